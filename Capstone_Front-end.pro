@@ -8,7 +8,7 @@ cache()
 
 QT       += core gui
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
 
 TARGET = Capstone_Front-end
 TEMPLATE = app
@@ -25,27 +25,9 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 
+include(gui.pri)
+
 SOURCES += \
-        main.cpp \
-        mainwindow.cpp \
-    building.cpp \
-    filereader.cpp \
-    buildingmodel.cpp \
-    renderarea.cpp \
-    filewriter.cpp
-
-HEADERS += \
-        mainwindow.h \
-    diagrammodels.h \
-    filereader.h \
-    propertymanager.h \
-    renderarea.h \
-    filewriter.h
-
-FORMS += \
-        mainwindow.ui
-
-RESOURCES += \
-    resources.qrc
+        main.cpp
 
 CONFIG += c++11
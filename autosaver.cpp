@@ -0,0 +1,139 @@
+#include "autosaver.h"
+#include "filewriter.h"
+#include "tracing.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrentRun>
+
+using namespace DiagramModels;
+
+//! Default time between autosaves
+static const int AUTOSAVE_INTERVAL = 2 * 60 * 1000;
+
+//! Holds the path of the file the recovered building was edited as
+static QString originPath(){
+    return Autosaver::recoveryPath() + ".origin";
+}
+
+Autosaver::Autosaver(QObject *parent):QObject(parent),_building(NULL),_loadFailed(false),_lastTickCost(0),_maxTickCost(0){
+    _timer.setInterval(AUTOSAVE_INTERVAL);
+    connect(&_timer,SIGNAL(timeout()),this,SLOT(tick()));
+    connect(&_writing,SIGNAL(finished()),this,SLOT(writeFinished()));
+}
+
+Autosaver::~Autosaver(){
+    _writing.waitForFinished();
+}
+
+QString Autosaver::recoveryPath(){
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    return QDir(dir).filePath("recovery.bldg");
+}
+
+bool Autosaver::hasRecovery(){
+    return QFileInfo::exists(recoveryPath());
+}
+
+QString Autosaver::recoveredFrom(){
+    QFile file(originPath());
+    if(!file.open(QIODevice::ReadOnly)) return QString();
+    return QString::fromUtf8(file.readAll());
+}
+
+QDateTime Autosaver::recoveryTime(){
+    return QFileInfo(recoveryPath()).lastModified();
+}
+
+void Autosaver::discard(){
+    QFile::remove(recoveryPath());
+    QFile::remove(originPath());
+}
+
+void Autosaver::setBuilding(Building *building, const QString &filepath){
+    _writing.waitForFinished();
+    _building = building;
+    _filepath = filepath;
+    _cache.clear();
+    _savedRevisions = revisions();
+    // floors still to load are checked by the write, loading them here would hold up the GUI thread
+    _loadFailed = false;
+    if(_building){
+        for(Floor* floor : _building->floors()){
+            if(!floor->loadError().isEmpty()) _loadFailed = true;
+        }
+    }
+    if(_building && !_loadFailed) _timer.start();
+    else _timer.stop();
+}
+
+void Autosaver::saved(const QString &filepath){
+    _writing.waitForFinished();
+    _filepath = filepath;
+    _savedRevisions = revisions();
+    discard();
+}
+
+QVector<quint64> Autosaver::revisions() const{
+    QVector<quint64> re;
+    if(!_building) return re;
+    for(Floor* floor : _building->floors()){
+        // an unloaded floor hasn't been edited, and loading leaves the revision where it was, so 0 either way
+        re << (floor->isLoaded() ? floor->revision() : 0);
+    }
+    return re;
+}
+
+void Autosaver::tick(){
+    if(!_building || _loadFailed || _writing.isRunning()) return;
+    TRACE_SPAN(traceSave,"autosave");
+    QElapsedTimer timer;
+    timer.start();
+    QVector<quint64> current = revisions();
+    if(current == _savedRevisions) return;
+
+    Building* snapshot = _building->snapshot(&_cache);
+    _savedRevisions = current;
+    QString filepath = _filepath;
+    _writing.setFuture(QtConcurrent::run([this,snapshot,filepath](){
+        QDir().mkpath(QFileInfo(recoveryPath()).absolutePath());
+        QString loadError;
+        if(snapshot->loadFailed(&loadError)){
+            // every later write would be refused the same way
+            _loadFailed = true;
+            _writeError = loadError + ", autosave is off until another building is opened";
+            delete snapshot;
+            return false;
+        }
+        bool ok = FileWriter::write(snapshot,recoveryPath(),&_writeError);
+        delete snapshot;
+        if(ok){
+            QSaveFile origin(originPath());
+            if(origin.open(QIODevice::WriteOnly)){
+                origin.write(filepath.toUtf8());
+                origin.commit();
+            }
+        }
+        return ok;
+    }));
+
+    _lastTickCost = timer.nsecsElapsed();
+    _maxTickCost = qMax(_maxTickCost,_lastTickCost);
+}
+
+void Autosaver::writeFinished(){
+    if(_writing.result()){
+        emit autosaved();
+    }else if(_loadFailed){
+        _timer.stop();
+        emit failed(_writeError);
+    }else{
+        // try again on the next tick
+        _savedRevisions.clear();
+        emit failed(_writeError);
+    }
+}
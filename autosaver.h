@@ -0,0 +1,92 @@
+#ifndef AUTOSAVER_H
+#define AUTOSAVER_H
+
+#include <QObject>
+#include <QString>
+#include <QDateTime>
+#include <QTimer>
+#include <QVector>
+#include <QFutureWatcher>
+
+#include "diagrammodels.h"
+
+/*!
+ * \brief The Autosaver class periodically writes the open building to a recovery file
+ *
+ * Each tick takes a snapshot on the GUI thread and writes it on a worker thread. Floors that
+ * haven't changed since the previous tick reuse the copy made then, so a tick costs roughly as much
+ * as the edits since the last one. Ticks with nothing new to save, or while the previous write is
+ * still running, are skipped. The GUI thread time of every tick is measured, see lastTickCost().
+ * A building with a floor that failed to load can't be saved, see FileWriter::write(), so autosaving
+ * it stops with a single failed() until another building is set.
+ *
+ * The recovery file is removed after a manual save and on a clean exit, so finding one at startup
+ * means the last session ended without saving its changes.
+ */
+class Autosaver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Autosaver(QObject* parent = 0);
+    //! Waits for a running write
+    ~Autosaver();
+
+    //! The file autosaves are written to
+    static QString recoveryPath();
+    //! If a previous session left a recovery file behind
+    static bool hasRecovery();
+    //! The file the recovered building was being edited as, empty if it was never saved
+    static QString recoveredFrom();
+    //! When the recovery file was written
+    static QDateTime recoveryTime();
+    //! Remove the recovery file
+    static void discard();
+
+    /*!
+     * \brief setBuilding autosave \param building from now on, or stop if it is NULL
+     * The building is taken to be saved as it is, the first autosave happens after its next edit.
+     * \param filepath the file the building is edited as, recorded with each autosave
+     */
+    void setBuilding(DiagramModels::Building* building, const QString& filepath);
+    //! The time between autosaves
+    void setInterval(int msec){_timer.setInterval(msec);}
+
+    //! GUI thread time of the last tick that took a snapshot, in nanoseconds
+    qint64 lastTickCost() const{return _lastTickCost;}
+    //! The longest GUI thread time of any tick, in nanoseconds
+    qint64 maxTickCost() const{return _maxTickCost;}
+
+public slots:
+    //! Snapshot the building if it changed and write it in the background
+    void tick();
+    //! The building is being saved as it is now, remove the recovery file and wait for the next edit
+    void saved(const QString& filepath);
+    //! A save reported through saved() didn't happen, autosave on the next tick
+    void unsaved(){_savedRevisions.clear();}
+
+signals:
+    //! An autosave was written
+    void autosaved();
+    //! An autosave couldn't be written
+    void failed(QString error);
+
+private slots:
+    void writeFinished();
+
+private:
+    //! The revision of every floor, compared between ticks to skip unchanged buildings
+    QVector<quint64> revisions() const;
+
+    QTimer _timer;
+    DiagramModels::Building* _building;
+    QString _filepath;
+    QVector<quint64> _savedRevisions; //! The floor revisions covered by the last save or autosave
+    DiagramModels::SnapshotCache _cache; //! Floor copies from the last tick
+    QFutureWatcher<bool> _writing;
+    QString _writeError;
+    bool _loadFailed; //! A floor of the building failed to load, set on the worker before the write finishes
+    qint64 _lastTickCost;
+    qint64 _maxTickCost;
+};
+
+#endif // AUTOSAVER_H
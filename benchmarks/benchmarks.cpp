@@ -0,0 +1,353 @@
+#include <QtTest>
+#include <QApplication>
+#include <QBuffer>
+#include <QImage>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <random>
+
+#include "diagrammodels.h"
+#include "binaryformat.h"
+#include "buildinggenerator.h"
+#include "connectiongraph.h"
+#include "roomadjacency.h"
+#include "filereader.h"
+#include "filewriter.h"
+#include "renderarea.h"
+
+using namespace DiagramModels;
+
+//! Floors of the generated buildings, the features are split evenly between them
+static const int FLOORS = 4;
+//! Points looked up per iteration of the hit-test and snapping benchmarks
+static const int QUERY_POINTS = 1000;
+//! Routes looked up per iteration of the route benchmark
+static const int QUERY_ROUTES = 100;
+
+/*!
+ * \brief The Benchmarks class times the editor's hot paths on generated buildings of 1k, 10k and 100k features
+ */
+class Benchmarks : public QObject
+{
+    Q_OBJECT
+private slots:
+    void cleanupTestCase();
+
+    void parseJson_data(){sizes();}
+    void parseJson();
+    void readJsonStream_data(){sizes();}
+    void readJsonStream();
+    void toJson_data(){sizes();}
+    void toJson();
+    void encodeBinary_data(){sizes();}
+    void encodeBinary();
+    void decodeBinary_data(){sizes();}
+    void decodeBinary();
+    void openBinary_data(){sizes();}
+    void openBinary();
+    void writeBinary_data(){sizes();}
+    void writeBinary();
+    void modelTraversal_data(){sizes();}
+    void modelTraversal();
+    void paint_data();
+    void paint();
+    void hitTest_data(){sizes();}
+    void hitTest();
+    void snapToRoom_data(){sizes();}
+    void snapToRoom();
+    void detectAdjacency_data(){sizes();}
+    void detectAdjacency();
+    void updateAdjacency_data(){sizes();}
+    void updateAdjacency();
+    void buildGraph_data(){sizes();}
+    void buildGraph();
+    void route_data();
+    void route();
+
+private:
+    //! The feature counts every benchmark runs at
+    static void sizes();
+    //! A building of \param features rooms, built once and kept for every benchmark
+    Building* building(int features);
+    //! The floor of \param building the floor-level benchmarks use
+    static Floor* busiestFloor(Building* building);
+    //! Fixed pseudo-random points over \param floor, the same for every run
+    static QVector<QPoint> queryPoints(Floor* floor);
+
+    QHash<int,Building*> _buildings;
+};
+
+void Benchmarks::sizes(){
+    QTest::addColumn<int>("features");
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+}
+
+Building* Benchmarks::building(int features){
+    if(_buildings.contains(features)) return _buildings[features];
+    GeneratorOptions options = BuildingGenerator::defaults();
+    options.floors = FLOORS;
+    options.roomsPerFloor = features / FLOORS;
+    options.verticesPerRoom = 6;
+    Building* re = BuildingGenerator::generate(options);
+    _buildings[features] = re;
+    return re;
+}
+
+Floor* Benchmarks::busiestFloor(Building *building){
+    Floor* re = building->floors().first();
+    for(Floor* floor : building->floors()){
+        if(floor->featureCount() > re->featureCount()) re = floor;
+    }
+    return re;
+}
+
+QVector<QPoint> Benchmarks::queryPoints(Floor *floor){
+    QRect extents = floor->extents();
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> x(extents.left(),extents.right());
+    std::uniform_int_distribution<int> y(extents.top(),extents.bottom());
+    QVector<QPoint> re;
+    for(int i = 0; i < QUERY_POINTS; i++) re << QPoint(x(random),y(random));
+    return re;
+}
+
+void Benchmarks::cleanupTestCase(){
+    qDeleteAll(_buildings);
+    _buildings.clear();
+}
+
+void Benchmarks::parseJson(){
+    QFETCH(int,features);
+    QByteArray json = QJsonDocument(building(features)->toJson()).toJson(QJsonDocument::Compact);
+    QBENCHMARK{
+        Building parsed(QJsonDocument::fromJson(json));
+    }
+}
+
+void Benchmarks::readJsonStream(){
+    QFETCH(int,features);
+    QByteArray json = QJsonDocument(building(features)->toJson()).toJson(QJsonDocument::Compact);
+    QBENCHMARK{
+        QBuffer buffer(&json);
+        buffer.open(QIODevice::ReadOnly);
+        delete FileReader::readJson(&buffer);
+    }
+}
+
+void Benchmarks::toJson(){
+    QFETCH(int,features);
+    Building* b = building(features);
+    QBENCHMARK{
+        QJsonDocument(b->toJson()).toJson(QJsonDocument::Compact);
+    }
+}
+
+void Benchmarks::encodeBinary(){
+    QFETCH(int,features);
+    Building* b = building(features);
+    QBENCHMARK{
+        BinaryFormat::encode(b);
+    }
+}
+
+void Benchmarks::decodeBinary(){
+    QFETCH(int,features);
+    QByteArray data = BinaryFormat::encode(building(features));
+    QBENCHMARK{
+        delete BinaryFormat::decode(data);
+    }
+}
+
+void Benchmarks::openBinary(){
+    QFETCH(int,features);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("building.bldg");
+    QVERIFY(FileWriter::write(building(features),path,BLDG_BINARY));
+    QBENCHMARK{
+        // what the editor waits for before it can show the first floor, the others are decoded later
+        Building* opened = BinaryFormat::open(path);
+        opened->floors().first()->features();
+        delete opened;
+    }
+}
+
+void Benchmarks::writeBinary(){
+    QFETCH(int,features);
+    Building* b = building(features);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("building.bldg");
+    bool written = false;
+    QBENCHMARK{
+        written = FileWriter::write(b,path,BLDG_BINARY);
+    }
+    QVERIFY(written);
+}
+
+void Benchmarks::modelTraversal(){
+    QFETCH(int,features);
+    // the model owns its building, give it a copy with every floor in memory
+    Building* copy = building(features)->snapshot();
+    for(Floor* floor : copy->floors()) floor->features();
+    BuildingModel model(copy);
+    int visited = 0;
+    QBENCHMARK{
+        visited = 0;
+        for(int f = 0; f < model.rowCount(); f++){
+            QModelIndex floor = model.index(f,0);
+            int rows = model.rowCount(floor);
+            for(int i = 0; i < rows; i++){
+                QModelIndex feature = model.index(i,0,floor);
+                model.data(feature);
+                visited++;
+            }
+        }
+    }
+    QCOMPARE(visited,features);
+}
+
+void Benchmarks::paint_data(){
+    QTest::addColumn<int>("features");
+    QTest::addColumn<bool>("wholeFloor");
+    QTest::addColumn<bool>("cached");
+    QTest::newRow("1k whole floor") << 1000 << true << false;
+    QTest::newRow("1k whole floor cached") << 1000 << true << true;
+    QTest::newRow("1k 1:1") << 1000 << false << false;
+    QTest::newRow("10k whole floor") << 10000 << true << false;
+    QTest::newRow("100k whole floor") << 100000 << true << false;
+}
+
+void Benchmarks::paint(){
+    QFETCH(int,features);
+    QFETCH(bool,wholeFloor);
+    QFETCH(bool,cached);
+    Floor* floor = busiestFloor(building(features));
+    RenderArea area;
+    area.resize(1024,768);
+    area.floor(floor);
+    if(wholeFloor){
+        QRect extents = floor->extents();
+        area.zoomAt(QPoint(0,0),qMin(1024.0 / extents.width(),768.0 / extents.height()));
+    }
+    QImage image(area.size(),QImage::Format_ARGB32_Premultiplied);
+    area.render(&image); // warm the geometry caches
+    QBENCHMARK{
+        if(!cached) area.invalidateStaticLayer();
+        area.render(&image);
+    }
+}
+
+void Benchmarks::hitTest(){
+    QFETCH(int,features);
+    Floor* floor = busiestFloor(building(features));
+    QVector<QPoint> points = queryPoints(floor);
+    int hits = 0;
+    QBENCHMARK{
+        hits = 0;
+        for(const QPoint& point : points){
+            if(floor->featureAt(point)) hits++;
+        }
+    }
+    QVERIFY(hits > 0);
+}
+
+void Benchmarks::snapToRoom(){
+    QFETCH(int,features);
+    Floor* floor = busiestFloor(building(features));
+    QVector<QPoint> points = queryPoints(floor);
+    RenderArea area;
+    area.floor(floor);
+    QBENCHMARK{
+        for(const QPoint& point : points) area.snapToRoom(point,10);
+    }
+}
+
+void Benchmarks::detectAdjacency(){
+    QFETCH(int,features);
+    Building* b = building(features);
+    int pairs = 0;
+    QBENCHMARK{
+        pairs = 0;
+        for(const QVector<Adjacency>& floor : RoomAdjacency::detect(b)) pairs += floor.size();
+    }
+    // the generated rooms are a grid, most share walls with the rooms either side and above and below
+    QVERIFY(pairs >= features);
+}
+
+void Benchmarks::updateAdjacency(){
+    QFETCH(int,features);
+    // a copy, the edits mustn't change the building the other benchmarks use
+    Building* copy = building(features)->snapshot();
+    Floor* floor = busiestFloor(copy);
+    RoomAdjacency adjacency(floor);
+    adjacency.pairs();
+    Feature* feature = floor->features()[floor->featureCount() / 2];
+    QPoint offset(1,0);
+    QBENCHMARK{
+        // nudge a room back and forth, each time only it is compared again
+        QPolygon bounds = feature->bounds();
+        bounds.translate(offset);
+        offset = -offset;
+        feature->bounds(bounds);
+        adjacency.neighbours(feature);
+    }
+    delete copy;
+}
+
+void Benchmarks::buildGraph(){
+    QFETCH(int,features);
+    Building* b = building(features);
+    int nodes = 0;
+    QBENCHMARK{
+        ConnectionGraph graph(b);
+        nodes = graph.nodeCount();
+    }
+    QCOMPARE(nodes,features);
+}
+
+void Benchmarks::route_data(){
+    QTest::addColumn<int>("features");
+    QTest::addColumn<bool>("cached");
+    QTest::newRow("1k") << 1000 << false;
+    QTest::newRow("1k cached") << 1000 << true;
+    QTest::newRow("10k") << 10000 << false;
+    QTest::newRow("10k cached") << 10000 << true;
+    QTest::newRow("100k") << 100000 << false;
+}
+
+void Benchmarks::route(){
+    QFETCH(int,features);
+    QFETCH(bool,cached);
+    Building* b = building(features);
+    QList<Feature*> all;
+    for(Floor* floor : b->floors()) all << floor->features();
+    // fixed pairs across the whole building, most of them a few floors apart
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> pick(0,all.size() - 1);
+    QVector<QPair<Feature*,Feature*> > pairs;
+    for(int i = 0; i < QUERY_ROUTES; i++) pairs << qMakePair(all[pick(random)],all[pick(random)]);
+    ConnectionGraph graph(b);
+    graph.nodeCount(); // build it outside the timing
+    int found = 0;
+    QBENCHMARK{
+        if(!cached) graph.clearRouteCache();
+        found = 0;
+        for(const QPair<Feature*,Feature*>& pair : pairs){
+            if(!graph.route(pair.first,pair.second).features.isEmpty()) found++;
+        }
+    }
+    QVERIFY(found > 0);
+}
+
+int main(int argc, char *argv[]){
+    // no display needed, the paint benchmarks render into images
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM","offscreen");
+    QApplication app(argc,argv);
+    Benchmarks benchmarks;
+    return QTest::qExec(&benchmarks,argc,argv);
+}
+
+#include "benchmarks.moc"
@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# Benchmarks for loading, saving, hit-testing and painting.
+# Runs headless, results go to benchmarks.xml for comparing between releases:
+#     qmake && make && make benchmark
+#
+#-------------------------------------------------
+
+QT       += core gui widgets concurrent testlib
+
+TARGET = benchmarks
+TEMPLATE = app
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../gui.pri)
+
+SOURCES += \
+    benchmarks.cpp
+
+# QT_QPA_PLATFORM defaults to offscreen in main(), pass -o <file>,csv or -o <file>,junitxml for other formats
+benchmark.commands = ./$$TARGET -o benchmarks.xml,xml -o -,txt
+benchmark.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += benchmark
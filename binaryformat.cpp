@@ -0,0 +1,351 @@
+#include "binaryformat.h"
+#include "bytestream.h"
+#include "tracing.h"
+
+#include <QHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QtConcurrent/QtConcurrentMap>
+#include <functional>
+
+using namespace DiagramModels;
+
+namespace{
+    //! Hands out one index per distinct string
+    class StringTable{
+    public:
+        int intern(const QString& s){
+            QHash<QString,int>::const_iterator it = _ids.find(s);
+            if(it != _ids.end()) return *it;
+            int id = _strings.size();
+            _ids.insert(s,id);
+            _strings << s;
+            return id;
+        }
+        const QStringList& strings() const{return _strings;}
+
+    private:
+        QHash<QString,int> _ids;
+        QStringList _strings;
+    };
+
+    bool fail(QString* error, const QString& message){
+        if(error) *error = message;
+        return false;
+    }
+
+    // header: magic, version, flags, floor count
+    const int FIXED_HEADER_SIZE = 4 + 2 + 2 + 4;
+
+    //! A binary building file kept mapped for the floors that have not been decoded yet
+    class MappedFile{
+    public:
+        QFile file;
+        QString path; // canonical, to find the mapping again in BinaryFormat::release()
+        QByteArray data; // a raw view of the mapping, or the contents if mapping is not supported or was released
+        BinaryFormat::Directory directory;
+        QReadWriteLock lock; // read while a floor is decoded, written while the mapping is swapped for a copy
+    };
+
+    //! Every file opened by BinaryFormat::open() whose floors may still be decoded
+    QMutex mappedFilesMutex;
+    QList<QWeakPointer<MappedFile> > mappedFiles;
+
+    //! Decodes one floor chunk from a mapped file
+    class BinaryFloorLoader: public FloorLoader{
+    public:
+        BinaryFloorLoader(QSharedPointer<MappedFile> file, int index):_file(file),_index(index){}
+        bool load(Floor* floor, QList<Feature*>* features, QString* error) override{
+            QReadLocker lock(&_file->lock);
+            return BinaryFormat::decodeFloor(_file->data,_file->directory,_index,floor,features,error);
+        }
+
+    private:
+        QSharedPointer<MappedFile> _file;
+        int _index;
+    };
+}
+
+QByteArray BinaryFormat::encode(Building *building, IoMonitor *monitor){
+    TRACE_SPAN(traceSave,"encodeBinary");
+    StringTable strings;
+    int buildingName = strings.intern(building->name());
+
+    QList<QByteArray> chunks;
+    QList<int> offsetPositions; // where each chunk offset sits in the directory
+    QByteArray directory;
+    ByteWriter dir(&directory);
+    QList<Floor*> floors = building->floors();
+    for(Floor* floor : floors){
+        if(monitor && monitor->isCancelled()) return QByteArray();
+        QByteArray chunk;
+        ByteWriter out(&chunk);
+        QPoint cursor;
+        QRect extents;
+        int vertexCount = 0;
+        QList<Feature*> features = floor->features();
+        QVector<quint64> connections;
+        for(int i = 0; i < features.size(); i++){
+            Feature* feature = features[i];
+            out.u8(quint8(feature->type()));
+            out.varint(strings.intern(feature->name()));
+            const QPolygon& bounds = feature->bounds();
+            out.varint(bounds.size());
+            for(const QPoint& p : bounds){
+                out.zigzag(p.x() - cursor.x());
+                out.zigzag(p.y() - cursor.y());
+                cursor = p;
+            }
+            vertexCount += bounds.size();
+            if(!bounds.isEmpty()) extents |= feature->boundingRect();
+            for(const FeatureConnection& con : feature->connections()){
+                connections << quint64(i) << quint64(con.floor_index) << quint64(con.feature_index);
+            }
+        }
+        out.varint(connections.size() / 3);
+        for(quint64 v : connections) out.varint(v);
+        chunks << chunk;
+
+        dir.varint(strings.intern(floor->name()));
+        dir.varint(features.size());
+        dir.varint(vertexCount);
+        dir.zigzag(extents.x());
+        dir.zigzag(extents.y());
+        dir.zigzag(extents.width());
+        dir.zigzag(extents.height());
+        offsetPositions << directory.size();
+        dir.u64(0); // chunk offset, patched below once the directory size is known
+        dir.u32(chunk.size());
+        dir.u16(qChecksum(chunk.constData(),chunk.size()));
+        if(monitor) monitor->progress(chunks.size(),floors.size());
+    }
+
+    QByteArray data;
+    ByteWriter out(&data);
+    data.append("BLDG",4);
+    out.u16(VERSION);
+    out.u16(0);
+    out.u32(building->floorCount());
+    out.varint(buildingName);
+    out.varint(strings.strings().size());
+    for(const QString& s : strings.strings()) out.string(s);
+
+    // the chunks follow the directory, whose size no longer depends on the offsets
+    quint64 offset = data.size() + directory.size();
+    for(int i = 0; i < chunks.size(); i++){
+        for(int b = 0; b < 8; b++) directory[offsetPositions[i] + b] = char((offset >> (8*b)) & 0xff);
+        offset += chunks[i].size();
+    }
+    data.append(directory);
+    for(const QByteArray& chunk : chunks) data.append(chunk);
+    return data;
+}
+
+bool BinaryFormat::readDirectory(const QByteArray &data, Directory *directory, QString *error){
+    if(data.size() < FIXED_HEADER_SIZE || !isBinary(data)){
+        return fail(error,"Not a binary building file");
+    }
+    ByteReader in(data,4,data.size());
+    directory->version = in.u16();
+    if(directory->version > VERSION){
+        return fail(error,QString("Unsupported binary building version %1").arg(directory->version));
+    }
+    in.u16(); // flags
+    quint32 floorCount = in.u32();
+    quint64 nameId = in.varint();
+    quint64 stringCount = in.varint();
+    if(!in.ok() || stringCount > quint64(data.size())){
+        return fail(error,QString("Truncated header at byte %1").arg(in.pos()));
+    }
+    directory->strings.clear();
+    directory->strings.reserve(int(stringCount));
+    for(quint64 i = 0; i < stringCount; i++){
+        int length = int(in.varint());
+        directory->strings << QString::fromUtf8(in.bytes(length));
+        if(!in.ok()) return fail(error,QString("Truncated string table at byte %1").arg(in.pos()));
+    }
+    if(nameId >= stringCount) return fail(error,"Building name is not in the string table");
+    directory->name = directory->strings[int(nameId)];
+
+    directory->floors.clear();
+    for(quint32 i = 0; i < floorCount; i++){
+        FloorEntry entry;
+        quint64 floorName = in.varint();
+        quint64 featureCount = in.varint();
+        quint64 vertexCount = in.varint();
+        int x = int(in.zigzag()), y = int(in.zigzag());
+        int w = int(in.zigzag()), h = int(in.zigzag());
+        entry.extents = QRect(x,y,w,h);
+        entry.offset = in.u64();
+        entry.size = in.u32();
+        entry.checksum = in.u16();
+        if(!in.ok()) return fail(error,QString("Truncated floor directory at byte %1").arg(in.pos()));
+        if(floorName >= stringCount) return fail(error,QString("Floor %1 name is not in the string table").arg(i));
+        // every feature and every vertex takes at least a byte of the chunk
+        if(featureCount > entry.size || vertexCount > entry.size){
+            return fail(error,QString("Floor %1 counts don't fit its chunk at byte %2").arg(i).arg(in.pos()));
+        }
+        entry.featureCount = int(featureCount);
+        entry.vertexCount = int(vertexCount);
+        if(entry.offset > quint64(data.size()) || entry.size > quint64(data.size()) - entry.offset){
+            return fail(error,QString("Floor %1 chunk at byte %2 runs past the end of the file").arg(i).arg(entry.offset));
+        }
+        entry.name = directory->strings[int(floorName)];
+        directory->floors << entry;
+    }
+    return true;
+}
+
+bool BinaryFormat::decodeFloor(const QByteArray &data, const Directory &directory, int index, Floor *floor,
+                               QList<Feature*>* decoded, QString *error){
+    TRACE_SPAN(traceLoad,"decodeFloor");
+    const FloorEntry& entry = directory.floors[index];
+    int begin = int(entry.offset);
+    if(qChecksum(data.constData() + begin,entry.size) != entry.checksum){
+        return fail(error,QString("Floor %1 chunk at byte %2 fails its checksum").arg(index).arg(begin));
+    }
+    ByteReader in(data,begin,begin + int(entry.size));
+    QPoint cursor;
+    QList<Feature*> features;
+    for(int i = 0; i < entry.featureCount; i++){
+        quint8 type = in.u8();
+        quint64 name = in.varint();
+        quint64 vertexCount = in.varint();
+        if(!in.ok() || vertexCount > entry.size){
+            qDeleteAll(features);
+            return fail(error,QString("Truncated feature at byte %1").arg(in.pos()));
+        }
+        if(name >= quint64(directory.strings.size()) || type > STAIRS){
+            qDeleteAll(features);
+            return fail(error,QString("Bad feature header at byte %1").arg(in.pos()));
+        }
+        QPolygon bounds;
+        bounds.reserve(int(vertexCount));
+        for(quint64 v = 0; v < vertexCount; v++){
+            int dx = int(in.zigzag());
+            int dy = int(in.zigzag());
+            cursor += QPoint(dx,dy);
+            bounds << cursor;
+        }
+        if(!in.ok()){
+            qDeleteAll(features);
+            return fail(error,QString("Truncated vertices at byte %1").arg(in.pos()));
+        }
+        Feature* feature = new Feature(FeatureType(type),bounds,floor);
+        feature->name(directory.strings[int(name)]);
+        features << feature;
+    }
+    quint64 connectionCount = in.varint();
+    if(!in.ok() || connectionCount > entry.size){
+        qDeleteAll(features);
+        return fail(error,QString("Truncated connection table at byte %1").arg(in.pos()));
+    }
+    int dangling = 0;
+    for(quint64 i = 0; i < connectionCount; i++){
+        quint64 feature = in.varint();
+        quint64 conFloor = in.varint();
+        quint64 conFeature = in.varint();
+        if(!in.ok() || feature >= quint64(features.size())){
+            qDeleteAll(features);
+            return fail(error,QString("Bad connection at byte %1").arg(in.pos()));
+        }
+        // resolved against the directory, so lazily loaded floors needn't wait for the others
+        if(conFloor >= quint64(directory.floors.size()) ||
+                conFeature >= quint64(directory.floors[int(conFloor)].featureCount)){
+            dangling++;
+            continue;
+        }
+        features[int(feature)]->addConnection(int(conFloor),int(conFeature));
+    }
+    if(dangling > 0){
+        qWarning("Dropped %d dangling connection(s) from floor %d",dangling,index);
+    }
+    *decoded = features;
+    return true;
+}
+
+Building* BinaryFormat::decode(const QByteArray &data, QString *error){
+    TRACE_SPAN(traceLoad,"decodeBinary");
+    Directory directory;
+    if(!readDirectory(data,&directory,error)) return NULL;
+    QList<Floor*> floors;
+    for(int i = 0; i < directory.floors.size(); i++) floors << new Floor(i,directory.floors[i].name);
+
+    // the chunks are independent, each task decodes one into its own floor
+    QVector<QString> errors(floors.size());
+    std::function<bool(Floor*)> decodeInto = [&data,&directory,&errors](Floor* floor){
+        int i = floor->floorIndex();
+        QList<Feature*> features;
+        if(!decodeFloor(data,directory,i,floor,&features,&errors[i])) return false;
+        for(Feature* feature : features) floor->addFeature(feature);
+        return true;
+    };
+    QList<bool> decoded;
+    if(Building::singleThreadedLoading() || floors.size() < 2){
+        for(Floor* floor : floors) decoded << decodeInto(floor);
+    }else{
+        decoded = QtConcurrent::blockingMapped<QList<bool> >(floors,decodeInto);
+    }
+    int failed = decoded.indexOf(false);
+    if(failed >= 0){
+        if(error) *error = errors[failed];
+        qDeleteAll(floors);
+        return NULL;
+    }
+    return new Building(directory.name,floors);
+}
+
+Building* BinaryFormat::open(const QString &filename, QString *error){
+    QSharedPointer<MappedFile> mapped(new MappedFile());
+    mapped->file.setFileName(filename);
+    if(!mapped->file.open(QIODevice::ReadOnly)){
+        if(error) *error = mapped->file.errorString();
+        return NULL;
+    }
+    mapped->path = QFileInfo(filename).canonicalFilePath();
+    uchar* view = mapped->file.size() > 0 ? mapped->file.map(0,mapped->file.size()) : NULL;
+    if(view){
+        mapped->data = QByteArray::fromRawData(reinterpret_cast<const char*>(view),int(mapped->file.size()));
+    }else{
+        mapped->data = mapped->file.readAll();
+        mapped->file.close();
+    }
+    if(!readDirectory(mapped->data,&mapped->directory,error)) return NULL;
+    if(mapped->file.isOpen()){
+        QMutexLocker lock(&mappedFilesMutex);
+        mappedFiles << mapped;
+    }
+
+    QList<Floor*> floors;
+    for(int i = 0; i < mapped->directory.floors.size(); i++){
+        const FloorEntry& entry = mapped->directory.floors[i];
+        QSharedPointer<FloorLoader> loader(new BinaryFloorLoader(mapped,i));
+        floors << new Floor(i,entry.name,loader,entry.featureCount,entry.extents);
+    }
+    return new Building(mapped->directory.name,floors);
+}
+
+void BinaryFormat::release(const QString &filename){
+    QString path = QFileInfo(filename).canonicalFilePath();
+    if(path.isEmpty()) return;
+    QList<QSharedPointer<MappedFile> > matching;
+    {
+        QMutexLocker lock(&mappedFilesMutex);
+        for(int i = mappedFiles.size() - 1; i >= 0; i--){
+            QSharedPointer<MappedFile> mapped = mappedFiles[i].toStrongRef();
+            if(!mapped || mapped->path == path){
+                mappedFiles.removeAt(i);
+                if(mapped) matching << mapped;
+            }
+        }
+    }
+    for(QSharedPointer<MappedFile> mapped : matching){
+        TRACE_SPAN(traceSave,"releaseMapping");
+        // waits for floors being decoded from the mapping, later ones decode from the copy
+        QWriteLocker lock(&mapped->lock);
+        mapped->data = QByteArray(mapped->data.constData(),mapped->data.size());
+        mapped->file.close();
+    }
+}
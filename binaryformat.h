@@ -0,0 +1,121 @@
+#ifndef BINARYFORMAT_H
+#define BINARYFORMAT_H
+
+#include <QByteArray>
+#include <QRect>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "diagrammodels.h"
+#include "iomonitor.h"
+
+/*!
+ * \brief The BinaryFormat class reads and writes the compact binary .bldg container
+ *
+ * Layout, all fixed width integers little endian:
+ *  - header: "BLDG", u16 version, u16 flags, u32 floor count, varint building name
+ *  - string table: varint count, then varint length + UTF-8 bytes for every name
+ *  - floor directory: per floor, varint name, varint feature count, varint vertex count,
+ *    zigzag varint extents (x, y, width, height), u64 chunk offset, u32 chunk size, u16 checksum
+ *  - floor chunks: per feature, u8 type, varint name, varint vertex count and zigzag varint
+ *    vertex deltas from the previous vertex in the chunk; then the connection table,
+ *    varint count and (feature, floor, target feature) varint triples
+ */
+class BinaryFormat
+{
+public:
+    enum{
+        VERSION = 1
+    };
+
+    //! An entry in the floor directory
+    typedef struct{
+        QString name;
+        int featureCount;
+        int vertexCount;
+        QRect extents;
+        quint64 offset;
+        quint32 size;
+        quint16 checksum;
+    }FloorEntry;
+
+    //! The parts of a file that are read before any floor is decoded
+    typedef struct{
+        int version;
+        QString name;
+        QStringList strings;
+        QVector<FloorEntry> floors;
+    }Directory;
+
+    /*!
+     * \brief isBinary check for the binary header magic
+     * \param header at least the first four bytes of a file
+     * \return if the data is a binary building file
+     */
+    static bool isBinary(const QByteArray& header){
+        return header.startsWith("BLDG");
+    }
+
+    /*!
+     * \brief encode serialise a building to the binary format
+     * \param building
+     * \param monitor reports a step per floor, encoding stops early if it is cancelled
+     * \return the file contents, or an empty array if cancelled
+     */
+    static QByteArray encode(DiagramModels::Building* building, IoMonitor* monitor = 0);
+
+    /*!
+     * \brief decode build a building from the binary format
+     * The floor chunks are decoded in parallel on the global thread pool unless
+     * Building::setSingleThreadedLoading() is on.
+     * \param data the file contents
+     * \param error set to a description of the problem if decoding fails
+     * \return the building, or NULL if the data is malformed
+     */
+    static DiagramModels::Building* decode(const QByteArray& data, QString* error = 0);
+
+    /*!
+     * \brief open map a binary building file and read only its directory
+     * Each floor is created with its name, feature count and extents, its features are
+     * decoded from the mapped file the first time the floor is used. The file stays open until every
+     * floor is decoded or release() is called for it.
+     * \param filename
+     * \param error set to a description of the problem if opening fails
+     * \return the building, or NULL if the file can't be read or its directory is malformed
+     */
+    static DiagramModels::Building* open(const QString& filename, QString* error = 0);
+
+    /*!
+     * \brief release let a file opened by open() be written over
+     * The floors not decoded yet get a copy of the file in memory and the mapping is closed; on Windows
+     * a mapped file can't be replaced. Call before renaming over \param filename, waits for floors being
+     * decoded from it. Does nothing if no building is still decoding from the file.
+     */
+    static void release(const QString& filename);
+
+    /*!
+     * \brief readDirectory read the header, string table and floor directory without decoding any floor
+     * \param data the file contents, or at least everything before the first chunk
+     * \param directory filled in from the data
+     * \param error set to a description of the problem if reading fails
+     * \return false if the data is malformed
+     */
+    static bool readDirectory(const QByteArray& data, Directory* directory, QString* error = 0);
+
+    /*!
+     * \brief decodeFloor decode the features of one floor chunk
+     * \param data the file contents
+     * \param directory the directory read from data
+     * \param index which floor to decode
+     * \param floor the floor the features belong to
+     * \param features filled with the decoded features, they are not added to the floor; connections
+     * to floors or features the directory doesn't have are dropped
+     * \param error set to a description of the problem if decoding fails
+     * \return false if the chunk is malformed, features is left empty
+     */
+    static bool decodeFloor(const QByteArray& data, const Directory& directory, int index, DiagramModels::Floor* floor,
+                            QList<DiagramModels::Feature*>* features, QString* error = 0);
+};
+
+#endif // BINARYFORMAT_H
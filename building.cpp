@@ -1,12 +1,17 @@
 #include "diagrammodels.h"
+#include "tracing.h"
 using namespace DiagramModels;
 
 #include <QJsonObject>
 #include <QJsonArray>
-#include <QDebug>
 #include <QStringList>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <functional>
 
-Building::Building(QString name, QList<DiagramModels::Floor*> floors):_floors(floors),_name(name){}
+Building::Building(QString name, QList<DiagramModels::Floor*> floors):_floors(floors),_name(name){
+    resolveConnections();
+}
 
 QJsonObject Building::toJson(){
     QJsonObject obj;
@@ -20,7 +25,7 @@ QJsonObject Building::toJson(){
         for(Feature* feat : f->features()){
             QJsonObject featObj;
             QJsonArray boundXY;
-            for(QPoint p : feat->bounds()){
+            for(const QPoint& p : feat->bounds()){
                 QJsonValue x(p.x());
                 QJsonValue y(p.y());
                 boundXY.append(x);
@@ -48,67 +53,223 @@ QJsonObject Building::toJson(){
     return obj;
 }
 
-Building::Building(QJsonDocument document){
-    QJsonObject object = document.object();
-    double version_id = object["version_id"].toDouble();
-    qDebug() << "Version ID: " << version_id;
-    QString buildingName = object["name"].toString();
-    QJsonArray floors = object["floors"].toArray();
-    _name = buildingName;
-    for(int i = 0; i < floors.size();i++){
-        QJsonObject floor = floors[i].toObject();
-        QString name = floor["name"].toString();
-        QJsonArray features = floor["features"].toArray();       
-        Floor* bFloor = new Floor(i,name);
-        qDebug() << "Add floor: " << name << "::" << bFloor;
+bool Building::_singleThreadedLoading = false;
+
+namespace{
+    //! A floor waiting to be built from its JSON object
+    typedef struct{
+        int index;
+        QJsonObject json;
+        Floor* floor;
+    }FloorJob;
+
+    //! Build the floor and its features, touches nothing outside the job so floors can be built in parallel
+    void buildFloor(FloorJob& job){
+        TRACE_SPAN(traceLoad,"buildFloor");
+        job.floor = new Floor(job.index,job.json["name"].toString());
+        QJsonArray features = job.json["features"].toArray();
         for(int j = 0; j < features.size();j++){
             QJsonObject f = features[j].toObject();
             QJsonArray boundXY = f["bounds"].toArray();
-            qDebug() << "Found feature";
             QPolygon bounds;
+            bounds.reserve(boundXY.size()/2);
             for(int _j = 0; _j < boundXY.size()-1;_j+=2){
                 int x = (int)boundXY[_j].toDouble();
                 int y = (int)boundXY[_j+1].toDouble();
-                bounds << QPoint(x,y);                
-            }            
-            qDebug() << "Bounds: " << bounds;
-            QString type = f["type"].toString();
-            FeatureType fType;
-            if(type == "STAIRS")    fType = FeatureType::STAIRS;
-            else if(type == "ROOM")      fType = FeatureType::ROOM;
-            int link = -1;
-            if( f.contains("link")){
-                link = f["link"].toString().toInt();
+                bounds << QPoint(x,y);
             }
+            QString type = f["type"].toString();
+            FeatureType fType = type.toUpper() == "STAIRS" ? STAIRS : ROOM;
             QString featName = type;
-            qDebug() << type;
             if(f.contains("name")){
                 featName = f["name"].toString();
             }
 
             QSet<FeatureConnection> featureConnections;
-            if(f.keys().contains("connections")){
-                QJsonArray connections = f["connections"].toArray();
-                for(int k = 0; k < connections.size();k++){
-                    QJsonObject con = connections[k].toObject();
-                    FeatureConnection connection;
-                    connection.feature_index = (int)con["feature"].toDouble();
-                    connection.floor_index = (int)con["floor"].toDouble();
-                    featureConnections << connection;
-                }
+            QJsonArray connections = f["connections"].toArray();
+            for(int k = 0; k < connections.size();k++){
+                QJsonObject con = connections[k].toObject();
+                FeatureConnection connection;
+                connection.feature_index = (int)con["feature"].toDouble();
+                connection.floor_index = (int)con["floor"].toDouble();
+                featureConnections << connection;
             }
-            Feature* feature = new Feature(fType,bounds,bFloor);
+            Feature* feature = new Feature(fType,bounds,job.floor);
             feature->connections(featureConnections);
-            qDebug() << "Connections found";
             feature->name(featName);
-            bFloor->addFeature(feature);
-            qDebug() << "Feature" << featName << ": "<<feature;
+            job.floor->addFeature(feature);
         }
-        _floors << bFloor;
     }
+}
+
+namespace{
+    //! Rebuilds the features of a snapshot floor from the copied values
+    class SnapshotLoader: public FloorLoader{
+    public:
+        explicit SnapshotLoader(QVector<FeatureState> features):_features(features){}
+
+        bool load(Floor *floor, QList<Feature *> *features, QString *error) override{
+            Q_UNUSED(error);
+            features->reserve(_features.size());
+            for(const FeatureState& state : _features){
+                Feature* feature = new Feature(state.type,state.bounds,floor);
+                feature->name(state.name);
+                feature->connections(state.connections);
+                *features << feature;
+            }
+            // kept, a snapshot of this snapshot shares the loader
+            return true;
+        }
+
+    private:
+        const QVector<FeatureState> _features; // const, so loading from several threads never detaches it
+    };
+
+    //! Stands in for a floor that failed to load, so its snapshot fails the same way
+    class FailedLoader: public FloorLoader{
+    public:
+        explicit FailedLoader(QString error):_error(error){}
+
+        bool load(Floor *floor, QList<Feature *> *features, QString *error) override{
+            Q_UNUSED(floor);
+            Q_UNUSED(features);
+            if(error) *error = _error;
+            return false;
+        }
+
+    private:
+        QString _error;
+    };
+}
 
+Building* Building::snapshot(SnapshotCache* cache){
+    TRACE_SPAN(traceSave,"snapshot");
+    QList<Floor*> floors;
+    for(Floor* floor : _floors){
+        // decoding a floor just to copy it would hold up the GUI thread, the copy decodes it when it is saved
+        QSharedPointer<FloorLoader> pending = floor->pendingLoader();
+        if(pending){
+            floors << new Floor(floor->floorIndex(),floor->name(),pending,floor->featureCount(),floor->extents());
+            continue;
+        }
+        if(floor->loadFailed()){
+            QSharedPointer<FloorLoader> loader(new FailedLoader(floor->loadError()));
+            floors << new Floor(floor->floorIndex(),floor->name(),loader,0,QRect());
+            continue;
+        }
+        quint64 revision = floor->revision();
+        QVector<FeatureState> states;
+        SnapshotCache::const_iterator cached = cache ? cache->constFind(floor) : SnapshotCache::const_iterator();
+        if(cache && cached != cache->constEnd() && cached->first == revision){
+            states = cached->second;
+        }else{
+            QList<Feature*> features = floor->features();
+            states.reserve(features.size());
+            for(Feature* feature : features){
+                // implicitly shared copies, cheap enough to take on the GUI thread
+                FeatureState state = {feature->type(),feature->name(),feature->bounds(),feature->connections()};
+                states << state;
+            }
+            if(cache) cache->insert(floor,qMakePair(revision,states));
+        }
+        QSharedPointer<FloorLoader> loader(new SnapshotLoader(states));
+        floors << new Floor(floor->floorIndex(),floor->name(),loader,states.size(),floor->extents());
+    }
+    return new Building(_name,floors);
+}
+
+Building::Building(QJsonDocument document){
+    TRACE_SPAN(traceLoad,"buildBuilding");
+    QJsonObject object = document.object();
+    _name = object["name"].toString();
+    QJsonArray floors = object["floors"].toArray();
+
+    // floors don't refer to each other until connections are resolved, so they are built independently
+    QVector<FloorJob> jobs(floors.size());
+    for(int i = 0; i < floors.size();i++){
+        jobs[i].index = i;
+        jobs[i].json = floors[i].toObject();
+        jobs[i].floor = NULL;
+    }
+    if(_singleThreadedLoading || jobs.size() < 2){
+        for(FloorJob& job : jobs) buildFloor(job);
+    }else{
+        QtConcurrent::blockingMap(jobs,buildFloor);
+    }
+    // results are collected in document order whichever thread built them
+    for(const FloorJob& job : jobs) _floors << job.floor;
+    resolveConnections();
+}
+
+Building::Building(QString name, const QVector<FloorState> &floors):_name(name){
+    TRACE_SPAN(traceLoad,"buildBuilding");
+    QVector<int> indexes(floors.size());
+    for(int i = 0; i < indexes.size(); i++) indexes[i] = i;
+    // each task builds one floor and its indexes, touching nothing shared
+    std::function<Floor*(int)> build = [&floors](int index){
+        TRACE_SPAN(traceLoad,"buildFloor");
+        Floor* floor = new Floor(index,floors[index].name);
+        for(const FeatureState& state : floors[index].features){
+            Feature* feature = new Feature(state.type,state.bounds,floor);
+            feature->name(state.name);
+            feature->connections(state.connections);
+            floor->addFeature(feature);
+        }
+        return floor;
+    };
+    if(_singleThreadedLoading || indexes.size() < 2){
+        for(int index : indexes) _floors << build(index);
+    }else{
+        // results come back in building order whichever thread built them
+        _floors = QtConcurrent::blockingMapped<QList<Floor*> >(indexes,build);
+    }
+    resolveConnections();
+}
+
+void Building::resolveConnections(){
+    for(Floor* floor : _floors){
+        if(!floor->isLoaded()) continue;
+        for(Feature* feature : floor->features()){
+            QSet<FeatureConnection> connections = feature->connections();
+            QSet<FeatureConnection> valid;
+            for(const FeatureConnection& con : connections){
+                if(con.floor_index < 0 || con.floor_index >= _floors.size()) continue;
+                if(con.feature_index < 0 || con.feature_index >= _floors[con.floor_index]->featureCount()) continue;
+                valid << con;
+            }
+            if(valid.size() != connections.size()){
+                qWarning("Dropped %d dangling connection(s) from feature \"%s\" on floor %d",
+                         connections.size() - valid.size(),qPrintable(feature->name()),floor->floorIndex());
+                feature->connections(valid);
+            }
+        }
+    }
+}
+
+bool Building::loadFailed(QString *error){
+    for(Floor* floor : _floors){
+        if(floor->loadFailed()){
+            if(error) *error = QString("Floor \"%1\" couldn't be read: %2").arg(floor->name()).arg(floor->loadError());
+            return true;
+        }
+    }
+    return false;
+}
+
+void Building::loadInBackground(){
+    if(_loading.isRunning()) return;
+    QList<Floor*> floors = _floors;
+    QAtomicInt* stop = &_stopLoading;
+    _loading = QtConcurrent::run([floors,stop](){
+        for(Floor* floor : floors){
+            if(stop->loadAcquire()) return;
+            floor->ensureLoaded();
+        }
+    });
 }
 
 Building::~Building(){    
+    _stopLoading.storeRelease(1);
+    _loading.waitForFinished();
     qDeleteAll(_floors);
 }
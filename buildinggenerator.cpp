@@ -0,0 +1,111 @@
+#include "buildinggenerator.h"
+
+#include <QtMath>
+
+using namespace DiagramModels;
+
+//! Average size of a generated room, in floor units
+static const int ROOM_WIDTH = 100;
+static const int ROOM_HEIGHT = 80;
+
+GeneratorOptions BuildingGenerator::defaults(){
+    GeneratorOptions options;
+    options.seed = 1;
+    options.floors = 5;
+    options.roomsPerFloor = 200;
+    options.verticesPerRoom = 4;
+    options.stairDensity = 0.02;
+    options.connectionFanOut = 1;
+    return options;
+}
+
+int BuildingGenerator::range(int low, int high){
+    return low + int(_random() % quint32(high - low + 1));
+}
+
+double BuildingGenerator::unit(){
+    return _random() / 4294967296.0;
+}
+
+QVector<int> BuildingGenerator::split(int total, int parts, int minimum){
+    QVector<int> re(parts,minimum);
+    int spare = total - parts * minimum;
+    for(int i = 0; i < spare; i++) re[range(0,parts - 1)]++;
+    return re;
+}
+
+QPolygon BuildingGenerator::room(const QRect &rect, int vertices){
+    // the far edges are x + width and y + height, so the next room starts on the same wall
+    int left = rect.x(), top = rect.y(), right = rect.x() + rect.width(), bottom = rect.y() + rect.height();
+    QPoint corners[4] = {QPoint(left,top),QPoint(right,top),QPoint(right,bottom),QPoint(left,bottom)};
+    // how many extra vertices go on each wall, walked clockwise from the top left
+    int extra[4] = {0,0,0,0};
+    for(int i = 4; i < vertices; i++) extra[range(0,3)]++;
+    QPolygon re;
+    for(int side = 0; side < 4; side++){
+        QPoint from = corners[side], to = corners[(side + 1) % 4];
+        re << from;
+        for(int i = 1; i <= extra[side]; i++){
+            re << from + (to - from) * i / (extra[side] + 1);
+        }
+    }
+    return re;
+}
+
+Floor* BuildingGenerator::floor(int index, const GeneratorOptions &options){
+    Floor* re = new Floor(index,QString("Floor %1").arg(index + 1));
+    int rooms = options.roomsPerFloor;
+    int columns = qMax(1,qCeil(qSqrt(rooms)));
+    int rows = qMax(1,(rooms + columns - 1) / columns);
+    // varied column widths and row heights, rooms on a row or column still share their walls
+    QVector<int> widths = split(columns * ROOM_WIDTH,columns,ROOM_WIDTH / 2);
+    QVector<int> heights = split(rows * ROOM_HEIGHT,rows,ROOM_HEIGHT / 2);
+
+    int stairs = 0;
+    int y = 0;
+    for(int row = 0, i = 0; row < rows; row++){
+        int x = 0;
+        for(int column = 0; column < columns && i < rooms; column++, i++){
+            QRect rect(x,y,widths[column],heights[row]);
+            x += widths[column];
+            bool isStairs = unit() < options.stairDensity;
+            // every floor gets a staircase when there are any
+            if(!isStairs && options.stairDensity > 0 && stairs == 0 && i == rooms - 1) isStairs = true;
+            Feature* feature = new Feature(isStairs ? STAIRS : ROOM,room(rect,qMax(4,options.verticesPerRoom)),re);
+            feature->name(isStairs ? QString("Stairs %1-%2").arg(index + 1).arg(++stairs)
+                                   : QString("Room %1-%2").arg(index + 1).arg(i + 1));
+            re->addFeature(feature);
+        }
+        y += heights[row];
+    }
+    return re;
+}
+
+Building* BuildingGenerator::generate(const GeneratorOptions &options){
+    BuildingGenerator generator(options.seed);
+    QList<Floor*> floors;
+    for(int f = 0; f < options.floors; f++) floors << generator.floor(f,options);
+
+    QVector<QList<int> > stairs(floors.size()); // the staircase indexes of each floor
+    for(int f = 0; f < floors.size(); f++){
+        QList<Feature*> features = floors[f]->features();
+        for(int i = 0; i < features.size(); i++){
+            if(features[i]->type() == STAIRS) stairs[f] << i;
+        }
+    }
+    for(int f = 0; f < floors.size(); f++){
+        for(int i : stairs[f]){
+            Feature* from = floors[f]->features()[i];
+            for(int up = 1; up <= options.connectionFanOut && f + up < floors.size(); up++){
+                int target = f + up;
+                int count = floors[target]->featureCount();
+                if(count == 0) continue;
+                int j = stairs[target].isEmpty() ? generator.range(0,count - 1)
+                                                 : stairs[target][generator.range(0,stairs[target].size() - 1)];
+                from->addConnection(target,j);
+                floors[target]->features()[j]->addConnection(f,i);
+            }
+        }
+    }
+    return new Building(QString("Generated %1").arg(options.seed),floors);
+}
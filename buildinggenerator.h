@@ -0,0 +1,58 @@
+#ifndef BUILDINGGENERATOR_H
+#define BUILDINGGENERATOR_H
+
+#include <random>
+
+#include "diagrammodels.h"
+
+//! What BuildingGenerator::generate() builds
+typedef struct{
+    quint32 seed;           // the same seed and options always give the same building
+    int floors;
+    int roomsPerFloor;
+    int verticesPerRoom;    // at least 4, the extra vertices are spread along the walls
+    double stairDensity;    // the fraction of rooms that are stairs, at least one per floor if above 0
+    int connectionFanOut;   // how many floors above each staircase connects to
+}GeneratorOptions;
+
+/*!
+ * \brief The BuildingGenerator class makes synthetic buildings of any size, for profiling and stress tests
+ *
+ * Each floor is a grid of rectilinear rooms with random column widths and row heights, so neighbouring
+ * rooms share their walls the way traced floorplans do. Staircases are linked both ways to staircases
+ * on the floors above, or to a room where a floor has none.
+ *
+ * The output only depends on the options. The random numbers come from std::mt19937, whose sequence
+ * is fixed by the standard, and are mapped to ranges by hand rather than through the std distributions,
+ * whose results vary between standard libraries.
+ */
+class BuildingGenerator
+{
+public:
+    //! The defaults: 5 floors of 200 four-sided rooms, 2% stairs linked one floor up
+    static GeneratorOptions defaults();
+
+    /*!
+     * \brief generate build a building
+     * \param options
+     * \return a new building, owned by the caller
+     */
+    static DiagramModels::Building* generate(const GeneratorOptions& options);
+
+private:
+    explicit BuildingGenerator(quint32 seed):_random(seed){}
+
+    //! A number in [low, high]
+    int range(int low, int high);
+    //! A number in [0, 1)
+    double unit();
+    //! Split \param total into \param parts sizes of at least \param minimum that add up to it
+    QVector<int> split(int total, int parts, int minimum);
+    //! A rectangle as a polygon of \param vertices points, the ones past 4 spread along its walls
+    QPolygon room(const QRect& rect, int vertices);
+    DiagramModels::Floor* floor(int index, const GeneratorOptions& options);
+
+    std::mt19937 _random;
+};
+
+#endif // BUILDINGGENERATOR_H
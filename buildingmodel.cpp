@@ -69,7 +69,7 @@ int BuildingModel::rowCount(const QModelIndex &parent) const{
     }            
     DModels* m = static_cast<DModels*>(parent.internalPointer());
     if(m->modelType() == FLOOR){
-        return static_cast<Floor*>(m)->features().count();
+        return static_cast<Floor*>(m)->featureCount();
     }
     return 0;
 }
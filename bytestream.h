@@ -0,0 +1,114 @@
+#ifndef BYTESTREAM_H
+#define BYTESTREAM_H
+
+#include <QByteArray>
+#include <QString>
+
+//! Appends little endian and varint encoded values to a byte array
+class ByteWriter{
+public:
+    explicit ByteWriter(QByteArray* out):_out(out){}
+
+    void u8(quint8 v){_out->append(char(v));}
+    void u16(quint16 v){
+        u8(v & 0xff);
+        u8(v >> 8);
+    }
+    void u32(quint32 v){
+        u16(v & 0xffff);
+        u16(v >> 16);
+    }
+    void u64(quint64 v){
+        u32(v & 0xffffffff);
+        u32(v >> 32);
+    }
+    void varint(quint64 v){
+        while(v >= 0x80){
+            u8(quint8(v) | 0x80);
+            v >>= 7;
+        }
+        u8(quint8(v));
+    }
+    void zigzag(qint64 v){
+        varint((quint64(v) << 1) ^ quint64(v >> 63));
+    }
+    void bytes(const QByteArray& b){_out->append(b);}
+    //! A varint length followed by the UTF-8 bytes
+    void string(const QString& s){
+        QByteArray utf8 = s.toUtf8();
+        varint(utf8.size());
+        bytes(utf8);
+    }
+
+private:
+    QByteArray* _out;
+};
+
+//! Reads values written by ByteWriter, failing instead of reading past the end
+class ByteReader{
+public:
+    ByteReader(const QByteArray& data, int begin, int end):_data(data.constData()),_pos(begin),_end(qMin(end,data.size())),_ok(true){}
+
+    bool ok() const{return _ok;}
+    int pos() const{return _pos;}
+
+    quint8 u8(){
+        if(_pos >= _end){
+            _ok = false;
+            return 0;
+        }
+        return quint8(_data[_pos++]);
+    }
+    quint16 u16(){
+        quint16 lo = u8();
+        return lo | quint16(u8()) << 8;
+    }
+    quint32 u32(){
+        quint32 lo = u16();
+        return lo | quint32(u16()) << 16;
+    }
+    quint64 u64(){
+        quint64 lo = u32();
+        return lo | quint64(u32()) << 32;
+    }
+    quint64 varint(){
+        quint64 v = 0;
+        for(int shift = 0; shift < 64; shift += 7){
+            quint8 b = u8();
+            v |= quint64(b & 0x7f) << shift;
+            if(!(b & 0x80)) return v;
+        }
+        _ok = false;
+        return 0;
+    }
+    qint64 zigzag(){
+        quint64 v = varint();
+        return qint64(v >> 1) ^ -qint64(v & 1);
+    }
+    QByteArray bytes(int length){
+        if(length < 0 || _end - _pos < length){
+            _ok = false;
+            return QByteArray();
+        }
+        QByteArray re(_data + _pos,length);
+        _pos += length;
+        return re;
+    }
+    //! Read a string written by ByteWriter::string
+    QString string(){
+        quint64 length = varint();
+        if(length > quint64(_end - _pos)){
+            _ok = false;
+            return QString();
+        }
+        return QString::fromUtf8(bytes(int(length)));
+    }
+
+private:
+    const char* _data;
+    int _pos;
+    int _end;
+    bool _ok;
+};
+
+#endif // BYTESTREAM_H
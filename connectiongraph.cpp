@@ -0,0 +1,264 @@
+#include "connectiongraph.h"
+#include "roomadjacency.h"
+#include "tracing.h"
+
+#include <QSet>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtMath>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+using namespace DiagramModels;
+
+const double ConnectionGraph::DEFAULT_FLOOR_COST = 500;
+
+ConnectionGraph::ConnectionGraph(Building *building):_building(building),_floorCost(DEFAULT_FLOOR_COST),
+    _dirty(true),_routes(ROUTE_CACHE_SIZE),_stamp(0){
+}
+
+ConnectionGraph::~ConnectionGraph(){
+    qDeleteAll(_adjacency);
+}
+
+void ConnectionGraph::setFloorCost(double cost){
+    if(cost == _floorCost) return;
+    _floorCost = cost;
+    _dirty = true;
+}
+
+//! The plan distance between two centroids
+static double distance(const QPoint& a, const QPoint& b){
+    return qSqrt(double(a.x() - b.x()) * (a.x() - b.x()) + double(a.y() - b.y()) * (a.y() - b.y()));
+}
+
+//! A link between two nodes, either way round
+static quint64 linkKey(int a, int b){
+    return (quint64(quint32(qMin(a,b))) << 32) | quint32(qMax(a,b));
+}
+
+QVector<QPair<int,int> > ConnectionGraph::adjacentFeatures(Floor *floor, RoomAdjacency* adjacency){
+    QVector<QPair<int,int> > re;
+    QList<Feature*> features = floor->features();
+    QHash<Feature*,int> indexes;
+    indexes.reserve(features.size());
+    for(int i = 0; i < features.size(); i++) indexes.insert(features[i],i);
+    for(const Adjacency& pair : adjacency->pairs()){
+        re << qMakePair(indexes.value(pair.first),indexes.value(pair.second));
+    }
+    return re;
+}
+
+void ConnectionGraph::update(){
+    QList<Floor*> floors = _building->floors();
+    QVector<quint64> revisions(floors.size());
+    for(int f = 0; f < floors.size(); f++) revisions[f] = floors[f]->revision();
+    if(!_dirty && floors == _floors && revisions == _revisions) return;
+    TRACE_SPAN(traceRoute,"buildConnectionGraph");
+
+    // shared walls are only looked for again on the floors that changed, and there around the edited features
+    QVector<QVector<QPair<int,int> > > adjacent(floors.size());
+    QVector<RoomAdjacency*> trackers(floors.size());
+    QList<int> stale;
+    for(int f = 0; f < floors.size(); f++){
+        RoomAdjacency*& tracker = _adjacency[floors[f]];
+        if(!tracker) tracker = new RoomAdjacency(floors[f]);
+        trackers[f] = tracker;
+        int old = _floors.indexOf(floors[f]);
+        if(old >= 0 && _revisions[old] == revisions[f]) adjacent[f] = _adjacent[old];
+        else stale << f;
+    }
+    for(QHash<Floor*,RoomAdjacency*>::iterator it = _adjacency.begin(); it != _adjacency.end();){
+        if(floors.contains(it.key())){
+            ++it;
+        }else{
+            delete it.value();
+            it = _adjacency.erase(it);
+        }
+    }
+    TRACE_COUNT(traceRoute,"graph floors rebuilt",stale.size());
+    std::function<QVector<QPair<int,int> >(int)> find = [&floors,&trackers](int f){
+        return adjacentFeatures(floors[f],trackers[f]);
+    };
+    // each task only updates its own floor's tracker and builds the geometry of its features, so the floors can go in parallel
+    QList<QVector<QPair<int,int> > > found;
+    if(Building::singleThreadedLoading() || stale.size() < 2){
+        for(int f : stale) found << find(f);
+    }else{
+        found = QtConcurrent::blockingMapped<QList<QVector<QPair<int,int> > > >(stale,find);
+    }
+    for(int i = 0; i < stale.size(); i++) adjacent[stale[i]] = found[i];
+
+    // the nodes, floor by floor
+    _features.clear();
+    _centroids.clear();
+    _levels.clear();
+    _nodes.clear();
+    QVector<int> firstNode(floors.size());
+    for(int f = 0; f < floors.size(); f++){
+        firstNode[f] = _features.size();
+        for(Feature* feature : floors[f]->features()){
+            _nodes.insert(feature,_features.size());
+            _features << feature;
+            _centroids << feature->center();
+            _levels << f;
+        }
+    }
+    int count = _features.size();
+
+    // the links, each once however many times it was found
+    QSet<quint64> seen;
+    QVector<QPair<int,int> > links;
+    for(int f = 0; f < floors.size(); f++){
+        for(const QPair<int,int>& pair : adjacent[f]){
+            int a = firstNode[f] + pair.first, b = firstNode[f] + pair.second;
+            if(seen.contains(linkKey(a,b))) continue;
+            seen << linkKey(a,b);
+            links << qMakePair(a,b);
+        }
+    }
+    for(int a = 0; a < count; a++){
+        for(const FeatureConnection& connection : _features[a]->connections()){
+            // floor_index is the floor's position, as Building::resolveConnections() checks it
+            if(connection.floor_index < 0 || connection.floor_index >= floors.size()) continue;
+            if(connection.feature_index < 0 || connection.feature_index >= floors[connection.floor_index]->featureCount()) continue;
+            int b = firstNode[connection.floor_index] + connection.feature_index;
+            if(a == b || seen.contains(linkKey(a,b))) continue;
+            seen << linkKey(a,b);
+            links << qMakePair(a,b);
+        }
+    }
+
+    // counted, then each node's run filled in, both directions of every link
+    _offsets.fill(0,count + 1);
+    for(const QPair<int,int>& link : links){
+        _offsets[link.first + 1]++;
+        _offsets[link.second + 1]++;
+    }
+    for(int n = 0; n < count; n++) _offsets[n + 1] += _offsets[n];
+    _targets.resize(links.size() * 2);
+    _weights.resize(links.size() * 2);
+    QVector<int> next = _offsets;
+    for(const QPair<int,int>& link : links){
+        int a = link.first, b = link.second;
+        float weight = distance(_centroids[a],_centroids[b]) + qAbs(_levels[a] - _levels[b]) * _floorCost;
+        _targets[next[a]] = b;
+        _weights[next[a]++] = weight;
+        _targets[next[b]] = a;
+        _weights[next[b]++] = weight;
+    }
+
+    // connected components, by a breadth first walk from each node not yet reached
+    _components.fill(-1,count);
+    QVector<int> queue;
+    queue.reserve(count);
+    for(int start = 0, component = 0; start < count; start++){
+        if(_components[start] >= 0) continue;
+        queue.clear();
+        queue << start;
+        _components[start] = component;
+        for(int i = 0; i < queue.size(); i++){
+            int n = queue[i];
+            for(int e = _offsets[n]; e < _offsets[n + 1]; e++){
+                if(_components[_targets[e]] < 0){
+                    _components[_targets[e]] = component;
+                    queue << _targets[e];
+                }
+            }
+        }
+        component++;
+    }
+
+    _cost.resize(count);
+    _previous.resize(count);
+    _stamps.fill(0,count);
+    _stamp = 0;
+    _routes.clear();
+    _floors = floors;
+    _revisions = revisions;
+    _adjacent = adjacent;
+    _dirty = false;
+}
+
+double ConnectionGraph::heuristic(int node, int to) const{
+    // never more than the real cost: no link is shorter than the straight line, nor skips a floor for free
+    return distance(_centroids[node],_centroids[to]) + qAbs(_levels[node] - _levels[to]) * _floorCost;
+}
+
+bool ConnectionGraph::search(int from, int to, CachedRoute *route){
+    TRACE_SPAN(traceRoute,"searchRoute");
+    if(++_stamp == 0){
+        // wrapped around, old stamps could look current
+        _stamps.fill(0);
+        _stamp = 1;
+    }
+    typedef std::pair<double,int> Entry; // estimated total cost, node
+    std::priority_queue<Entry,std::vector<Entry>,std::greater<Entry> > open;
+    _cost[from] = 0;
+    _previous[from] = -1;
+    _stamps[from] = _stamp;
+    open.push(Entry(heuristic(from,to),from));
+    while(!open.empty()){
+        Entry top = open.top();
+        open.pop();
+        int n = top.second;
+        if(n == to) break;
+        // left behind when a cheaper way to the node was found, the weights are floats so allow for rounding
+        if(top.first > _cost[n] + heuristic(n,to) + 1e-6) continue;
+        TRACE_COUNT(traceRoute,"route nodes expanded",1);
+        for(int e = _offsets[n]; e < _offsets[n + 1]; e++){
+            int target = _targets[e];
+            double cost = _cost[n] + _weights[e];
+            if(_stamps[target] != _stamp || cost < _cost[target]){
+                _stamps[target] = _stamp;
+                _cost[target] = cost;
+                _previous[target] = n;
+                open.push(Entry(cost + heuristic(target,to),target));
+            }
+        }
+    }
+    if(_stamps[to] != _stamp) return false;
+    route->length = _cost[to];
+    for(int n = to; n != -1; n = _previous[n]) route->nodes.prepend(n);
+    return true;
+}
+
+Route ConnectionGraph::route(Feature *from, Feature *to){
+    TRACE_SPAN(traceRoute,"route");
+    Route re;
+    re.length = 0;
+    int a = node(from), b = node(to);
+    if(a < 0 || b < 0 || _components[a] != _components[b]) return re;
+
+    // links go both ways, so a route and its reverse share a cache entry
+    quint64 key = linkKey(a,b);
+    CachedRoute* cached = _routes.object(key);
+    if(cached){
+        TRACE_COUNT(traceRoute,"route cache hits",1);
+    }else{
+        cached = new CachedRoute;
+        cached->length = 0;
+        search(qMin(a,b),qMax(a,b),cached);
+        _routes.insert(key,cached);
+    }
+    for(int n : cached->nodes) re.features << _features[n];
+    if(a > b) std::reverse(re.features.begin(),re.features.end());
+    re.length = cached->length;
+    return re;
+}
+
+bool ConnectionGraph::reachable(Feature *from, Feature *to){
+    int a = node(from), b = node(to);
+    return a >= 0 && b >= 0 && _components[a] == _components[b];
+}
+
+QList<Feature*> ConnectionGraph::reachableFrom(Feature *from){
+    QList<Feature*> re;
+    int a = node(from);
+    if(a < 0) return re;
+    for(int n = 0; n < _features.size(); n++){
+        if(_components[n] == _components[a]) re << _features[n];
+    }
+    return re;
+}
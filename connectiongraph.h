@@ -0,0 +1,120 @@
+#ifndef CONNECTIONGRAPH_H
+#define CONNECTIONGRAPH_H
+
+#include <QCache>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QPoint>
+#include <QVector>
+
+#include "diagrammodels.h"
+
+class RoomAdjacency;
+
+//! A way through the building, see ConnectionGraph::route()
+typedef struct{
+    QList<DiagramModels::Feature*> features;    // from the start to the end, both included; empty if there is no way
+    double length;                              // centroid to centroid in floor units, plus the floor cost of each floor climbed
+}Route;
+
+/*!
+ * \brief The ConnectionGraph class answers wayfinding queries over every feature of a building
+ *
+ * Features are the nodes. Features on the same floor that share a wall (see RoomAdjacency) are linked
+ * by their centroid distance, and connections (stairs) link features on different floors by their centroid
+ * distance plus floorCost() per floor between them. Links go both ways, however the connection was drawn.
+ *
+ * The links are kept in compressed sparse row form: one array of targets and weights, and where
+ * each node's run starts, so a search touches contiguous memory. Routes are found with A*, the
+ * heuristic being the centroid distance plus the floor cost of the floors in between, and cached.
+ * Whether two features are reachable at all is looked up in the connected components worked out
+ * when the graph is built.
+ *
+ * Every query first checks the floor revisions and rebuilds what changed, so the graph can follow
+ * the model the editor is changing. Each floor keeps a RoomAdjacency, so after an edit only the walls
+ * of the features that changed are compared again, on the global thread pool if several floors were
+ * edited. Not thread safe: use it from the thread that edits the building.
+ */
+class ConnectionGraph
+{
+public:
+    explicit ConnectionGraph(DiagramModels::Building* building);
+    ~ConnectionGraph();
+
+    //! The cost of climbing one floor, in floor units
+    double floorCost() const{return _floorCost;}
+    void setFloorCost(double cost);
+
+    //! The shortest route from \param from to \param to, with no features if there is none
+    Route route(DiagramModels::Feature* from, DiagramModels::Feature* to);
+    //! If there is any route from \param from to \param to
+    bool reachable(DiagramModels::Feature* from, DiagramModels::Feature* to);
+    //! Every feature there is a route to from \param from, itself included, in building order
+    QList<DiagramModels::Feature*> reachableFrom(DiagramModels::Feature* from);
+
+    int nodeCount(){update();return _features.size();}
+    //! The number of links, each counted once
+    int edgeCount(){update();return _targets.size() / 2;}
+    //! Forget the cached routes, the next queries search again
+    void clearRouteCache(){_routes.clear();}
+
+    //! Routes kept for repeated queries, cleared whenever the building changes
+    enum{ROUTE_CACHE_SIZE = 4096};
+    //! The default floorCost()
+    static const double DEFAULT_FLOOR_COST;
+
+private:
+    Q_DISABLE_COPY(ConnectionGraph)
+
+    //! A cached route, as node ids
+    typedef struct{
+        QVector<int> nodes;
+        double length;
+    }CachedRoute;
+
+    //! Bring the graph up to date with the building if any floor has changed
+    void update();
+    //! The pairs of features sharing a wall on \param floor, as indexes on the floor, brought up to date by \param adjacency
+    static QVector<QPair<int,int> > adjacentFeatures(DiagramModels::Floor* floor, RoomAdjacency* adjacency);
+    //! The node of \param feature, -1 if it isn't in the building
+    int node(DiagramModels::Feature* feature){
+        update();
+        return _nodes.value(feature,-1);
+    }
+    //! The A* search, \return false if there is no route
+    bool search(int from, int to, CachedRoute* route);
+    double heuristic(int node, int to) const;
+
+    DiagramModels::Building* _building;
+    double _floorCost;
+    bool _dirty;                                    // set to rebuild even if no floor changed
+
+    // what the graph was built from
+    QList<DiagramModels::Floor*> _floors;
+    QVector<quint64> _revisions;
+    QVector<QVector<QPair<int,int> > > _adjacent;   // of each floor, reused until the floor changes
+    QHash<DiagramModels::Floor*,RoomAdjacency*> _adjacency; // owned, follows the edits to each floor
+
+    // per node
+    QVector<DiagramModels::Feature*> _features;
+    QVector<QPoint> _centroids;
+    QVector<int> _levels;                           // the floor's position in the building
+    QVector<int> _components;                       // nodes with the same number reach each other
+    QHash<DiagramModels::Feature*,int> _nodes;
+
+    // the links of node n are _targets[_offsets[n]] to _targets[_offsets[n + 1] - 1]
+    QVector<int> _offsets;
+    QVector<int> _targets;
+    QVector<float> _weights;
+
+    QCache<quint64,CachedRoute> _routes;
+
+    // the search state, reused between searches; a node's entries are only valid if its stamp is the current one
+    QVector<double> _cost;
+    QVector<int> _previous;
+    QVector<quint32> _stamps;
+    quint32 _stamp;
+};
+
+#endif // CONNECTIONGRAPH_H
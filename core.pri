@@ -0,0 +1,55 @@
+# The models, file formats and exports, without QtWidgets; shared by the editor, benchmarks/ and tools/.
+# The editor's windows and dialogs are in gui.pri.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/building.cpp \
+    $$PWD/filereader.cpp \
+    $$PWD/buildingmodel.cpp \
+    $$PWD/filewriter.cpp \
+    $$PWD/feature.cpp \
+    $$PWD/floor.cpp \
+    $$PWD/spatialindex.cpp \
+    $$PWD/snapindex.cpp \
+    $$PWD/floorrenderer.cpp \
+    $$PWD/binaryformat.cpp \
+    $$PWD/jsonstreamreader.cpp \
+    $$PWD/fileservice.cpp \
+    $$PWD/editjournal.cpp \
+    $$PWD/autosaver.cpp \
+    $$PWD/edithistory.cpp \
+    $$PWD/tracing.cpp \
+    $$PWD/buildinggenerator.cpp \
+    $$PWD/osmexporter.cpp \
+    $$PWD/exportpipeline.cpp \
+    $$PWD/tileexporter.cpp \
+    $$PWD/connectiongraph.cpp \
+    $$PWD/roomadjacency.cpp
+
+HEADERS += \
+    $$PWD/diagrammodels.h \
+    $$PWD/filereader.h \
+    $$PWD/filewriter.h \
+    $$PWD/spatialindex.h \
+    $$PWD/snapindex.h \
+    $$PWD/floorrenderer.h \
+    $$PWD/binaryformat.h \
+    $$PWD/jsonstreamreader.h \
+    $$PWD/iomonitor.h \
+    $$PWD/fileservice.h \
+    $$PWD/bytestream.h \
+    $$PWD/editjournal.h \
+    $$PWD/autosaver.h \
+    $$PWD/edithistory.h \
+    $$PWD/tracing.h \
+    $$PWD/buildinggenerator.h \
+    $$PWD/osmexporter.h \
+    $$PWD/georeference.h \
+    $$PWD/exportpipeline.h \
+    $$PWD/tileexporter.h \
+    $$PWD/connectiongraph.h \
+    $$PWD/roomadjacency.h
+
+# qmake CONFIG+=tracing compiles in the trace spans and counters, see tracing.h
+tracing: DEFINES += FLOORPLAN_TRACING
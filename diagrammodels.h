@@ -10,12 +10,23 @@
 #include <QList>
 #include <QString>
 #include <QPolygon>
+#include <QPainterPath>
 #include <QDebug>
 #include <QJsonDocument>
 #include <QAbstractItemModel>
 #include <QMetaEnum>
 #include <QSet>
 #include <QHash>
+#include <QPair>
+#include <QVector>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QSharedPointer>
+#include <QFuture>
+
+#include "spatialindex.h"
+#include "snapindex.h"
+#include "tracing.h"
 
 namespace DiagramModels{
     class Building;
@@ -49,9 +60,20 @@ namespace DiagramModels{
         }
     }FeatureConnection;
     inline uint qHash(const FeatureConnection fc, uint seed = 0){
-        return ::qHash(fc.floor_index,seed) + ::qHash(fc.feature_index,seed);
+        // both halves in one key, a sum would put (1, 2) and (2, 1) and every other swap in the same bucket
+        return ::qHash((quint64(quint32(fc.floor_index)) << 32) | quint32(fc.feature_index),seed);
     }
 
+    //! Geometry derived from the bounds of a feature, cached until the bounds change
+    typedef struct{
+        QRect boundingRect;
+        QPainterPath path;
+        double area;
+        QPoint centroid;
+        QPoint labelPosition;
+        uint vertexHash;
+    }FeatureGeometry;
+
     /*!
      * \brief The Feature class
      * Responsible for holding the information concerning room dimensions and other properties
@@ -64,13 +86,13 @@ namespace DiagramModels{
          * \param bounds The vectorized bounds of the feature
          * \param floor A reference to the floor the feature is on
          */
-        explicit Feature(FeatureType type, QPolygon bounds, Floor *floor):_bounds(bounds),_type(type),_floor(floor),_center(boundsCentroid(_bounds)){}
+        explicit Feature(FeatureType type, QPolygon bounds, Floor *floor):_type(type),_bounds(bounds),_floor(floor),_geometryValid(false){}
 
         //! Return the type of the feature
         FeatureType type(){return _type;}
 
         //! Set the feature type
-        void type(FeatureType type){_type = type;}
+        void type(FeatureType type);
         //! Convert the type from an enum to a string and return it
         QString typeToString() const{
             switch(_type){
@@ -79,28 +101,19 @@ namespace DiagramModels{
             }
         }
         //! Return the name of the feature (e.g. "Room 201")
-        void name(QString name){_name = name;}
+        void name(QString name);
         //! add a connection between floors or features
-        void addConnection(int floor_index, int feature_index){
-            FeatureConnection con = {floor_index,feature_index};
-            _connections << con;
-        }
+        void addConnection(int floor_index, int feature_index);
         //! Get a set of the values for the connections
         QSet<FeatureConnection> connections(){
             return _connections;
         }
         //! set the values for connections
-        void connections(QSet<FeatureConnection> connections){
-            _connections = connections;
-        }
+        void connections(QSet<FeatureConnection> connections);
         //! Get the bounds of the feature
-        QPolygon bounds(){return _bounds;}
-        //! Set the bounds of the feature, recalculates the center
-        void bounds(QPolygon bounds){
-            _bounds = bounds;
-            _center = boundsCentroid(_bounds);
-            qDebug() << "Center of " << name() << ": " << _center;
-        }
+        const QPolygon& bounds() const{return _bounds;}
+        //! Set the bounds of the feature, invalidates the cached geometry and updates the floor's index
+        void bounds(QPolygon bounds);
         //! Returns a FEATURE model type
         DModelType modelType() override{return FEATURE;}
         //! Get a reference to the floor the feature is on
@@ -108,52 +121,105 @@ namespace DiagramModels{
         //! Get the feature name
         QString name(){return _name;}
         //! Get the center of the feature in XY
-        QPoint center(){return _center;}
+        QPoint center() const{return geometry().centroid;}
 
+        //! Get the geometry derived from the bounds, rebuilt only after the bounds change
+        const FeatureGeometry& geometry() const{
+            if(!_geometryValid) buildGeometry();
+            else TRACE_COUNT(tracePaint,"geometry cache hits",1);
+            return _geometry;
+        }
+        //! Get the bounding rectangle of the feature
+        QRect boundingRect() const{return geometry().boundingRect;}
+        //! Get the bounds as a painter path, ready to draw
+        const QPainterPath& path() const{return geometry().path;}
+        //! Get the area enclosed by the bounds
+        double area() const{return geometry().area;}
+        //! Get the point to draw the name at, inside the feature where possible
+        QPoint labelPosition() const{return geometry().labelPosition;}
+        //! Get a hash of the vertices, changes whenever the bounds do
+        uint vertexHash() const{return geometry().vertexHash;}
+        //! If \param point is inside the feature
+        bool contains(const QPoint& point) const{
+            return boundingRect().contains(point) && _bounds.containsPoint(point,Qt::OddEvenFill);
+        }
 
     private:
-        /*!
-         * \brief boundsCentroid find the center of the bounds of the feature
-         * \param polygon the bounds to calculate
-         * \return the center point of the feature
-         */
-        QPoint boundsCentroid(QPolygon polygon){
-            QPoint re;
-            QPoint p1,p2;
-            int partial;
-            int signedArea;
-            int i;
-            for(i = 0; i < polygon.size()-1;i++){
-                p1 = polygon[i];
-                p2 = polygon[i+1];
-                partial = p1.x()*p2.y() - p1.y()*p2.x();
-                signedArea += partial;
-                re.setX(re.x() + (p1.x() + p2.x())*partial);
-                re.setY(re.y() + (p1.y() + p2.y())*partial);
-            }
-            if(i == 0)return QPoint();
-            p1 = polygon[i];
-            p2 = polygon[0];
-            partial = p1.x()*p2.y() - p1.y()*p2.x();
-            signedArea += partial;
-            re.setX(re.x() + (p1.x() + p2.x())*partial);
-            re.setY(re.y() + (p1.y() + p2.y())*partial);
-
-            signedArea /= 2;
-            re.setX(6 * signedArea);
-            re.setY(6 * signedArea);
-            return re;
-        }
+        //! Recalculate the cached geometry from the bounds
+        void buildGeometry() const;
 
      private:
         FeatureType _type; //! The type of the feature
         QPolygon _bounds; //! The bounds of the feature
         Floor* _floor; //! What floor the feature is on
         QString _name; //! The name of the feature
-        QPoint _center; //! The stored and recalculated center of the feature
+        mutable FeatureGeometry _geometry; //! Cached geometry derived from the bounds
+        mutable bool _geometryValid; //! If the cached geometry matches the bounds
         QSet<FeatureConnection> _connections; //! The connections the feature has
     };
 
+    //! Which property of a feature an edit changed
+    typedef enum{
+        EDIT_BOUNDS,
+        EDIT_TYPE,
+        EDIT_NAME,
+        EDIT_CONNECTIONS
+    }FeatureEdit;
+
+    /*!
+     * \brief The EditListener class is told about every edit made to the floors of a building
+     * Features added by a FloorLoader are not reported, only changes made after a floor is built: while the
+     * loader runs the floor isn't loaded yet and keeps the edits the loader makes to its features to itself.
+     */
+    class EditListener{
+    public:
+        virtual ~EditListener(){}
+        //! \param feature was appended to \param floor
+        virtual void featureAdded(Floor* floor, Feature* feature) = 0;
+        //! The feature at \param index is about to be removed from \param floor
+        virtual void featureRemoved(Floor* floor, int index) = 0;
+        //! A property of \param feature was changed
+        virtual void featureEdited(Floor* floor, Feature* feature, FeatureEdit edit) = 0;
+        //! \param connection was added to \param feature
+        virtual void connectionAdded(Floor* floor, Feature* feature, const FeatureConnection& connection) = 0;
+        //! \param floor was renamed
+        virtual void floorRenamed(Floor* floor) = 0;
+    };
+
+    //! The values of a feature, copied without its floor, geometry or indexes
+    typedef struct{
+        FeatureType type;
+        QString name;
+        QPolygon bounds;
+        QSet<FeatureConnection> connections;
+    }FeatureState;
+
+    //! The values of a floor and its features, e.g. as read from a file
+    typedef struct{
+        QString name;
+        QVector<FeatureState> features;
+    }FloorState;
+
+    //! The feature values of each floor copied by Building::snapshot(), with the floor revision they were copied at
+    typedef QHash<Floor*,QPair<quint64,QVector<FeatureState> > > SnapshotCache;
+
+    /*!
+     * \brief The FloorLoader class supplies the features of a floor that is loaded on first use
+     */
+    class FloorLoader{
+    public:
+        virtual ~FloorLoader(){}
+        /*!
+         * \brief load decode the features of a floor, called at most once per floor
+         * A loader shared by a floor and its snapshot is called for each of them, possibly at the same time.
+         * \param floor the floor the features belong to
+         * \param features filled with the decoded features, not yet added to the floor
+         * \param error set to a description of the problem if loading fails
+         * \return false if the floor data is malformed
+         */
+        virtual bool load(Floor* floor, QList<Feature*>* features, QString* error) = 0;
+    };
+
     /*!
      * \brief The Floor class
      */
@@ -164,16 +230,57 @@ namespace DiagramModels{
          * \param index the index of the floor in the building
          * \param name the name of the floor (e.g. "Floor 2")
          */
-        explicit Floor(int index, QString name):_floorIndex(index),_name(name){
+        explicit Floor(int index, QString name):_floorIndex(index),_name(name),_revision(0),_listener(NULL),
+            _loaded(1),_pendingFeatureCount(0){
+        }
+        /*!
+         * \brief Floor constructor for a floor whose features are loaded on first use
+         * \param index the index of the floor in the building
+         * \param name the name of the floor
+         * \param loader decodes the features when they are first needed
+         * \param featureCount the number of features the loader will produce
+         * \param extents the bounding box of the features
+         */
+        explicit Floor(int index, QString name, QSharedPointer<FloorLoader> loader, int featureCount, QRect extents):
+            _floorIndex(index),_name(name),_revision(0),_listener(NULL),_loader(loader),_loaded(0),
+            _pendingFeatureCount(featureCount),_extents(extents){
         }
         ~Floor(){
             qDeleteAll(_features);
         }
 
+        /*!
+         * \brief ensureLoaded decode the features if the floor was created with a loader
+         * Safe to call from any thread, callers block while another thread is loading the floor.
+         */
+        void ensureLoaded(){
+            if(!_loaded.loadAcquire()) load();
+        }
+        //! If the features are in memory, or the loader has failed
+        bool isLoaded() const{return _loaded.loadAcquire();}
+        //! Why the loader failed, empty if the floor hasn't been loaded yet or loaded fine
+        QString loadError() const{return isLoaded() ? _loadError : QString();}
+        //! Load the floor if needed, \return if its loader failed; a failed floor has no features
+        bool loadFailed(){
+            ensureLoaded();
+            return !_loadError.isEmpty();
+        }
+        //! Get the number of features without loading them
+        int featureCount(){return isLoaded() ? _features.size() : _pendingFeatureCount;}
+        //! Get the bounding box of the features, known up front for lazily loaded floors
+        QRect extents(){
+            if(isLoaded()) return _index.bounds();
+            return _extents;
+        }
+
         //! Get the name
         QString name(){return _name;}
         //! Set the name
-        void name(QString name){_name = name;}
+        void name(QString name){
+            _name = name;
+            _revision++;
+            if(_listener) _listener->floorRenamed(this);
+        }
         //! Get the floor index
         int floorIndex(){return _floorIndex;}
         //! Set the floor index
@@ -184,19 +291,92 @@ namespace DiagramModels{
 
         //! Get a list of the features the floor has
         QList<Feature*> features(){
+            ensureLoaded();
             return _features;
         }
+        //! The position of \param feature on the floor, -1 if it isn't on it; doesn't load the floor, safe from
+        //! an EditListener since a floor only has features once it is loaded
+        int indexOf(Feature* feature) const{return _features.indexOf(feature);}
         //! Add a feature to the floor
-        void addFeature(Feature* feature){_features << feature;}
+        void addFeature(Feature* feature);
         //! Remove a feature from the \param index
-        void removeFeature(int index){_features.removeAt(index);}
+        void removeFeature(int index);
         //! Remove feature \param f
-        void removeFeature(Feature* f){_features.removeOne(f);}
+        void removeFeature(Feature* f);
+
+        /*!
+         * \brief featureAt find the topmost feature containing a point
+         * \param point
+         * \return the last drawn feature containing \param point, or NULL
+         */
+        Feature* featureAt(const QPoint& point);
+        /*!
+         * \brief featuresAt find every feature containing a point
+         * \param point
+         * \return the features containing \param point, in floor order
+         */
+        QList<Feature*> featuresAt(const QPoint& point);
+        /*!
+         * \brief featuresIn find the features whose bounding box intersects a rectangle
+         * \param rect
+         * \return the features overlapping \param rect, in floor order
+         */
+        QList<Feature*> featuresIn(const QRect& rect);
+        /*!
+         * \brief featureChanged keep the floor's index up to date with the bounds of a feature
+         * \param feature the feature whose bounds were changed
+         */
+        void featureChanged(Feature* feature);
+        //! Mark the floor as changed without touching the indexes
+        void touch(){_revision++;}
+        //! A property of \param feature other than its bounds was changed
+        void featureEdited(Feature* feature, FeatureEdit edit){
+            _revision++;
+            if(_listener && isLoaded()) _listener->featureEdited(this,feature,edit);
+        }
+        //! \param connection was added to \param feature
+        void connectionAdded(Feature* feature, const FeatureConnection& connection){
+            _revision++;
+            if(_listener && isLoaded()) _listener->connectionAdded(this,feature,connection);
+        }
+        //! Report later edits to \param listener, or to nobody if it is NULL
+        void setEditListener(EditListener* listener){_listener = listener;}
+        //! The loader of a floor that isn't loaded yet, for a copy of the floor to share; NULL once it is loaded
+        QSharedPointer<FloorLoader> pendingLoader(){
+            QMutexLocker lock(&_loadMutex);
+            return isLoaded() ? QSharedPointer<FloorLoader>() : _loader;
+        }
+        //! Get a counter that changes on every edit to the floor or its features, loading doesn't count as one
+        quint64 revision(){
+            ensureLoaded();
+            return _revision;
+        }
+        //! Get the vertex and edge grid used for snapping
+        const SnapIndex& snapIndex(){
+            ensureLoaded();
+            return _snapIndex;
+        }
 
      private:
         int _floorIndex; //! 0-indexed floor levels
         QList<Feature*> _features; //! List of features on the floor
         QString _name; //! The name of the floor
+        SpatialIndex _index; //! Grid over the feature bounding boxes for hit-testing
+        SnapIndex _snapIndex; //! Grid over the feature vertices and edges for snapping
+        quint64 _revision; //! Edit counter, lets views know when cached drawings are stale
+        EditListener* _listener; //! Told about edits, e.g. to journal them
+
+        QSharedPointer<FloorLoader> _loader; //! Supplies the features of a lazily loaded floor
+        QAtomicInt _loaded; //! Set once the features are in memory
+        QMutex _loadMutex; //! Held while the loader runs
+        int _pendingFeatureCount; //! The feature count reported by the loader's directory
+        QRect _extents; //! The feature extents reported by the loader's directory
+        QString _loadError; //! Set if the loader failed
+
+        //! Run the loader, see ensureLoaded()
+        void load();
+        //! Add a feature to the list and indexes without loading first
+        void insertFeature(Feature* feature);
     };    
 
     class Building{
@@ -209,6 +389,16 @@ namespace DiagramModels{
         explicit Building(QString name, QList<DiagramModels::Floor*> floors);
         /*!
          * \brief Building constructor
+         * Floors are built from the values in parallel on the global thread pool unless
+         * setSingleThreadedLoading() is on, connections are checked once every floor exists.
+         * \param name the name of the building
+         * \param floors the values of each floor, in building order
+         */
+        explicit Building(QString name, const QVector<DiagramModels::FloorState>& floors);
+        /*!
+         * \brief Building constructor
+         * Floors are built in parallel on the global thread pool unless setSingleThreadedLoading() is on,
+         * connections are checked in a final pass once every floor exists.
          * \param document the json representation of the building
          */
         explicit Building(QJsonDocument document);
@@ -221,6 +411,43 @@ namespace DiagramModels{
         //! Get the number of floors
         int floorCount(){return _floors.length();}
 
+        //! Report edits to every floor to \param listener, or to nobody if it is NULL
+        void setEditListener(EditListener* listener){
+            for(Floor* floor : _floors) floor->setEditListener(listener);
+        }
+
+        //! Build floors one after another on the calling thread, for debugging
+        static void setSingleThreadedLoading(bool on){_singleThreadedLoading = on;}
+        //! If floors are built one after another on the calling thread
+        static bool singleThreadedLoading(){return _singleThreadedLoading;}
+
+        /*!
+         * \brief loadInBackground load every lazily loaded floor on a worker thread, lowest floor first
+         * Floors needed on the GUI thread before their turn are loaded there on first use.
+         */
+        void loadInBackground();
+        //! The loading started by loadInBackground(), to be told when every floor is in
+        QFuture<void> backgroundLoading() const{return _loading;}
+
+        /*!
+         * \brief loadFailed load every floor and check that none failed
+         * Saving a building with a failed floor would write that floor out empty.
+         * \param error set to the first floor that failed and why
+         * \return true if a floor failed to load
+         */
+        bool loadFailed(QString* error = 0);
+
+        /*!
+         * \brief snapshot copy the building as it is now, for saving while editing carries on
+         * Only the feature values are copied here, the snapshot's floors build their features and
+         * indexes on first use, usually on the thread that serialises them. Floors that aren't loaded
+         * yet aren't loaded here either, their copies share the loader and decode the floor themselves.
+         * \param cache floors copied by an earlier snapshot, reused if they haven't been edited since and
+         * updated with the floors copied now; lets repeated snapshots cost only as much as the edits in between
+         * \return a building owned by the caller, unaffected by later edits to this one
+         */
+        Building* snapshot(SnapshotCache* cache = 0);
+
         /*!
          * \brief toJson creates a JSON representation of the building
          * \return a QJSONObject representing the building
@@ -228,9 +455,16 @@ namespace DiagramModels{
         QJsonObject toJson();
 
     private:
+        //! Drop connections to floors or features that don't exist, from the floors already loaded;
+        //! a FloorLoader checks the connections of the floor it loads
+        void resolveConnections();
 
+    private:
+        static bool _singleThreadedLoading; //! See setSingleThreadedLoading()
         QList<DiagramModels::Floor*> _floors;
         QString _name;
+        QFuture<void> _loading; //! The background floor loading started by loadInBackground()
+        QAtomicInt _stopLoading; //! Set to end background loading early
     };
 
     class BuildingModel: public QAbstractItemModel{
@@ -0,0 +1,147 @@
+#include "edithistory.h"
+#include "tracing.h"
+
+using namespace DiagramModels;
+
+//! Rough bytes held by a feature that isn't on any floor
+static qint64 featureBytes(Feature* feature){
+    return sizeof(Feature) + feature->bounds().size() * sizeof(QPoint) + feature->name().size() * sizeof(QChar);
+}
+
+EditHistory::EditHistory(qint64 byteLimit):_sequence(0),_bytes(0),_byteLimit(byteLimit){}
+
+EditHistory::~EditHistory(){
+    clear();
+}
+
+bool EditHistory::owns(const EditCommand &command, bool undoStack){
+    // a deleted feature waiting to be undone, or an added one waiting to be redone, is on no floor
+    if(undoStack) return command.type == CMD_DELETE_FEATURE;
+    return command.type == CMD_ADD_FEATURE;
+}
+
+qint64 EditHistory::cost(const EditCommand &command, bool undoStack){
+    qint64 bytes = sizeof(Entry);
+    if(owns(command,undoStack)) bytes += featureBytes(command.feature);
+    return bytes;
+}
+
+void EditHistory::release(const Entry &entry, bool undoStack){
+    _bytes -= cost(entry.command,undoStack);
+    if(owns(entry.command,undoStack)) delete entry.command.feature;
+}
+
+void EditHistory::push(const EditCommand &command){
+    FloorHistory& history = _floors[command.floor];
+    for(const Entry& entry : history.redo) release(entry,false);
+    history.redo.clear();
+
+    if(command.type == CMD_MOVE && !history.undo.isEmpty()){
+        EditCommand& last = history.undo.last().command;
+        if(last.type == CMD_MOVE && last.feature == command.feature){
+            last.point += command.point;
+            return;
+        }
+    }
+    Entry entry = {command,_sequence++};
+    history.undo << entry;
+    _bytes += cost(command,true);
+    evict();
+}
+
+bool EditHistory::undo(Floor *floor, EditCommand *command){
+    QHash<Floor*,FloorHistory>::iterator it = _floors.find(floor);
+    if(it == _floors.end() || it->undo.isEmpty()) return false;
+    Entry entry = it->undo.takeLast();
+    _bytes -= cost(entry.command,true);
+    apply(entry.command,false);
+    it->redo << entry;
+    _bytes += cost(entry.command,false);
+    if(command) *command = entry.command;
+    return true;
+}
+
+bool EditHistory::redo(Floor *floor, EditCommand *command){
+    QHash<Floor*,FloorHistory>::iterator it = _floors.find(floor);
+    if(it == _floors.end() || it->redo.isEmpty()) return false;
+    Entry entry = it->redo.takeLast();
+    _bytes -= cost(entry.command,false);
+    apply(entry.command,true);
+    it->undo << entry;
+    _bytes += cost(entry.command,true);
+    evict();
+    if(command) *command = entry.command;
+    return true;
+}
+
+void EditHistory::apply(const EditCommand &command, bool forward){
+    Feature* feature = command.feature;
+    switch(command.type){
+    case CMD_ADD_POINT:{
+        QPolygon bounds = feature->bounds();
+        if(forward) bounds << command.point;
+        else if(!bounds.isEmpty()) bounds.removeLast();
+        feature->bounds(bounds);
+        break;
+    }
+    case CMD_ADD_FEATURE:
+        if(forward) command.floor->addFeature(feature);
+        else command.floor->removeFeature(feature);
+        break;
+    case CMD_DELETE_FEATURE:
+        if(forward) command.floor->removeFeature(feature);
+        else command.floor->addFeature(feature);
+        break;
+    case CMD_MOVE:
+        feature->bounds(feature->bounds().translated(forward ? command.point : -command.point));
+        break;
+    case CMD_SELECT:
+        break; // the selection belongs to the view
+    }
+}
+
+const EditCommand* EditHistory::peekUndo(Floor *floor) const{
+    QHash<Floor*,FloorHistory>::const_iterator it = _floors.find(floor);
+    if(it == _floors.end() || it->undo.isEmpty()) return NULL;
+    return &it->undo.last().command;
+}
+
+const EditCommand* EditHistory::peekRedo(Floor *floor) const{
+    QHash<Floor*,FloorHistory>::const_iterator it = _floors.find(floor);
+    if(it == _floors.end() || it->redo.isEmpty()) return NULL;
+    return &it->redo.last().command;
+}
+
+int EditHistory::count() const{
+    int re = 0;
+    for(const FloorHistory& history : _floors) re += history.undo.size() + history.redo.size();
+    return re;
+}
+
+void EditHistory::setByteLimit(qint64 bytes){
+    _byteLimit = bytes;
+    evict();
+}
+
+void EditHistory::evict(){
+    while(_bytes > _byteLimit){
+        // the floor whose oldest undo command is the oldest overall
+        FloorHistory* oldest = NULL;
+        for(FloorHistory& history : _floors){
+            if(history.undo.isEmpty()) continue;
+            if(!oldest || history.undo.first().sequence < oldest->undo.first().sequence) oldest = &history;
+        }
+        if(!oldest) return; // only redo commands left, they go on the next push
+        release(oldest->undo.takeFirst(),true);
+        TRACE_COUNT(traceUndo,"history evictions",1);
+    }
+}
+
+void EditHistory::clear(){
+    for(FloorHistory& history : _floors){
+        for(const Entry& entry : history.undo) release(entry,true);
+        for(const Entry& entry : history.redo) release(entry,false);
+    }
+    _floors.clear();
+    _bytes = 0;
+}
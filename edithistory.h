@@ -0,0 +1,113 @@
+#ifndef EDITHISTORY_H
+#define EDITHISTORY_H
+
+#include <QHash>
+#include <QList>
+#include <QPoint>
+
+#include "diagrammodels.h"
+
+//! The kinds of edit the history can undo
+typedef enum{
+    CMD_ADD_POINT,      // point = the vertex appended to feature
+    CMD_ADD_FEATURE,    // feature = the new feature, previous = the selection before it
+    CMD_DELETE_FEATURE, // feature = the removed feature
+    CMD_SELECT,         // feature = the new selection, previous = the old one
+    CMD_MOVE            // point = how far feature was moved
+}EditCommandType;
+
+//! One undoable edit, stored by value
+typedef struct{
+    EditCommandType type;
+    DiagramModels::Floor* floor;
+    DiagramModels::Feature* feature;
+    DiagramModels::Feature* previous;
+    QPoint point;
+}EditCommand;
+
+/*!
+ * \brief The EditHistory class keeps the undo and redo stacks of every floor
+ *
+ * Consecutive moves of the same feature are merged into one command. The total size of the
+ * history is capped, once it is exceeded the oldest commands of any floor are dropped first.
+ * Features that only the history can bring back (deleted, or added and then undone) are owned by
+ * it and deleted when their command is dropped.
+ */
+class EditHistory
+{
+public:
+    //! The default cap on memoryUsage()
+    static const qint64 DEFAULT_BYTE_LIMIT = 16 * 1024 * 1024;
+
+    explicit EditHistory(qint64 byteLimit = DEFAULT_BYTE_LIMIT);
+    ~EditHistory();
+
+    /*!
+     * \brief push record an edit that has already been made
+     * Clears the redo stack of the floor and drops the oldest commands if the history is over its limit.
+     * \param command
+     */
+    void push(const EditCommand& command);
+    /*!
+     * \brief undo revert the last edit on a floor
+     * \param floor
+     * \param command set to the command that was reverted
+     * \return false if there was nothing to undo
+     */
+    bool undo(DiagramModels::Floor* floor, EditCommand* command);
+    /*!
+     * \brief redo make the last undone edit on a floor again
+     * \param floor
+     * \param command set to the command that was made again
+     * \return false if there was nothing to redo
+     */
+    bool redo(DiagramModels::Floor* floor, EditCommand* command);
+
+    //! The command undo() would revert next on \param floor, or NULL
+    const EditCommand* peekUndo(DiagramModels::Floor* floor) const;
+    //! The command redo() would make next on \param floor, or NULL
+    const EditCommand* peekRedo(DiagramModels::Floor* floor) const;
+    //! If \param floor has an edit to undo
+    bool canUndo(DiagramModels::Floor* floor) const{return !_floors.value(floor).undo.isEmpty();}
+    //! If \param floor has an edit to redo
+    bool canRedo(DiagramModels::Floor* floor) const{return !_floors.value(floor).redo.isEmpty();}
+    //! The number of commands kept across every floor
+    int count() const;
+    //! An estimate of the bytes held by the history, including the features it owns
+    qint64 memoryUsage() const{return _bytes;}
+    //! The cap on memoryUsage()
+    qint64 byteLimit() const{return _byteLimit;}
+    //! Change the cap, dropping the oldest commands if the history is now over it
+    void setByteLimit(qint64 bytes);
+    //! Forget every command, deleting the features the history owns
+    void clear();
+
+private:
+    typedef struct{
+        EditCommand command;
+        quint64 sequence; //! When the command was pushed, orders eviction across floors
+    }Entry;
+
+    typedef struct{
+        QList<Entry> undo;
+        QList<Entry> redo;
+    }FloorHistory;
+
+    //! The bytes held for \param command, \param undoStack says which stack it is on
+    static qint64 cost(const EditCommand& command, bool undoStack);
+    //! If the history owns the feature of \param command while it is on the given stack
+    static bool owns(const EditCommand& command, bool undoStack);
+    //! Drop a command, deleting its feature if the history owned it
+    void release(const Entry& entry, bool undoStack);
+    //! Drop the oldest undo commands until the history is within its limit
+    void evict();
+    //! Make or revert \param command on the model
+    static void apply(const EditCommand& command, bool forward);
+
+    QHash<DiagramModels::Floor*,FloorHistory> _floors;
+    quint64 _sequence;
+    qint64 _bytes;
+    qint64 _byteLimit;
+};
+
+#endif // EDITHISTORY_H
@@ -0,0 +1,460 @@
+#include "editjournal.h"
+#include "bytestream.h"
+#include "filewriter.h"
+#include "tracing.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QtConcurrent/QtConcurrentRun>
+#include <climits>
+
+using namespace DiagramModels;
+
+namespace{
+    // magic, version, flags, building file size and modification time
+    const int HEADER_SIZE = 4 + 2 + 2 + 8 + 8;
+    //! Journals larger than this are compacted into the building file
+    const qint64 DEFAULT_COMPACT_THRESHOLD = 4 * 1024 * 1024;
+    //! Header flag of a carried journal, see EditJournal
+    const quint16 CONTENT_HEADER = 1;
+
+    bool fail(QString* error, const QString& message){
+        if(error) *error = message;
+        return false;
+    }
+
+    //! The journal header for the building file at \param basePath as it is on disk now
+    QByteArray journalHeader(const QString& basePath){
+        QFileInfo info(basePath);
+        QByteArray header;
+        ByteWriter out(&header);
+        header.append("BJNL",4);
+        out.u16(EditJournal::VERSION);
+        out.u16(0);
+        out.u64(quint64(info.size()));
+        out.u64(quint64(info.lastModified().toMSecsSinceEpoch()));
+        return header;
+    }
+
+    //! The carried journal header for a building file holding \param contents
+    QByteArray contentHeader(const QByteArray& contents){
+        QByteArray header;
+        ByteWriter out(&header);
+        header.append("BJNL",4);
+        out.u16(EditJournal::VERSION);
+        out.u16(CONTENT_HEADER);
+        out.u64(quint64(contents.size()));
+        QByteArray hash = QCryptographicHash::hash(contents,QCryptographicHash::Sha1);
+        out.u64(ByteReader(hash,0,8).u64());
+        return header;
+    }
+
+    //! The carried journal next to \param basePath if it was written for the building file as it is now, else empty
+    QByteArray readCarried(const QString& basePath){
+        QFile carried(EditJournal::carriedJournalPath(basePath));
+        if(!carried.open(QIODevice::ReadOnly)) return QByteArray();
+        QByteArray data = carried.readAll();
+        QFile building(basePath);
+        if(data.size() < HEADER_SIZE || !building.open(QIODevice::ReadOnly)) return QByteArray();
+        // the size first, the building file is only hashed if it could be the one
+        if(ByteReader(data,8,16).u64() != quint64(building.size())) return QByteArray();
+        return data.startsWith(contentHeader(building.readAll())) ? data : QByteArray();
+    }
+
+    //! Split the records out of a journal, stopping at the first torn or damaged one
+    QList<QByteArray> readRecords(const QByteArray& data, int* validEnd){
+        QList<QByteArray> records;
+        int pos = HEADER_SIZE;
+        while(pos < data.size()){
+            ByteReader in(data,pos,data.size());
+            quint64 length = in.varint();
+            if(!in.ok() || length > quint64(data.size())) break;
+            QByteArray payload = in.bytes(int(length));
+            quint16 checksum = in.u16();
+            if(!in.ok() || checksum != qChecksum(payload.constData(),payload.size())) break;
+            records << payload;
+            pos = in.pos();
+        }
+        *validEnd = qMin(pos,data.size());
+        return records;
+    }
+
+    void writeVertices(ByteWriter& out, const QPolygon& bounds){
+        out.varint(bounds.size());
+        QPoint cursor;
+        for(const QPoint& p : bounds){
+            out.zigzag(p.x() - cursor.x());
+            out.zigzag(p.y() - cursor.y());
+            cursor = p;
+        }
+    }
+
+    bool readVertices(ByteReader& in, QPolygon* bounds){
+        quint64 count = in.varint();
+        if(!in.ok() || count > quint64(INT_MAX / 2)) return false;
+        bounds->reserve(int(count));
+        QPoint cursor;
+        for(quint64 i = 0; i < count && in.ok(); i++){
+            cursor += QPoint(int(in.zigzag()),int(in.zigzag()));
+            *bounds << cursor;
+        }
+        return in.ok();
+    }
+
+    void writeConnections(ByteWriter& out, const QSet<FeatureConnection>& connections){
+        out.varint(connections.size());
+        for(const FeatureConnection& con : connections){
+            out.zigzag(con.floor_index);
+            out.zigzag(con.feature_index);
+        }
+    }
+
+    bool readConnections(ByteReader& in, QSet<FeatureConnection>* connections){
+        quint64 count = in.varint();
+        for(quint64 i = 0; i < count && in.ok(); i++){
+            FeatureConnection con;
+            con.floor_index = int(in.zigzag());
+            con.feature_index = int(in.zigzag());
+            *connections << con;
+        }
+        return in.ok();
+    }
+
+    //! The feature at \param index on \param floor, or NULL
+    Feature* featureAt(Floor* floor, quint64 index){
+        QList<Feature*> features = floor->features();
+        return index < quint64(features.size()) ? features[int(index)] : NULL;
+    }
+
+    //! Apply one record to the building, false if it doesn't fit the building
+    bool apply(Building* building, const QByteArray& payload){
+        ByteReader in(payload,0,payload.size());
+        quint8 type = in.u8();
+        quint64 floorIndex = in.varint();
+        if(!in.ok() || floorIndex >= quint64(building->floorCount())) return false;
+        Floor* floor = building->floors()[int(floorIndex)];
+        if(type == EditJournal::FEATURE_ADDED){
+            quint8 featureType = in.u8();
+            QString name = in.string();
+            QPolygon bounds;
+            QSet<FeatureConnection> connections;
+            if(!readVertices(in,&bounds) || !readConnections(in,&connections) || featureType > STAIRS) return false;
+            Feature* feature = new Feature(FeatureType(featureType),bounds,floor);
+            feature->name(name);
+            feature->connections(connections);
+            floor->addFeature(feature);
+            return true;
+        }
+        if(type == EditJournal::FLOOR_RENAMED){
+            QString name = in.string();
+            if(!in.ok()) return false;
+            floor->name(name);
+            return true;
+        }
+
+        quint64 index = in.varint();
+        Feature* feature = in.ok() ? featureAt(floor,index) : NULL;
+        if(!feature) return false;
+        switch(type){
+        case EditJournal::FEATURE_REMOVED:
+            floor->removeFeature(int(index));
+            delete feature;
+            return true;
+        case EditJournal::BOUNDS_CHANGED:{
+            QPolygon bounds;
+            if(!readVertices(in,&bounds)) return false;
+            feature->bounds(bounds);
+            return true;
+        }
+        case EditJournal::FEATURE_RENAMED:{
+            QString name = in.string();
+            if(!in.ok()) return false;
+            feature->name(name);
+            return true;
+        }
+        case EditJournal::TYPE_CHANGED:{
+            quint8 featureType = in.u8();
+            if(!in.ok() || featureType > STAIRS) return false;
+            feature->type(FeatureType(featureType));
+            return true;
+        }
+        case EditJournal::CONNECTION_ADDED:{
+            int conFloor = int(in.zigzag());
+            int conFeature = int(in.zigzag());
+            if(!in.ok()) return false;
+            feature->addConnection(conFloor,conFeature);
+            return true;
+        }
+        case EditJournal::CONNECTIONS_SET:{
+            QSet<FeatureConnection> connections;
+            if(!readConnections(in,&connections)) return false;
+            feature->connections(connections);
+            return true;
+        }
+        }
+        return false;
+    }
+}
+
+EditJournal::EditJournal(Building *building, const QString &basePath, QObject *parent):QObject(parent),
+    _building(building),_basePath(basePath),_lastRecord(-1),_lastBoundsFeature(NULL),_journalChecked(false),
+    _compactThreshold(DEFAULT_COMPACT_THRESHOLD),_compacting(false),_carrying(false){
+    connect(&_compaction,SIGNAL(finished()),this,SLOT(compactionFinished()));
+    _building->setEditListener(this);
+}
+
+EditJournal::~EditJournal(){
+    _building->setEditListener(NULL);
+    _compaction.waitForFinished();
+}
+
+bool EditJournal::replay(Building *building, const QString &basePath, QString *error){
+    TRACE_SPAN(traceLoad,"replayJournal");
+    QFile file(journalPath(basePath));
+    QByteArray data;
+    if(file.exists()){
+        if(!file.open(QIODevice::ReadOnly)) return fail(error,file.errorString());
+        data = file.readAll();
+    }
+    if(!data.startsWith(journalHeader(basePath))){
+        // a compaction may have replaced the building file before it could move its journal into place
+        QByteArray carried = readCarried(basePath);
+        if(!carried.isEmpty()) data = carried;
+        else if(!file.exists()) return true;
+        else return fail(error,"The journal was written for a different version of the building file");
+    }
+    int end;
+    QList<QByteArray> records = readRecords(data,&end);
+    for(int i = 0; i < records.size(); i++){
+        if(!apply(building,records[i])) return fail(error,QString("Journal record %1 doesn't match the building").arg(i));
+    }
+    if(end < data.size()) return fail(error,QString("The journal is damaged at byte %1").arg(end));
+    return true;
+}
+
+bool EditJournal::isCompacting(){
+    QMutexLocker lock(&_fileMutex);
+    return _compacting;
+}
+
+QByteArray EditJournal::beginRecord(RecordType type, Floor *floor){
+    QByteArray payload;
+    ByteWriter out(&payload);
+    out.u8(type);
+    out.varint(floor->floorIndex());
+    _lastBoundsFeature = NULL;
+    return payload;
+}
+
+void EditJournal::endRecord(const QByteArray &payload){
+    _lastRecord = _pending.size();
+    ByteWriter out(&_pending);
+    out.varint(payload.size());
+    out.bytes(payload);
+    out.u16(qChecksum(payload.constData(),payload.size()));
+}
+
+void EditJournal::featureAdded(Floor *floor, Feature *feature){
+    QByteArray payload = beginRecord(FEATURE_ADDED,floor);
+    ByteWriter out(&payload);
+    out.u8(feature->type());
+    out.string(feature->name());
+    writeVertices(out,feature->bounds());
+    writeConnections(out,feature->connections());
+    endRecord(payload);
+}
+
+void EditJournal::featureRemoved(Floor *floor, int index){
+    QByteArray payload = beginRecord(FEATURE_REMOVED,floor);
+    ByteWriter out(&payload);
+    out.varint(index);
+    endRecord(payload);
+}
+
+void EditJournal::featureEdited(Floor *floor, Feature *feature, FeatureEdit edit){
+    // not features(), which would try to load a floor that may be loading right now
+    int index = floor->indexOf(feature);
+    if(index < 0) return;
+    if(edit == EDIT_BOUNDS && feature == _lastBoundsFeature){
+        // only the final bounds matter, a drag replaces its own record instead of adding one per step
+        _pending.truncate(_lastRecord);
+    }
+    RecordType types[] = {BOUNDS_CHANGED,TYPE_CHANGED,FEATURE_RENAMED,CONNECTIONS_SET};
+    QByteArray payload = beginRecord(types[edit],floor);
+    ByteWriter out(&payload);
+    out.varint(index);
+    switch(edit){
+    case EDIT_BOUNDS: writeVertices(out,feature->bounds()); break;
+    case EDIT_TYPE: out.u8(feature->type()); break;
+    case EDIT_NAME: out.string(feature->name()); break;
+    case EDIT_CONNECTIONS: writeConnections(out,feature->connections()); break;
+    }
+    endRecord(payload);
+    if(edit == EDIT_BOUNDS) _lastBoundsFeature = feature;
+}
+
+void EditJournal::connectionAdded(Floor *floor, Feature *feature, const FeatureConnection &connection){
+    int index = floor->indexOf(feature);
+    if(index < 0) return;
+    QByteArray payload = beginRecord(CONNECTION_ADDED,floor);
+    ByteWriter out(&payload);
+    out.varint(index);
+    out.zigzag(connection.floor_index);
+    out.zigzag(connection.feature_index);
+    endRecord(payload);
+}
+
+void EditJournal::floorRenamed(Floor *floor){
+    QByteArray payload = beginRecord(FLOOR_RENAMED,floor);
+    ByteWriter out(&payload);
+    out.string(floor->name());
+    endRecord(payload);
+}
+
+bool EditJournal::openJournal(QString *error){
+    if(!QFileInfo::exists(_basePath)) return fail(error,"The building file " + _basePath + " doesn't exist");
+    QByteArray header = journalHeader(_basePath);
+    QFile file(journalPath(_basePath));
+    if(file.open(QIODevice::ReadWrite)){
+        QByteArray data = file.readAll();
+        if(data.startsWith(header)){
+            int end;
+            readRecords(data,&end);
+            if(end < data.size()) file.resize(end); // appending after a torn record would hide the new ones
+            // left by a compaction that never replaced the building file
+            if(!_carrying) QFile::remove(carriedJournalPath(_basePath));
+            _journalChecked = true;
+            return true;
+        }
+        file.close();
+    }
+    // missing, or left over from an older version of the building file: start over, with the edits
+    // a compaction carried if it replaced the building file but couldn't restart the journal
+    QByteArray records = _sinceSnapshot;
+    QByteArray carried = readCarried(_basePath);
+    if(!carried.isEmpty()){
+        int end;
+        readRecords(carried,&end);
+        records = carried.mid(HEADER_SIZE,end - HEADER_SIZE);
+    }
+    QSaveFile fresh(journalPath(_basePath));
+    if(!fresh.open(QIODevice::WriteOnly)) return fail(error,fresh.errorString());
+    fresh.write(header);
+    fresh.write(records);
+    if(!fresh.commit()) return fail(error,fresh.errorString());
+    QFile::remove(carriedJournalPath(_basePath));
+    _sinceSnapshot.clear();
+    _journalChecked = true;
+    return true;
+}
+
+bool EditJournal::save(QString *error){
+    if(_pending.isEmpty()) return true;
+    TRACE_SPAN(traceSave,"appendJournal");
+    QMutexLocker lock(&_fileMutex);
+    if(!_journalChecked && !openJournal(error)) return false;
+    QFile file(journalPath(_basePath));
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Append)) return fail(error,file.errorString());
+    // the carried journal first, so a failure leaves both files as they were
+    QFile carried(carriedJournalPath(_basePath));
+    qint64 carriedBefore = 0;
+    if(_carrying){
+        if(!carried.open(QIODevice::WriteOnly | QIODevice::Append)) return fail(error,carried.errorString());
+        carriedBefore = carried.size();
+        if(carried.write(_pending) != _pending.size() || !carried.flush()){
+            QString message = carried.errorString();
+            carried.resize(carriedBefore);
+            return fail(error,message);
+        }
+    }
+    qint64 before = file.size();
+    if(file.write(_pending) != _pending.size() || !file.flush()){
+        QString message = file.errorString();
+        file.resize(before);
+        if(_carrying) carried.resize(carriedBefore);
+        return fail(error,message);
+    }
+    qint64 size = file.size();
+    file.close();
+    if(_compacting) _sinceSnapshot += _pending;
+    _pending.clear();
+    _lastRecord = -1;
+    _lastBoundsFeature = NULL;
+    bool compact = !_compacting && size > _compactThreshold;
+    lock.unlock();
+
+    if(compact) startCompaction();
+    return true;
+}
+
+void EditJournal::startCompaction(){
+    // the snapshot covers every record saved so far, later ones are collected in _sinceSnapshot
+    Building* snapshot = _building->snapshot();
+    QMutexLocker lock(&_fileMutex);
+    _compacting = true;
+    _sinceSnapshot.clear();
+    _compaction.setFuture(QtConcurrent::run([this,snapshot](){
+        QString error;
+        bool ok = compact(snapshot,&error);
+        delete snapshot;
+        if(!ok) _compactionError = error;
+        return ok;
+    }));
+}
+
+bool EditJournal::startCarrying(const QByteArray &data, QString *error){
+    QMutexLocker lock(&_fileMutex);
+    QSaveFile file(carriedJournalPath(_basePath));
+    if(!file.open(QIODevice::WriteOnly)) return fail(error,file.errorString());
+    file.write(contentHeader(data));
+    file.write(_sinceSnapshot);
+    if(!file.commit()) return fail(error,file.errorString());
+    _carrying = true;
+    return true;
+}
+
+bool EditJournal::compact(Building *snapshot, QString *error){
+    TRACE_SPAN(traceSave,"compactJournal");
+    QString loadError;
+    bool written = false;
+    if(snapshot->loadFailed(&loadError)){
+        // the floor would be written out empty, losing whatever the file still has of it
+        fail(error,loadError + ", not compacting into it");
+    }else{
+        QByteArray data = FileWriter::encode(snapshot,FileWriter::formatFor(_basePath));
+        // from here until the journal is restarted, edits saved are in a journal that matches either building file
+        written = startCarrying(data,error) && FileWriter::write(data,_basePath,error);
+    }
+    QMutexLocker lock(&_fileMutex);
+    _compacting = false;
+    _carrying = false;
+    if(!written){
+        // the building file and journal are untouched and still complete
+        QFile::remove(carriedJournalPath(_basePath));
+        _sinceSnapshot.clear();
+        return false;
+    }
+    QSaveFile file(journalPath(_basePath));
+    if(!file.open(QIODevice::WriteOnly)){
+        _journalChecked = false;
+        return fail(error,file.errorString());
+    }
+    file.write(journalHeader(_basePath));
+    file.write(_sinceSnapshot);
+    if(!file.commit()){
+        // the old journal no longer matches, the next save starts a new one from the carried journal
+        _journalChecked = false;
+        return fail(error,file.errorString());
+    }
+    QFile::remove(carriedJournalPath(_basePath));
+    _sinceSnapshot.clear();
+    return true;
+}
+
+void EditJournal::compactionFinished(){
+    if(_compaction.result()) emit compacted();
+    else emit compactionFailed(_compactionError);
+}
@@ -0,0 +1,139 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QMutex>
+#include <QFutureWatcher>
+
+#include "diagrammodels.h"
+
+/*!
+ * \brief The EditJournal class saves a building by appending its edits to a sidecar file
+ *
+ * The journal lives next to the building file ("plan.bldg.journal"). Edits are encoded as they
+ * happen and save() appends them, so the cost of a save depends on the edits since the last one
+ * rather than on the size of the building. Once the journal grows past a threshold it is compacted
+ * in the background: a snapshot is written over the building file and the journal starts over.
+ * Edits saved while that runs go to a carried journal ("plan.bldg.journal.next") as well, which is
+ * written for the snapshot before the building file is replaced and moved into place after it, so
+ * they survive a crash in between.
+ *
+ * Layout, all fixed width integers little endian:
+ *  - header: "BJNL", u16 version, u16 flags, u64 size and i64 modification time (ms) of the
+ *    building file the journal applies to; a carried journal has flag 1 set and the first
+ *    8 bytes of the SHA-1 of the building file instead of its time, which isn't known in advance
+ *  - records: varint payload length, payload, u16 checksum of the payload; the payload is
+ *    u8 record type, varint floor index and the fields of that type, vertices as zigzag deltas
+ * A journal whose header doesn't match its building file is stale and ignored, a torn last
+ * record is dropped.
+ */
+class EditJournal : public QObject, public DiagramModels::EditListener
+{
+    Q_OBJECT
+public:
+    enum{
+        VERSION = 1
+    };
+
+    //! The kinds of record in the journal
+    typedef enum{
+        FEATURE_ADDED = 1,      // type, name, vertices, connections
+        FEATURE_REMOVED = 2,    // feature index
+        BOUNDS_CHANGED = 3,     // feature index, vertices
+        FEATURE_RENAMED = 4,    // feature index, name
+        TYPE_CHANGED = 5,       // feature index, type
+        CONNECTION_ADDED = 6,   // feature index, floor index, feature index
+        CONNECTIONS_SET = 7,    // feature index, connections
+        FLOOR_RENAMED = 8       // name
+    }RecordType;
+
+    /*!
+     * \brief EditJournal start recording the edits made to a building
+     * \param building the building, already saved to or loaded from \param basePath
+     * \param basePath the building file the journal belongs to
+     * \param parent
+     */
+    explicit EditJournal(DiagramModels::Building* building, const QString& basePath, QObject* parent = 0);
+    //! Stops recording and waits for a running compaction
+    ~EditJournal();
+
+    //! The sidecar journal for the building file \param basePath
+    static QString journalPath(const QString& basePath){return basePath + ".journal";}
+    //! The journal a compaction of \param basePath carries edits in until it replaces the journal
+    static QString carriedJournalPath(const QString& basePath){return journalPath(basePath) + ".next";}
+
+    /*!
+     * \brief replay apply the journal next to a building file to the building loaded from it
+     * \param building the building, just loaded from \param basePath
+     * \param basePath
+     * \param error set to why the journal was ignored or cut short
+     * \return false if the journal is stale or damaged, the records before the damage are still applied
+     */
+    static bool replay(DiagramModels::Building* building, const QString& basePath, QString* error = 0);
+
+    //! The building file the journal belongs to
+    const QString& basePath() const{return _basePath;}
+    //! If there are edits that save() would write
+    bool hasUnsavedEdits() const{return !_pending.isEmpty();}
+    //! If a background compaction is running
+    bool isCompacting();
+    //! Compact the journal once it is larger than \param bytes
+    void setCompactThreshold(qint64 bytes){_compactThreshold = bytes;}
+
+    /*!
+     * \brief save append the edits made since the last save to the journal
+     * May start a background compaction, see compacted() and compactionFailed().
+     * \param error set to a description of the problem if writing fails
+     * \return false if the edits couldn't be written, they are kept for the next attempt
+     */
+    bool save(QString* error = 0);
+
+    void featureAdded(DiagramModels::Floor* floor, DiagramModels::Feature* feature) override;
+    void featureRemoved(DiagramModels::Floor* floor, int index) override;
+    void featureEdited(DiagramModels::Floor* floor, DiagramModels::Feature* feature, DiagramModels::FeatureEdit edit) override;
+    void connectionAdded(DiagramModels::Floor* floor, DiagramModels::Feature* feature, const DiagramModels::FeatureConnection& connection) override;
+    void floorRenamed(DiagramModels::Floor* floor) override;
+
+signals:
+    //! The building file was rewritten from a snapshot and the journal restarted
+    void compacted();
+    //! Compaction failed with \param error, the journal is still complete
+    void compactionFailed(QString error);
+
+private slots:
+    void compactionFinished();
+
+private:
+    //! Start a record of \param type for \param floor in _pending, returns the payload to fill in
+    QByteArray beginRecord(RecordType type, DiagramModels::Floor* floor);
+    //! Frame \param payload and append it to _pending
+    void endRecord(const QByteArray& payload);
+    //! Check the journal on disk still belongs to the building file and drop a torn tail
+    bool openJournal(QString* error);
+    //! Snapshot the building and rewrite the building file on a worker thread
+    void startCompaction();
+    //! On the worker: write \param snapshot over the building file and restart the journal
+    bool compact(DiagramModels::Building* snapshot, QString* error);
+    //! On the worker: start the carried journal for the building file about to hold \param data
+    bool startCarrying(const QByteArray& data, QString* error);
+
+private:
+    DiagramModels::Building* _building;
+    QString _basePath;
+    QByteArray _pending; //! Framed records not yet written
+    int _lastRecord; //! Where the last record in _pending starts, -1 if it can't be coalesced
+    DiagramModels::Feature* _lastBoundsFeature; //! The feature the last record moved, if it was BOUNDS_CHANGED
+    bool _journalChecked; //! If the journal on disk has been checked against the building file
+    qint64 _compactThreshold;
+
+    QMutex _fileMutex; //! Held while the journal file is written, by save() or a compaction
+    bool _compacting; //! Guarded by _fileMutex
+    QByteArray _sinceSnapshot; //! Records saved while compacting, carried into the new journal; guarded by _fileMutex
+    bool _carrying; //! If saves also go to the carried journal; guarded by _fileMutex
+    QFutureWatcher<bool> _compaction;
+    QString _compactionError;
+};
+
+#endif // EDITJOURNAL_H
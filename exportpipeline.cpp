@@ -0,0 +1,275 @@
+#include "exportpipeline.h"
+#include "floorrenderer.h"
+#include "tracing.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPainter>
+#include <QPdfWriter>
+
+using namespace DiagramModels;
+
+bool ExportSink::open(QString *error){
+    if(!_file.open(QIODevice::WriteOnly)){
+        if(error) *error = _file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool ExportSink::commit(QString *error){
+    if(!_file.commit()){
+        if(error) *error = _file.errorString();
+        return false;
+    }
+    return true;
+}
+
+//! The outline of \param bounds as SVG path data
+static QString svgPath(const QPolygon& bounds){
+    QString re;
+    for(int i = 0; i < bounds.size(); i++){
+        re += QString(i == 0 ? "M%1 %2" : " L%1 %2").arg(bounds[i].x()).arg(bounds[i].y());
+    }
+    if(!bounds.isEmpty()) re += " Z";
+    return re;
+}
+
+void SvgSink::beginBuilding(Building *building){
+    int width = 0, height = 0;
+    for(Floor* floor : building->floors()){
+        QRect extents = floor->extents();
+        _extents << extents;
+        width = qMax(width,extents.width());
+        height += extents.height() + FLOOR_GAP;
+    }
+    _xml.setAutoFormatting(true);
+    _xml.writeStartDocument();
+    _xml.writeStartElement("svg");
+    _xml.writeDefaultNamespace("http://www.w3.org/2000/svg");
+    _xml.writeAttribute("version","1.1");
+    _xml.writeAttribute("viewBox",QString("0 0 %1 %2").arg(width).arg(qMax(0,height - FLOOR_GAP)));
+    _xml.writeTextElement("title",building->name());
+}
+
+void SvgSink::beginFloor(Floor *floor, int position){
+    QRect extents = _extents.value(position);
+    // each floor's top left corner goes to the left edge, below the floor before
+    _xml.writeStartElement("g");
+    _xml.writeAttribute("id",QString("floor-%1").arg(position));
+    _xml.writeAttribute("transform",QString("translate(%1 %2)").arg(-extents.x()).arg(_offset - extents.y()));
+    _xml.writeAttribute("stroke","black");
+    _xml.writeTextElement("title",floor->name());
+    _offset += extents.height() + FLOOR_GAP;
+}
+
+void SvgSink::feature(Floor *floor, int position, Feature *feature, int index){
+    Q_UNUSED(floor);Q_UNUSED(position);Q_UNUSED(index);
+    _xml.writeEmptyElement("path");
+    _xml.writeAttribute("d",svgPath(feature->bounds()));
+    _xml.writeAttribute("fill",FloorRenderer::featureBrush(feature).color().name());
+    if(!feature->name().isEmpty()){
+        QPoint label = feature->labelPosition();
+        _xml.writeStartElement("text");
+        _xml.writeAttribute("x",QString::number(label.x()));
+        _xml.writeAttribute("y",QString::number(label.y()));
+        _xml.writeAttribute("stroke","none");
+        _xml.writeCharacters(feature->name());
+        _xml.writeEndElement();
+    }
+}
+
+void SvgSink::endFloor(Floor *floor, int position){
+    Q_UNUSED(floor);Q_UNUSED(position);
+    _xml.writeEndElement();
+}
+
+void SvgSink::endBuilding(Building *building){
+    Q_UNUSED(building);
+    _xml.writeEndElement();
+    _xml.writeEndDocument();
+}
+
+PdfSink::PdfSink(const QString &filepath):ExportSink(filepath){}
+
+// out of line, where QPdfWriter and QPainter are complete types
+PdfSink::~PdfSink(){}
+
+//! Margin around each page, and the height of the floor name above the floor, in points
+static const qreal PDF_MARGIN = 36;
+static const qreal PDF_TITLE_HEIGHT = 24;
+
+void PdfSink::beginBuilding(Building *building){
+    _writer.reset(new QPdfWriter(device()));
+    _writer->setTitle(building->name());
+    _writer->setCreator(building->name());
+    _writer->setPageSize(QPageSize(QPageSize::A4));
+    _writer->setPageOrientation(QPageLayout::Landscape);
+    _painter.reset(new QPainter(_writer.data()));
+}
+
+void PdfSink::beginFloor(Floor *floor, int position){
+    if(position > 0) _writer->newPage();
+    // page units are device pixels, points are 1/72 inch
+    qreal points = _writer->resolution() / 72.0;
+    QRectF page(0,0,_writer->width(),_writer->height());
+    page.adjust(PDF_MARGIN * points,PDF_MARGIN * points,-PDF_MARGIN * points,-PDF_MARGIN * points);
+
+    _painter->resetTransform();
+    QFont font = _painter->font();
+    font.setPointSizeF(14);
+    _painter->setFont(font);
+    _painter->drawText(QRectF(page.topLeft(),QSizeF(page.width(),PDF_TITLE_HEIGHT * points)),Qt::AlignLeft | Qt::AlignVCenter,
+                       QString("%1 (level %2)").arg(floor->name()).arg(floor->floorIndex()));
+    page.setTop(page.top() + PDF_TITLE_HEIGHT * points);
+
+    QRect extents = floor->extents();
+    if(extents.isEmpty()) return;
+    qreal scale = qMin(page.width() / extents.width(),page.height() / extents.height());
+    _painter->translate(page.topLeft());
+    _painter->scale(scale,scale);
+    _painter->translate(-extents.topLeft());
+    // the font is scaled with the floor, this keeps the labels at 6 points on the page
+    font.setPointSizeF(6 / scale);
+    _painter->setFont(font);
+    _painter->setPen(QPen(Qt::black,0));
+}
+
+void PdfSink::feature(Floor *floor, int position, Feature *feature, int index){
+    Q_UNUSED(floor);Q_UNUSED(position);Q_UNUSED(index);
+    // every feature at full detail, unlike the screen there is no zoom level to simplify for
+    FloorRenderer::drawFeature(*_painter,feature,FloorRenderer::featureBrush(feature));
+}
+
+void PdfSink::endFloor(Floor *floor, int position){
+    Q_UNUSED(floor);Q_UNUSED(position);
+}
+
+void PdfSink::endBuilding(Building *building){
+    Q_UNUSED(building);
+    // ending the painter writes the last page and the document trailer
+    _painter->end();
+    _painter.reset();
+    _writer.reset();
+}
+
+void GeoJsonSink::beginBuilding(Building *building){
+    QJsonObject name;
+    name.insert("name",building->name());
+    device()->write("{\"type\":\"FeatureCollection\",\"properties\":");
+    device()->write(QJsonDocument(name).toJson(QJsonDocument::Compact));
+    device()->write(",\"features\":[");
+}
+
+void GeoJsonSink::feature(Floor *floor, int position, Feature *feature, int index){
+    Q_UNUSED(position);
+    QPolygon bounds = feature->bounds();
+    if(bounds.size() < 3) return; // not a polygon
+
+    QJsonArray ring;
+    qint64 area = 0; // twice the signed area in floor coordinates
+    for(int i = 0; i < bounds.size(); i++){
+        const QPoint& a = bounds[i];
+        const QPoint& b = bounds[(i + 1) % bounds.size()];
+        area += qint64(a.x()) * b.y() - qint64(b.x()) * a.y();
+        ring.append(QJsonArray() << _geo.longitude(a) << _geo.latitude(a));
+    }
+    ring.append(ring.first()); // closed
+    // outer rings go counterclockwise in longitude and latitude (RFC 7946); latitude runs against floor y,
+    // so a ring with a positive area in floor coordinates is clockwise once placed on the globe
+    if(area > 0){
+        QJsonArray reversed;
+        for(int i = ring.size() - 1; i >= 0; i--) reversed.append(ring[i]);
+        ring = reversed;
+    }
+    QJsonObject geometry;
+    geometry.insert("type","Polygon");
+    geometry.insert("coordinates",QJsonArray() << ring);
+
+    QJsonArray connections;
+    for(const FeatureConnection& connection : feature->connections()){
+        QJsonObject link;
+        link.insert("level",connection.floor_index);
+        link.insert("feature",connection.feature_index);
+        connections.append(link);
+    }
+    QJsonObject properties;
+    properties.insert("name",feature->name());
+    properties.insert("type",feature->type() == STAIRS ? "stairs" : "room");
+    properties.insert("level",floor->floorIndex());
+    properties.insert("floor",floor->name());
+    properties.insert("connections",connections);
+
+    QJsonObject object;
+    object.insert("type","Feature");
+    object.insert("id",QString("%1-%2").arg(floor->floorIndex()).arg(index));
+    object.insert("geometry",geometry);
+    object.insert("properties",properties);
+    device()->write(_count++ ? ",\n" : "\n");
+    device()->write(QJsonDocument(object).toJson(QJsonDocument::Compact));
+}
+
+void GeoJsonSink::endBuilding(Building *building){
+    Q_UNUSED(building);
+    device()->write("\n]}\n");
+}
+
+void ExportPipeline::addSink(ExportFormat format, const QString &filepath){
+    switch(format){
+    case SVG:
+        addSink(new SvgSink(filepath));
+        break;
+    case PDF:
+        addSink(new PdfSink(filepath));
+        break;
+    case GEOJSON:
+        addSink(new GeoJsonSink(filepath,_geo));
+        break;
+    case OSM:
+        Q_ASSERT_X(false,"ExportPipeline::addSink","OSM has its own exporter");
+        break;
+    }
+}
+
+//! Give up on every sink, \param reason for \param failed or for all of them if it is NULL
+static bool fail(const QList<ExportSink*>& sinks, ExportSink* failed, const QString& reason, QString* error){
+    for(ExportSink* sink : sinks) sink->cancel();
+    if(error) *error = failed ? failed->filepath() + ": " + reason : reason;
+    return false;
+}
+
+bool ExportPipeline::run(Building *building, QString *error, IoMonitor *monitor){
+    TRACE_SPAN(traceSave,"exportPipeline");
+    QString reason;
+    for(ExportSink* sink : _sinks){
+        if(!sink->open(&reason)) return fail(_sinks,sink,reason,error);
+    }
+
+    QList<Floor*> floors = building->floors();
+    for(ExportSink* sink : _sinks) sink->beginBuilding(building);
+    for(int position = 0; position < floors.size(); position++){
+        if(monitor && monitor->isCancelled()) return fail(_sinks,NULL,"Export cancelled",error);
+        Floor* floor = floors[position];
+        QList<Feature*> features = floor->features();
+        for(ExportSink* sink : _sinks) sink->beginFloor(floor,position);
+        for(int i = 0; i < features.size(); i++){
+            for(ExportSink* sink : _sinks) sink->feature(floor,position,features[i],i);
+        }
+        for(ExportSink* sink : _sinks) sink->endFloor(floor,position);
+        // a full disk shows up here, not after the rest of the building has been encoded
+        for(ExportSink* sink : _sinks){
+            if(sink->hasFailed()) return fail(_sinks,sink,sink->errorString(),error);
+        }
+        if(monitor) monitor->progress(position + 1,floors.size());
+    }
+    for(ExportSink* sink : _sinks) sink->endBuilding(building);
+
+    for(int i = 0; i < _sinks.size(); i++){
+        if(!_sinks[i]->commit(&reason)){
+            // the files before this one are already in place
+            return fail(_sinks.mid(i + 1),_sinks[i],reason,error);
+        }
+    }
+    return true;
+}
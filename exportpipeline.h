@@ -0,0 +1,163 @@
+#ifndef EXPORTPIPELINE_H
+#define EXPORTPIPELINE_H
+
+#include <QList>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QString>
+#include <QVector>
+#include <QXmlStreamWriter>
+
+#include "diagrammodels.h"
+#include "filewriter.h"
+#include "georeference.h"
+#include "iomonitor.h"
+
+class QPainter;
+class QPdfWriter;
+
+/*!
+ * \brief The ExportSink class turns the stream of floors and features from ExportPipeline into one file
+ *
+ * The pipeline calls beginBuilding(), then for each floor beginFloor(), feature() for each of its
+ * features and endFloor(), then endBuilding(). Sinks write to device() as they go; it is a buffered
+ * QSaveFile, so the file goes to disk in blocks and is only replaced once the export has succeeded.
+ */
+class ExportSink
+{
+public:
+    explicit ExportSink(const QString& filepath):_file(filepath){}
+    virtual ~ExportSink(){}
+
+    QString filepath() const{return _file.fileName();}
+
+    virtual void beginBuilding(DiagramModels::Building* building){Q_UNUSED(building);}
+    virtual void beginFloor(DiagramModels::Floor* floor, int position){Q_UNUSED(floor);Q_UNUSED(position);}
+    //! \param index the feature's index on \param floor, which is at \param position in the building
+    virtual void feature(DiagramModels::Floor* floor, int position, DiagramModels::Feature* feature, int index) = 0;
+    virtual void endFloor(DiagramModels::Floor* floor, int position){Q_UNUSED(floor);Q_UNUSED(position);}
+    virtual void endBuilding(DiagramModels::Building* building){Q_UNUSED(building);}
+
+    //! Open the file, \return false with \param error set if it can't be
+    bool open(QString* error);
+    //! If a write has failed, the export can stop early
+    bool hasFailed() const{return _file.error() != QFileDevice::NoError;}
+    QString errorString() const{return _file.errorString();}
+    //! Replace the file with what was written, \return false with \param error set if that fails
+    bool commit(QString* error);
+    //! Drop what was written, leaving any previous file as it was
+    void cancel(){_file.cancelWriting();}
+
+protected:
+    QIODevice* device(){return &_file;}
+
+private:
+    QSaveFile _file;
+};
+
+/*!
+ * \brief The SvgSink class writes every floor into one SVG drawing, stacked top to bottom
+ * Features are filled as in the editor, see FloorRenderer::featureBrush().
+ */
+class SvgSink: public ExportSink
+{
+public:
+    explicit SvgSink(const QString& filepath):ExportSink(filepath),_xml(device()),_offset(0){}
+
+    void beginBuilding(DiagramModels::Building* building);
+    void beginFloor(DiagramModels::Floor* floor, int position);
+    void feature(DiagramModels::Floor* floor, int position, DiagramModels::Feature* feature, int index);
+    void endFloor(DiagramModels::Floor* floor, int position);
+    void endBuilding(DiagramModels::Building* building);
+
+    //! Space left between floors, in floor units
+    enum{FLOOR_GAP = 50};
+
+private:
+    QXmlStreamWriter _xml;
+    QVector<QRect> _extents;    // of each floor, taken once so the viewBox and the floors agree
+    int _offset;                // where the next floor starts, down the drawing
+};
+
+/*!
+ * \brief The PdfSink class prints each floor on its own A4 page, scaled to fit
+ * Needs a QGuiApplication for the fonts.
+ */
+class PdfSink: public ExportSink
+{
+public:
+    explicit PdfSink(const QString& filepath);
+    ~PdfSink();
+
+    void beginBuilding(DiagramModels::Building* building);
+    void beginFloor(DiagramModels::Floor* floor, int position);
+    void feature(DiagramModels::Floor* floor, int position, DiagramModels::Feature* feature, int index);
+    void endFloor(DiagramModels::Floor* floor, int position);
+    void endBuilding(DiagramModels::Building* building);
+
+private:
+    QScopedPointer<QPdfWriter> _writer;
+    QScopedPointer<QPainter> _painter;
+};
+
+/*!
+ * \brief The GeoJsonSink class writes a GeoJSON (RFC 7946) FeatureCollection of polygons
+ * Properties are name, type ("room" or "stairs"), level (the floor index), floor (its name)
+ * and connections, a list of {level, feature} pairs.
+ */
+class GeoJsonSink: public ExportSink
+{
+public:
+    GeoJsonSink(const QString& filepath, const GeoReference& geo):ExportSink(filepath),_geo(geo),_count(0){}
+
+    void beginBuilding(DiagramModels::Building* building);
+    void feature(DiagramModels::Floor* floor, int position, DiagramModels::Feature* feature, int index);
+    void endBuilding(DiagramModels::Building* building);
+
+private:
+    GeoReference _geo;
+    int _count;     // features written so far, for the separators
+};
+
+/*!
+ * \brief The ExportPipeline class exports a building to any number of files in one pass
+ *
+ * Floors and features are visited once, in order, and handed to every sink, so exporting several
+ * formats costs one traversal (and one load of each lazily loaded floor) however many there are.
+ * OSM isn't a sink: the format puts every node before any way, which takes two passes, see OsmExporter.
+ */
+class ExportPipeline
+{
+public:
+    ExportPipeline(){}
+    ~ExportPipeline(){qDeleteAll(_sinks);}
+
+    //! Where the building is on the globe, for the sinks added after this
+    void setGeoReference(const GeoReference& geo){_geo = geo;}
+
+    //! If \param format is written by a sink rather than its own exporter
+    static bool supports(ExportFormat format){return format != OSM;}
+    //! Export to \param filepath in \param format, which must be supported
+    void addSink(ExportFormat format, const QString& filepath);
+    //! Add a sink of any kind, the pipeline deletes it
+    void addSink(ExportSink* sink){_sinks << sink;}
+
+    /*!
+     * \brief run export the building to every sink
+     * A failure or cancellation while exporting leaves every file as it was; only the final
+     * renames, one per file, can leave some files replaced and not others.
+     * \param building
+     * \param error set to a description of the first problem, prefixed with its file
+     * \param monitor reports progress per floor and stops the export if it is cancelled
+     * \return false if the files weren't written
+     */
+    bool run(DiagramModels::Building* building, QString* error = 0, IoMonitor* monitor = 0);
+
+private:
+    Q_DISABLE_COPY(ExportPipeline)
+
+    QList<ExportSink*> _sinks;
+    GeoReference _geo;
+};
+
+#endif // EXPORTPIPELINE_H
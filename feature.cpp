@@ -0,0 +1,98 @@
+#include "diagrammodels.h"
+
+#include <QtMath>
+#include <algorithm>
+
+using namespace DiagramModels;
+
+void Feature::bounds(QPolygon bounds){
+    if(bounds == _bounds) return;
+    _bounds = bounds;
+    _geometryValid = false;
+    if(_floor) _floor->featureChanged(this);
+}
+
+void Feature::type(FeatureType type){
+    _type = type;
+    if(_floor) _floor->featureEdited(this,EDIT_TYPE);
+}
+
+void Feature::name(QString name){
+    _name = name;
+    if(_floor) _floor->featureEdited(this,EDIT_NAME);
+}
+
+void Feature::addConnection(int floor_index, int feature_index){
+    FeatureConnection con = {floor_index,feature_index};
+    _connections << con;
+    if(_floor) _floor->connectionAdded(this,con);
+}
+
+void Feature::connections(QSet<FeatureConnection> connections){
+    _connections = connections;
+    if(_floor) _floor->featureEdited(this,EDIT_CONNECTIONS);
+}
+
+/*!
+ * \brief interiorPoint find a point inside a polygon to place a label on
+ * Takes the widest span of the horizontal line through the middle of the bounding box.
+ * \param polygon
+ * \param rect the bounding rectangle of polygon
+ * \return the middle of the widest span, or the center of rect if there is none
+ */
+static QPoint interiorPoint(const QPolygon& polygon, const QRect& rect){
+    double y = rect.top() + rect.height() / 2.0;
+    QVector<double> crossings;
+    for(int i = 0; i < polygon.size(); i++){
+        QPoint a = polygon[i], b = polygon[(i + 1) % polygon.size()];
+        if((a.y() <= y) == (b.y() <= y)) continue;
+        crossings << a.x() + (y - a.y()) * (b.x() - a.x()) / double(b.y() - a.y());
+    }
+    std::sort(crossings.begin(),crossings.end());
+    double bestWidth = -1, bestX = rect.center().x();
+    for(int i = 0; i + 1 < crossings.size(); i += 2){
+        if(crossings[i+1] - crossings[i] > bestWidth){
+            bestWidth = crossings[i+1] - crossings[i];
+            bestX = (crossings[i] + crossings[i+1]) / 2;
+        }
+    }
+    return QPoint(qRound(bestX),qRound(y));
+}
+
+void Feature::buildGeometry() const{
+    TRACE_COUNT(tracePaint,"geometry cache misses",1);
+    FeatureGeometry& g = _geometry;
+    g.boundingRect = _bounds.boundingRect();
+    g.path = QPainterPath();
+    g.path.setFillRule(Qt::OddEvenFill);
+    g.path.addPolygon(QPolygonF(_bounds));
+    g.path.closeSubpath();
+
+    // shoelace formula for the area and centroid
+    double signedArea = 0, cx = 0, cy = 0;
+    uint hash = uint(_bounds.size());
+    for(int i = 0; i < _bounds.size(); i++){
+        const QPoint& p1 = _bounds[i];
+        const QPoint& p2 = _bounds[(i + 1) % _bounds.size()];
+        double partial = double(p1.x()) * p2.y() - double(p2.x()) * p1.y();
+        signedArea += partial;
+        cx += (p1.x() + p2.x()) * partial;
+        cy += (p1.y() + p2.y()) * partial;
+        hash ^= ::qHash((quint64(quint32(p1.x())) << 32) | quint32(p1.y())) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+    signedArea /= 2;
+    g.area = qAbs(signedArea);
+    if(qFuzzyIsNull(signedArea)){
+        g.centroid = g.boundingRect.center();
+    }else{
+        g.centroid = QPoint(qRound(cx / (6 * signedArea)),qRound(cy / (6 * signedArea)));
+    }
+    g.vertexHash = hash;
+
+    if(_bounds.size() < 3 || _bounds.containsPoint(g.centroid,Qt::OddEvenFill)){
+        g.labelPosition = g.centroid;
+    }else{
+        g.labelPosition = interiorPoint(_bounds,g.boundingRect);
+    }
+    _geometryValid = true;
+}
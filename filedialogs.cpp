@@ -0,0 +1,46 @@
+#include "filedialogs.h"
+
+#include <QFileDialog>
+#include <QMessageBox>
+
+using namespace DiagramModels;
+
+QString FileDialogs::savePath(QWidget *context, Building *building, QString filepath, bool saveAs){
+    if(saveAs || filepath == ""){
+        return QFileDialog::getSaveFileName(context, "Save building file", building->name(),"building file (*.bldg);;JSON building file (*.json)");
+    }
+    return filepath;
+}
+
+QString FileDialogs::saveFile(QWidget* context, Building* building,QString filepath,bool saveAs){
+    QString nfilepath = savePath(context,building,filepath,saveAs);
+    if(nfilepath.isEmpty())
+        return filepath;
+    QString error;
+    if(!FileWriter::write(building,nfilepath,&error)){
+        QMessageBox::information(context,"Unable to save to file at " + nfilepath,error);
+        return QString();
+    }
+    return nfilepath;
+}
+
+void FileDialogs::exportFile(QWidget* context, Building* bldg, ExportFormat frmt){
+    QString name;
+    switch(frmt){
+    case OSM: name = "OSM"; break;
+    case SVG: name = "SVG"; break;
+    case PDF: name = "PDF"; break;
+    case GEOJSON: name = "GeoJSON"; break;
+    }
+    QString filter = QString("%1 Format (*.%2)").arg(name).arg(FileWriter::extensionFor(frmt));
+    QString filepath = QFileDialog::getSaveFileName(context,"Save " + name + " File",QString(),filter);
+    if(filepath.isEmpty())return;
+    QString error;
+    if(!FileWriter::exportTo(bldg,filepath,frmt,&error)){
+        QMessageBox::information(context,"Unable to export " + name + " file to " + filepath,error);
+    }
+}
+
+QString FileDialogs::tilesDirectory(QWidget* context){
+    return QFileDialog::getExistingDirectory(context,"Export map tiles to");
+}
@@ -0,0 +1,49 @@
+#ifndef FILEDIALOGS_H
+#define FILEDIALOGS_H
+
+#include <QString>
+#include <QWidget>
+
+#include "diagrammodels.h"
+#include "filewriter.h"
+
+/*!
+ * \brief The FileDialogs class asks the user where to save and export, and reports failures, around FileWriter
+ */
+class FileDialogs
+{
+public:
+    /*!
+     * \brief savePath ask where to save if the building has no file yet or for a "save as"
+     * \param context the calling QWidget
+     * \param filepath the current file, if any
+     * \param saveAs if this is a "save as" operation
+     * \return the file to save to, or an empty string if the user canceled
+     */
+    static QString savePath(QWidget* context, DiagramModels::Building* building, QString filepath = "", bool saveAs = false);
+
+    /*!
+     * \brief saveFile saves the data to a .bldg file, in the binary format unless the file name ends in .json
+     * \param context the calling QWidget
+     * \param filepath the path to the file
+     * \param saveAs if this is a "save as" operation
+     * \return the filepath used, the original if canceled, or an empty string if saving failed
+     */
+    static QString saveFile(QWidget* context, DiagramModels::Building* building, QString filepath = "", bool saveAs = false);
+
+    /*!
+     * \brief exportFile ask for a file and export the building to it
+     * \param context the calling QWidget
+     * \param frmt the desired format, default being Open Street Maps
+     */
+    static void exportFile(QWidget* context, DiagramModels::Building* building, ExportFormat frmt = OSM);
+
+    /*!
+     * \brief tilesDirectory ask for the directory to export map tiles to, see FileService::exportTiles
+     * \param context the calling QWidget
+     * \return the directory, or an empty string if the user canceled
+     */
+    static QString tilesDirectory(QWidget* context);
+};
+
+#endif // FILEDIALOGS_H
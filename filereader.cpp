@@ -1,6 +1,162 @@
 #include "filereader.h"
+#include "jsonstreamreader.h"
 
 FileReader::FileReader()
 {
 
 }
+
+namespace{
+    typedef JsonStreamReader JSR;
+
+    //! Read the {"floor": n, "feature": n} object the reader is positioned at
+    bool readConnection(JSR& reader, FeatureConnection* connection){
+        connection->floor_index = 0;
+        connection->feature_index = 0;
+        while(reader.readNext() == JSR::Name){
+            QString key = reader.string();
+            reader.readNext();
+            if(key == "floor" && reader.tokenType() == JSR::Number){
+                connection->floor_index = int(reader.number());
+            }else if(key == "feature" && reader.tokenType() == JSR::Number){
+                connection->feature_index = int(reader.number());
+            }else if(!reader.skipValue()){
+                return false;
+            }
+        }
+        return reader.tokenType() == JSR::EndObject;
+    }
+
+    //! Read the feature object the reader is positioned at into \param state
+    bool readFeature(JSR& reader, FeatureState* state){
+        QPolygon bounds;
+        QString type;
+        QString name;
+        bool hasName = false;
+        QSet<FeatureConnection> connections;
+        while(reader.readNext() == JSR::Name){
+            QString key = reader.string();
+            reader.readNext();
+            if(key == "bounds"){
+                if(reader.tokenType() != JSR::BeginArray){
+                    reader.raiseError("Feature bounds must be an array");
+                    return false;
+                }
+                double x = 0;
+                bool haveX = false;
+                while(reader.readNext() == JSR::Number){
+                    if(haveX) bounds << QPoint(int(x),int(reader.number()));
+                    else x = reader.number();
+                    haveX = !haveX;
+                }
+                if(reader.tokenType() != JSR::EndArray){
+                    reader.raiseError("Feature bounds must only contain numbers");
+                    return false;
+                }
+            }else if(key == "type" && reader.tokenType() == JSR::String){
+                type = reader.string();
+            }else if(key == "name" && reader.tokenType() == JSR::String){
+                name = reader.string();
+                hasName = true;
+            }else if(key == "connections" && reader.tokenType() == JSR::BeginArray){
+                while(reader.readNext() == JSR::BeginObject){
+                    FeatureConnection connection;
+                    if(!readConnection(reader,&connection)) return false;
+                    connections << connection;
+                }
+                if(reader.tokenType() != JSR::EndArray){
+                    reader.raiseError("Feature connections must be an array of objects");
+                    return false;
+                }
+            }else if(!reader.skipValue()){
+                return false;
+            }
+        }
+        if(reader.tokenType() != JSR::EndObject) return false;
+        state->type = type.toUpper() == "STAIRS" ? STAIRS : ROOM;
+        state->name = hasName ? name : type;
+        state->bounds = bounds;
+        state->connections = connections;
+        return true;
+    }
+
+    //! Read the floor object the reader is positioned at into \param floor, the features are built later
+    bool readFloor(JSR& reader, FloorState* floor, QIODevice* device, IoMonitor* monitor){
+        while(reader.readNext() == JSR::Name){
+            QString key = reader.string();
+            reader.readNext();
+            if(key == "name" && reader.tokenType() == JSR::String){
+                floor->name = reader.string();
+            }else if(key == "features"){
+                if(reader.tokenType() != JSR::BeginArray){
+                    reader.raiseError("Floor features must be an array");
+                    break;
+                }
+                while(reader.readNext() == JSR::BeginObject){
+                    FeatureState feature;
+                    TRACE_COUNT(traceLoad,"features read",1);
+                    if(!readFeature(reader,&feature)) break;
+                    floor->features << feature;
+                    if(monitor){
+                        if(monitor->isCancelled()){
+                            reader.raiseError("Loading cancelled");
+                            break;
+                        }
+                        monitor->progress(reader.offset(),device->size());
+                    }
+                }
+                if(reader.tokenType() != JSR::EndArray){
+                    reader.raiseError("Floor features must be an array of objects");
+                    break;
+                }
+            }else if(!reader.skipValue()){
+                break;
+            }
+        }
+        return !reader.hasError() && reader.tokenType() == JSR::EndObject;
+    }
+}
+
+Building* FileReader::readJson(QIODevice *device, QString *error, IoMonitor *monitor){
+    TRACE_SPAN(traceLoad,"readJson");
+    JSR reader(device);
+    if(monitor) monitor->stage("Reading");
+    QString name;
+    QVector<FloorState> floors;
+    if(reader.readNext() != JSR::BeginObject){
+        reader.raiseError("Expected a building object");
+    }
+    while(!reader.hasError() && reader.readNext() == JSR::Name){
+        QString key = reader.string();
+        reader.readNext();
+        if(key == "name" && reader.tokenType() == JSR::String){
+            name = reader.string();
+        }else if(key == "floors"){
+            if(reader.tokenType() != JSR::BeginArray){
+                reader.raiseError("Building floors must be an array");
+                break;
+            }
+            while(reader.readNext() == JSR::BeginObject){
+                FloorState floor;
+                if(!readFloor(reader,&floor,device,monitor)) break;
+                floors << floor;
+            }
+            if(reader.tokenType() != JSR::EndArray){
+                reader.raiseError("Building floors must be an array of objects");
+            }
+        }else{
+            reader.skipValue();
+        }
+    }
+    if(!reader.hasError() && reader.tokenType() == JSR::EndObject){
+        reader.readNext();
+    }
+    if(reader.tokenType() != JSR::EndDocument){
+        reader.raiseError("Expected the end of the building object");
+        if(error) *error = QString("%1 at byte %2").arg(reader.errorString()).arg(reader.errorOffset());
+        return NULL;
+    }
+    // parsing has to be in document order, building the floors and their indexes doesn't
+    if(monitor) monitor->stage("Building floors");
+    return new Building(name,floors);
+}
@@ -4,9 +4,14 @@
 #include <QString>
 #include <QFile>
 #include <QByteArray>
+#include <QIODevice>
 
 #include "diagrammodels.h"
 #include "filewriter.h"
+#include "binaryformat.h"
+#include "iomonitor.h"
+#include "editjournal.h"
+#include "tracing.h"
 
 using namespace DiagramModels;
 class FileReader
@@ -16,20 +21,51 @@ public:
 
     /*!
      * \brief loadBuidling loads a building given the filename
+     * The codec is picked from the header magic, binary files start with "BLDG", anything else is read as JSON.
+     * Edits saved to the file's journal are replayed on top, see EditJournal.
      * \param filename
-     * \return the constructed building
+     * \param error set to a description of the problem if loading fails
+     * \param lazy for binary files, read only the floor directory and load the floors in the background
+     * \param monitor reports progress through JSON files and cancels reading them
+     * \return the constructed building, or NULL if the file could not be read or loading was cancelled
      */
-    static Building* loadBuidling(QString filename){
+    static Building* loadBuidling(QString filename, QString* error = 0, bool lazy = true, IoMonitor* monitor = 0){
+        TRACE_SPAN(traceLoad,"loadBuilding");
         QFile file(filename);
         if(!file.open(QIODevice::ReadOnly)){
             qWarning("Failed to open file.");
+            if(error) *error = file.errorString();
             return 0;
         }
-        QByteArray data = file.readAll();
-        Building* building = new Building(QJsonDocument::fromJson(data));
+        Building* building;
+        if(BinaryFormat::isBinary(file.peek(4))){
+            if(lazy){
+                file.close();
+                building = BinaryFormat::open(filename,error);
+                if(building) building->loadInBackground();
+            }else{
+                building = BinaryFormat::decode(file.readAll(),error);
+            }
+        }else{
+            building = readJson(&file,error,monitor);
+        }
 
+        QString journalError;
+        if(building && !EditJournal::replay(building,filename,&journalError)){
+            qWarning("Journal for %s not fully applied: %s",qPrintable(filename),qPrintable(journalError));
+        }
         return building;
     };
+
+    /*!
+     * \brief readJson build a building from a JSON document in a single pass, without a DOM
+     * The document is parsed into feature values, then the floors are built from them in parallel.
+     * \param device an open device positioned at the start of the document
+     * \param error set to the problem and its byte offset if the document is malformed
+     * \param monitor reports the bytes read after every feature, reading stops early if it is cancelled
+     * \return the constructed building, or NULL if the document is malformed or reading was cancelled
+     */
+    static Building* readJson(QIODevice* device, QString* error = 0, IoMonitor* monitor = 0);
 };
 
 #endif // FILEREADER_H
@@ -0,0 +1,145 @@
+#include "fileservice.h"
+#include "filereader.h"
+#include "filewriter.h"
+
+#include <QFileInfo>
+#include <QtConcurrent/QtConcurrentRun>
+
+using namespace DiagramModels;
+
+/*!
+ * \brief The FileService::Job class is one load or save, run on a worker thread
+ * Progress is throttled to whole percent steps before it is signalled to the service's thread.
+ */
+class FileService::Job: public IoMonitor{
+public:
+    typedef enum{
+        LOAD,
+        SAVE,
+        EXPORT_TILES
+    }Kind;
+
+    Job(FileService* service, Kind kind, const QString& filename, Building* building = NULL,
+        const TileOptions& tiles = TileExporter::defaults()):
+        _service(service),_kind(kind),_filename(filename),_building(building),_tiles(tiles),_ok(false),_percent(-1){
+        TileStats none = {0,0,0};
+        _stats = none;
+    }
+    ~Job(){
+        delete _building;
+    }
+
+    //! Do the work, on the worker thread
+    void run(){
+        if(_kind == LOAD){
+            _building = FileReader::loadBuidling(_filename,&_error,true,this);
+            _ok = _building != NULL;
+            return;
+        }
+        if(_kind == SAVE){
+            _ok = FileWriter::write(_building,_filename,&_error,this);
+        }else{
+            _ok = TileExporter::exportTiles(_building,_filename,_tiles,&_error,this,&_stats);
+        }
+        delete _building; // the snapshot is no longer needed
+        _building = NULL;
+    }
+
+    void stage(const QString &name) override{
+        _stage = name;
+        _percent = -1;
+        progress(0,1);
+    }
+    void progress(qint64 done, qint64 total) override{
+        int percent = total > 0 ? int(qBound(qint64(0),done * 100 / total,qint64(100))) : 0;
+        if(percent == _percent) return;
+        _percent = percent;
+        emit _service->progress(_stage,percent);
+    }
+
+    Kind kind() const{return _kind;}
+    const QString& filename() const{return _filename;}
+    bool ok() const{return _ok;}
+    const QString& error() const{return _error;}
+    const TileStats& stats() const{return _stats;}
+    //! Hand the loaded building to the caller
+    Building* takeBuilding(){
+        Building* building = _building;
+        _building = NULL;
+        return building;
+    }
+
+private:
+    FileService* _service;
+    Kind _kind;
+    QString _filename;
+    Building* _building; //! The snapshot being saved or exported, or the building that was loaded
+    TileOptions _tiles; //! What to render, for EXPORT_TILES
+    TileStats _stats; //! What the tile export did
+    bool _ok;
+    QString _error;
+    QString _stage; //! Only touched by the worker
+    int _percent; //! The last percentage signalled, only touched by the worker
+};
+
+FileService::FileService(QObject *parent):QObject(parent),_job(NULL){
+    connect(&_watcher,SIGNAL(finished()),this,SLOT(jobFinished()));
+}
+
+FileService::~FileService(){
+    if(_job){
+        _job->cancel();
+        _watcher.waitForFinished();
+        delete _job;
+    }
+}
+
+bool FileService::load(const QString &filename){
+    if(isBusy()) return false;
+    start(new Job(this,Job::LOAD,filename),"Opening " + QFileInfo(filename).fileName());
+    return true;
+}
+
+bool FileService::save(Building *building, const QString &filename){
+    if(isBusy()) return false;
+    start(new Job(this,Job::SAVE,filename,building->snapshot()),"Saving " + QFileInfo(filename).fileName());
+    return true;
+}
+
+bool FileService::exportTiles(Building *building, const QString &directory, const TileOptions &options){
+    if(isBusy()) return false;
+    start(new Job(this,Job::EXPORT_TILES,directory,building->snapshot(),options),
+          "Exporting tiles to " + QFileInfo(directory).fileName());
+    return true;
+}
+
+void FileService::cancel(){
+    if(_job) _job->cancel();
+}
+
+void FileService::start(Job *job, const QString &description){
+    _job = job;
+    emit started(description);
+    _watcher.setFuture(QtConcurrent::run([job](){
+        job->run();
+    }));
+}
+
+void FileService::jobFinished(){
+    Job* job = _job;
+    _job = NULL;
+    if(!job) return;
+    if(job->kind() == Job::SAVE && job->ok()){
+        // a cancel that arrived after the commit is too late, the file was written
+        emit saved(job->filename());
+    }else if(job->kind() == Job::EXPORT_TILES && job->ok()){
+        emit tilesExported(job->filename(),job->stats().rendered);
+    }else if(job->isCancelled()){
+        emit cancelled(job->filename());
+    }else if(!job->ok()){
+        emit failed(job->filename(),job->error());
+    }else{
+        emit loaded(job->takeBuilding(),job->filename());
+    }
+    delete job;
+}
@@ -0,0 +1,85 @@
+#ifndef FILESERVICE_H
+#define FILESERVICE_H
+
+#include <QObject>
+#include <QString>
+#include <QFutureWatcher>
+
+#include "diagrammodels.h"
+#include "iomonitor.h"
+#include "tileexporter.h"
+
+/*!
+ * \brief The FileService class loads, saves and exports buildings on a worker thread
+ * One operation runs at a time. Progress and the result are reported through signals on the
+ * thread that owns the service, so the GUI stays responsive while large files are parsed or written.
+ */
+class FileService : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FileService(QObject* parent = 0);
+    //! Cancels the running operation and waits for it to stop
+    ~FileService();
+
+    //! If an operation is running
+    bool isBusy() const{return _job != NULL;}
+
+    /*!
+     * \brief load read a building file in the background, see FileReader::loadBuidling
+     * \param filename
+     * \return false if another operation is already running
+     */
+    bool load(const QString& filename);
+    /*!
+     * \brief save write a building file in the background, see FileWriter::write
+     * A snapshot of the building is taken before returning, later edits don't affect the file.
+     * \param building
+     * \param filename
+     * \return false if another operation is already running
+     */
+    bool save(DiagramModels::Building* building, const QString& filename);
+    /*!
+     * \brief exportTiles render map tiles in the background, see TileExporter::exportTiles
+     * A snapshot of the building is taken before returning, later edits don't affect the tiles.
+     * \param building
+     * \param directory
+     * \param options
+     * \return false if another operation is already running
+     */
+    bool exportTiles(DiagramModels::Building* building, const QString& directory, const TileOptions& options);
+
+public slots:
+    //! Stop the running operation, cancelled() is emitted once it has stopped
+    void cancel();
+
+signals:
+    //! An operation has started, \param description says what it is doing (e.g. "Saving plan.bldg")
+    void started(QString description);
+    //! The running operation is \param percent through \param stage
+    void progress(QString stage, int percent);
+    //! \param building was read from \param filename, the receiver takes ownership
+    void loaded(DiagramModels::Building* building, QString filename);
+    //! The building was written to \param filename
+    void saved(QString filename);
+    //! The tiles were written to \param directory, \param rendered of them drawn
+    void tilesExported(QString directory, int rendered);
+    //! Reading or writing \param filename failed with \param error
+    void failed(QString filename, QString error);
+    //! The operation on \param filename was cancelled, nothing was loaded or written
+    void cancelled(QString filename);
+
+private slots:
+    //! The worker has finished, report the result
+    void jobFinished();
+
+private:
+    class Job;
+    //! Run \param job on the global thread pool
+    void start(Job* job, const QString& description);
+
+    Job* _job; //! The running operation, or NULL
+    QFutureWatcher<void> _watcher; //! Signals when _job finishes
+};
+
+#endif // FILESERVICE_H
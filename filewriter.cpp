@@ -1,9 +1,12 @@
 #include "filewriter.h"
+#include "binaryformat.h"
+#include "osmexporter.h"
+#include "exportpipeline.h"
+#include "tracing.h"
 
-#include <QFileDialog>
 #include <QFile>
+#include <QSaveFile>
 #include <QIODevice>
-#include <QMessageBox>
 #include <QJsonDocument>
 #include <QJsonObject>
 //#include <QDataStream>
@@ -13,30 +16,120 @@ FileWriter::FileWriter()
 }
 
 using namespace DiagramModels;
-QString FileWriter::saveFile(QWidget* context, Building* building,QString filepath,bool saveAs){
-    if(saveAs || filepath == ""){
-        QString nfilepath = QFileDialog::getSaveFileName(context, "Save building file", building->name(),"building file (*.bldg)");
-        if(nfilepath.isEmpty())
-            return filepath;
-        filepath = nfilepath;
-    }
+//! Written in blocks of this size so progress and cancellation stay responsive
+static const qint64 WRITE_BLOCK_SIZE = 1024 * 1024;
+
+BuildingFormat FileWriter::formatFor(const QString &filepath){
+    if(filepath.endsWith(".json",Qt::CaseInsensitive)) return BLDG_JSON;
     QFile file(filepath);
+    if(file.open(QIODevice::ReadOnly) && file.size() > 0){
+        return BinaryFormat::isBinary(file.peek(4)) ? BLDG_BINARY : BLDG_JSON;
+    }
+    return BLDG_BINARY;
+}
+
+bool FileWriter::write(Building *building, const QString &filepath, QString *error, IoMonitor *monitor){
+    return write(building,filepath,formatFor(filepath),error,monitor);
+}
+
+bool FileWriter::write(Building *building, const QString &filepath, BuildingFormat format, QString *error, IoMonitor *monitor){
+    TRACE_SPAN(traceSave,"write");
+    QString loadError;
+    if(building->loadFailed(&loadError)){
+        // the floor would be written out empty, losing whatever the file still has of it
+        if(error) *error = loadError + ", not saving over it";
+        return false;
+    }
+    if(monitor) monitor->stage("Encoding");
+    QByteArray data = encode(building,format,monitor);
+    if(monitor && monitor->isCancelled()){
+        if(error) *error = "Saving cancelled";
+        return false;
+    }
+    return write(data,filepath,error,monitor);
+}
+
+bool FileWriter::write(const QByteArray &data, const QString &filepath, QString *error, IoMonitor *monitor){
+    QSaveFile file(filepath);
     if(!file.open(QIODevice::WriteOnly)){
-        QMessageBox::information(context,"Unable to save to file at " + filepath,file.errorString());
-        return QString();
+        if(error) *error = file.errorString();
+        return false;
     }
+    if(monitor) monitor->stage("Writing");
+    for(qint64 written = 0; written < data.size();){
+        if(monitor && monitor->isCancelled()){
+            file.cancelWriting();
+            if(error) *error = "Saving cancelled";
+            return false;
+        }
+        qint64 n = file.write(data.constData() + written,qMin(WRITE_BLOCK_SIZE,data.size() - written));
+        if(n < 0) break;
+        written += n;
+        if(monitor) monitor->progress(written,data.size());
+    }
+    // a building opened from this file may still be decoding floors from a mapping of it
+    BinaryFormat::release(filepath);
+    // commit() renames over the old file only if every write succeeded
+    if(!file.commit()){
+        if(error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+QByteArray FileWriter::encode(Building *building, BuildingFormat format, IoMonitor *monitor){
+    if(format == BLDG_BINARY){
+        return BinaryFormat::encode(building,monitor);
+    }
+    if(monitor && monitor->isCancelled()) return QByteArray();
+    TRACE_SPAN(traceSave,"encodeJson");
     QJsonDocument doc(building->toJson());
-    file.write(doc.toJson());
-    file.close();
-    return filepath;
+    if(monitor) monitor->progress(1,1);
+    return doc.toJson();
 }
 
-void FileWriter::exportFile(QWidget* context, Building* bldg, ExportFormat frmt){
-    QString filepath = QFileDialog::getSaveFileName(context,"Save OSM File",QString(),"OSM Format (*.xml)");
-    if(filepath.isEmpty())return;
-    QFile file(filepath);
-    if(!file.open(QIODevice::WriteOnly)){
-        QMessageBox::information(context,"Unable to export OSM file to " + filepath,file.errorString());
+QString FileWriter::extensionFor(ExportFormat format){
+    switch(format){
+    case OSM: return "xml";
+    case SVG: return "svg";
+    case PDF: return "pdf";
+    case GEOJSON: return "geojson";
     }
+    return QString();
+}
+
+bool FileWriter::exportTo(Building *building, const QString &filepath, ExportFormat format, QString *error, IoMonitor *monitor){
+    return exportTo(building,filepath,format,GeoReference(),error,monitor);
+}
 
+bool FileWriter::exportTo(Building *building, const QString &filepath, ExportFormat format, const GeoReference &geo,
+                          QString *error, IoMonitor *monitor){
+    if(ExportPipeline::supports(format)){
+        if(monitor) monitor->stage("Exporting");
+        ExportPipeline pipeline;
+        pipeline.setGeoReference(geo);
+        pipeline.addSink(format,filepath);
+        return pipeline.run(building,error,monitor);
+    }
+    QSaveFile file(filepath);
+    if(!file.open(QIODevice::WriteOnly)){
+        if(error) *error = file.errorString();
+        return false;
+    }
+    if(monitor) monitor->stage("Exporting");
+    bool written = false;
+    if(format == OSM){
+        OsmExporter exporter;
+        exporter.setGeoReference(geo);
+        written = exporter.write(building,&file,error,monitor);
+    }
+    if(!written){
+        file.cancelWriting();
+        return false;
+    }
+    if(!file.commit()){
+        if(error) *error = file.errorString();
+        return false;
+    }
+    return true;
 }
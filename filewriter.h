@@ -3,38 +3,85 @@
 
 #include <QString>
 #include "diagrammodels.h"
+#include "georeference.h"
+#include "iomonitor.h"
 
 
+//! The formats a building can be exported to, see ExportPipeline and OsmExporter
 typedef enum{
-    OSM          // Open Street Maps Export
+    OSM,         // Open Street Maps Export
+    SVG,         // every floor in one drawing
+    PDF,         // a page per floor, for printing
+    GEOJSON      // polygons in longitude and latitude, for GIS tools
 }ExportFormat;
 
+//! The formats a building file can be saved in
+typedef enum{
+    BLDG_BINARY,    // compact binary container, see BinaryFormat
+    BLDG_JSON       // the original JSON document
+}BuildingFormat;
+
+/*!
+ * \brief The FileWriter class saves and exports buildings without any UI, see FileDialogs for the dialogs around it
+ */
 class FileWriter
 {
 public:
     /*!
-     * \brief instance
-     * \return the instance of the FileWriter to be used
+     * \brief formatFor pick the format to save a file in
+     * .json files are JSON. A file that already exists keeps the format it is in, so a JSON .bldg file
+     * isn't turned into a binary one by saving over it; new files of any other extension are binary.
+     * \param filepath
+     * \return the format to save filepath in
+     */
+    static BuildingFormat formatFor(const QString& filepath);
+
+    /*!
+     * \brief encode serialise a building
+     * \param building
+     * \param format
+     * \param monitor reports encoding progress, encoding stops early if it is cancelled
+     * \return the file contents, or an empty array if cancelled
      */
-    static FileWriter* instance(){
-        static FileWriter *writer = new FileWriter();
-        return writer;
-    }
+    static QByteArray encode(DiagramModels::Building* building, BuildingFormat format, IoMonitor* monitor = 0);
 
     /*!
-     * \brief saveFile saves the data to a .bldg file in JSON format
-     * \param context the calling QWidget
-     * \param filepath the path to the file
-     * \param saveAs if this is a "save as" operation
-     * \return the filepath used, or the original if canceled
+     * \brief write encode a building and write it to a file
+     * The file is written through QSaveFile, so it is only replaced once every byte is on disk;
+     * a failed or cancelled write leaves the previous file untouched. Buildings with a floor that failed
+     * to load aren't written, see Building::loadFailed(). Buildings still decoding floors from the file being
+     * replaced are given a copy of it first, see BinaryFormat::release().
+     * \param building
+     * \param filepath the file to write, in the format picked by formatFor()
+     * \param error set to a description of the problem if writing fails
+     * \param monitor reports encoding and writing progress, and cancels the write
+     * \return false if the file wasn't written
      */
-    QString saveFile(QWidget* context, DiagramModels::Building*, QString filepath = "", bool saveAs = false);
+    static bool write(DiagramModels::Building* building, const QString& filepath, QString* error = 0, IoMonitor* monitor = 0);
+    //! write() in \param format, whatever the file is now
+    static bool write(DiagramModels::Building* building, const QString& filepath, BuildingFormat format,
+                      QString* error = 0, IoMonitor* monitor = 0);
+    //! write() the already encoded \param data, e.g. from encode()
+    static bool write(const QByteArray& data, const QString& filepath, QString* error = 0, IoMonitor* monitor = 0);
+
     /*!
-     * \brief exportFile export the file to the desired format
-     * \param context the calling QWidget
-     * \param frmt the desired format, default being Open Street Maps
+     * \brief exportTo write a building in an export format
+     * Written through QSaveFile like write(), a failed export leaves any previous file untouched.
+     * To write several formats in one pass over the building, use ExportPipeline directly.
+     * \param building
+     * \param filepath
+     * \param format
+     * \param error set to a description of the problem if exporting fails
+     * \param monitor reports progress and cancels the export
+     * \return false if the file wasn't written
      */
-    void exportFile(QWidget* context, DiagramModels::Building*, ExportFormat frmt = OSM);
+    static bool exportTo(DiagramModels::Building* building, const QString& filepath, ExportFormat format,
+                         QString* error = 0, IoMonitor* monitor = 0);
+    //! exportTo() with the building placed on the globe by \param geo, for OSM and GeoJSON
+    static bool exportTo(DiagramModels::Building* building, const QString& filepath, ExportFormat format,
+                         const GeoReference& geo, QString* error = 0, IoMonitor* monitor = 0);
+    //! The file extension, without the dot, of \param format
+    static QString extensionFor(ExportFormat format);
 
 protected:
     FileWriter();
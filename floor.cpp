@@ -0,0 +1,89 @@
+#include "diagrammodels.h"
+#include "tracing.h"
+
+#include <QDebug>
+
+using namespace DiagramModels;
+
+void Floor::load(){
+    QMutexLocker lock(&_loadMutex);
+    if(_loaded.loadAcquire()) return; // another thread finished loading while we waited
+    QList<Feature*> features;
+    QString error;
+    // the loaded floor is where edits are counted from, so building it doesn't look like an edit
+    quint64 revision = _revision;
+    if(_loader->load(this,&features,&error)){
+        for(Feature* feature : features) insertFeature(feature);
+    }else{
+        // left empty and marked failed rather than passed off as a floor with no features
+        qWarning() << "Failed to load floor" << _name << ":" << error;
+        qDeleteAll(features);
+        _loadError = error.isEmpty() ? QString("Unreadable floor data") : error;
+    }
+    _revision = revision;
+    _loader.clear();
+    _loaded.storeRelease(1);
+}
+
+void Floor::addFeature(Feature *feature){
+    ensureLoaded();
+    insertFeature(feature);
+    if(_listener) _listener->featureAdded(this,feature);
+}
+
+void Floor::insertFeature(Feature *feature){
+    _features << feature;
+    _index.insert(feature,feature->boundingRect());
+    _snapIndex.insert(feature,feature->bounds());
+    _revision++;
+}
+
+void Floor::removeFeature(int index){
+    ensureLoaded();
+    if(index < 0 || index >= _features.size()) return;
+    if(_listener) _listener->featureRemoved(this,index);
+    Feature* f = _features.takeAt(index);
+    _index.remove(f);
+    _snapIndex.remove(f);
+    _revision++;
+}
+
+void Floor::removeFeature(Feature *f){
+    ensureLoaded();
+    removeFeature(_features.indexOf(f));
+}
+
+void Floor::featureChanged(Feature *feature){
+    _index.update(feature,feature->boundingRect());
+    _snapIndex.update(feature,feature->bounds());
+    _revision++;
+    if(_listener && isLoaded()) _listener->featureEdited(this,feature,EDIT_BOUNDS);
+}
+
+QList<Feature*> Floor::featuresAt(const QPoint &point){
+    ensureLoaded();
+    TRACE_SPAN(traceHitTest,"featuresAt");
+    QList<Feature*> re;
+    QList<Feature*> candidates = _index.query(point);
+    TRACE_COUNT(traceHitTest,"hit-test candidates",candidates.size());
+    for(Feature* f : candidates){
+        if(f->contains(point)) re << f;
+    }
+    return re;
+}
+
+Feature* Floor::featureAt(const QPoint &point){
+    ensureLoaded();
+    TRACE_SPAN(traceHitTest,"featureAt");
+    QList<Feature*> candidates = _index.query(point);
+    TRACE_COUNT(traceHitTest,"hit-test candidates",candidates.size());
+    for(int i = candidates.size() - 1; i >= 0; i--){
+        if(candidates[i]->contains(point)) return candidates[i];
+    }
+    return NULL;
+}
+
+QList<Feature*> Floor::featuresIn(const QRect &rect){
+    ensureLoaded();
+    return _index.query(rect);
+}
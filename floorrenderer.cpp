@@ -0,0 +1,55 @@
+#include "floorrenderer.h"
+#include "tracing.h"
+
+#include <QSet>
+#include <QPair>
+#include <QtMath>
+
+void FloorRenderer::drawFeature(QPainter &painter, Feature *feature, const QBrush &brush){
+    painter.setBrush(brush);
+    painter.drawPath(feature->path());
+    painter.drawText(feature->labelPosition(),feature->name());
+}
+
+void FloorRenderer::drawFloor(QPainter &painter, Floor *floor, const QRect& visible, Feature* exclude){
+    QTransform transform = painter.worldTransform();
+    qreal scale = qSqrt(qAbs(transform.determinant()));
+    TRACE_SPAN(tracePaint,"drawFloor");
+    QList<Feature*> features = visible.isNull() ? floor->features() : floor->featuresIn(visible);
+    TRACE_COUNT(tracePaint,"features culled",floor->featureCount() - features.size());
+    QSet<QPair<int,int> > tinyCells; // device cells holding at least one feature too small to draw
+    for(Feature* feature : features){
+        if(feature == exclude) continue;
+        QRect rect = feature->boundingRect();
+        qreal size = qMax(rect.width(),rect.height()) * scale;
+        if(size < TINY_FEATURE_SIZE){
+            QPointF p = transform.map(QPointF(rect.center()));
+            tinyCells << qMakePair(qFloor(p.x() / AGGREGATE_CELL_SIZE),qFloor(p.y() / AGGREGATE_CELL_SIZE));
+            TRACE_COUNT(tracePaint,"features aggregated",1);
+            continue;
+        }
+        painter.setBrush(featureBrush(feature));
+        if(size < SIMPLIFY_FEATURE_SIZE){
+            painter.drawRect(rect);
+            TRACE_COUNT(tracePaint,"features simplified",1);
+            TRACE_COUNT(tracePaint,"vertices drawn",4);
+            continue;
+        }
+        painter.drawPath(feature->path());
+        TRACE_COUNT(tracePaint,"features drawn",1);
+        TRACE_COUNT(tracePaint,"vertices drawn",feature->bounds().size());
+        if(rect.width() * scale >= LABEL_MIN_WIDTH && rect.height() * scale >= LABEL_MIN_HEIGHT){
+            painter.drawText(feature->labelPosition(),feature->name());
+        }
+    }
+    if(!tinyCells.isEmpty()){
+        painter.save();
+        painter.resetTransform();
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(Qt::darkGray);
+        for(const QPair<int,int>& cell : tinyCells){
+            painter.drawRect(cell.first * AGGREGATE_CELL_SIZE,cell.second * AGGREGATE_CELL_SIZE,AGGREGATE_CELL_SIZE,AGGREGATE_CELL_SIZE);
+        }
+        painter.restore();
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef FLOORRENDERER_H
+#define FLOORRENDERER_H
+
+#include <QPainter>
+#include <QBrush>
+#include <QPen>
+
+#include "diagrammodels.h"
+
+using namespace DiagramModels;
+
+/*!
+ * \brief The FloorRenderer class draws floors and features
+ * Shared by the cached floor layer and the overlay in RenderArea, so both look the same
+ */
+class FloorRenderer
+{
+public:
+    /*!
+     * \brief featureBrush the fill for a feature that is not hovered or selected
+     * \param feature
+     * \return yellow for connected features, light gray otherwise
+     */
+    static QBrush featureBrush(Feature* feature){
+        if(feature->connections().size() > 0) return QBrush(Qt::yellow);
+        return QBrush(Qt::lightGray);
+    }
+
+    //! The pen features are outlined with, one pixel wide at any zoom
+    static QPen outlinePen(){
+        QPen re(Qt::black);
+        re.setWidth(1);
+        re.setCosmetic(true);
+        return re;
+    }
+
+    /*!
+     * \brief drawFeature draw the outline, fill and name of a feature
+     * \param painter a painter with the outline pen set
+     * \param feature
+     * \param brush the fill
+     */
+    static void drawFeature(QPainter& painter, Feature* feature, const QBrush& brush);
+
+    /*!
+     * \brief drawFloor draw the features on a floor in floor order, with level of detail for the painter's scale
+     * Features smaller than TINY_FEATURE_SIZE pixels are merged into a coarse dot grid,
+     * features smaller than SIMPLIFY_FEATURE_SIZE are drawn as their bounding box, and
+     * names are only drawn on features at least LABEL_MIN_WIDTH by LABEL_MIN_HEIGHT pixels.
+     * \param painter a painter with the outline pen and the floor to device transform set
+     * \param floor
+     * \param visible the area to draw in floor coordinates, features outside it are culled; a null rect draws everything
+     * \param exclude a feature to leave out, e.g. one that is being dragged and drawn separately
+     */
+    static void drawFloor(QPainter& painter, Floor* floor, const QRect& visible = QRect(), Feature* exclude = NULL);
+
+    //! Level of detail thresholds, in device pixels
+    enum{
+        TINY_FEATURE_SIZE = 3,
+        SIMPLIFY_FEATURE_SIZE = 12,
+        LABEL_MIN_WIDTH = 40,
+        LABEL_MIN_HEIGHT = 14,
+        AGGREGATE_CELL_SIZE = 4
+    };
+};
+
+#endif // FLOORRENDERER_H
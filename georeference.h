@@ -0,0 +1,30 @@
+#ifndef GEOREFERENCE_H
+#define GEOREFERENCE_H
+
+#include <QPoint>
+#include <QPointF>
+#include <QtMath>
+
+/*!
+ * \brief The GeoReference struct places floor coordinates on the globe, for the geographic export formats
+ * A flat projection around the origin, fine at building scale. Floor y grows down the plan, latitude grows north.
+ */
+struct GeoReference{
+    double originLat;       // latitude of floor coordinate (0, 0)
+    double originLon;       // longitude of floor coordinate (0, 0)
+    double metresPerUnit;   // the length of one floor unit
+
+    GeoReference():originLat(0),originLon(0),metresPerUnit(0.1){}
+
+    //! Metres per degree of latitude, and of longitude at the equator
+    static constexpr double METRES_PER_DEGREE = 111320.0;
+
+    double latitude(const QPoint& point) const{
+        return originLat - point.y() * metresPerUnit / METRES_PER_DEGREE;
+    }
+    double longitude(const QPoint& point) const{
+        return originLon + point.x() * metresPerUnit / (METRES_PER_DEGREE * qCos(qDegreesToRadians(originLat)));
+    }
+};
+
+#endif // GEOREFERENCE_H
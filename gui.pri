@@ -0,0 +1,21 @@
+# The editor's windows and dialogs on top of core.pri, everything but main(); needs QtWidgets.
+# Included by the editor and by benchmarks/, which paints through RenderArea.
+
+include(core.pri)
+
+SOURCES += \
+    $$PWD/mainwindow.cpp \
+    $$PWD/renderarea.cpp \
+    $$PWD/filedialogs.cpp
+
+HEADERS += \
+    $$PWD/mainwindow.h \
+    $$PWD/propertymanager.h \
+    $$PWD/renderarea.h \
+    $$PWD/filedialogs.h
+
+FORMS += \
+    $$PWD/mainwindow.ui
+
+RESOURCES += \
+    $$PWD/resources.qrc
@@ -0,0 +1,36 @@
+#ifndef IOMONITOR_H
+#define IOMONITOR_H
+
+#include <QAtomicInt>
+#include <QString>
+
+/*!
+ * \brief The IoMonitor class lets a long read or write report progress and be cancelled from another thread
+ * Readers and writers take an optional monitor, check isCancelled() between floors or blocks and
+ * give up as soon as it is set.
+ */
+class IoMonitor
+{
+public:
+    IoMonitor():_cancelled(0){}
+    virtual ~IoMonitor(){}
+
+    //! Ask the operation to stop at its next check, safe to call from any thread
+    void cancel(){_cancelled.storeRelease(1);}
+    //! If cancel() has been called
+    bool isCancelled() const{return _cancelled.loadAcquire();}
+
+    //! The operation has moved on to a new step (e.g. "Encoding", "Writing"), progress restarts from zero
+    virtual void stage(const QString& name){Q_UNUSED(name);}
+    /*!
+     * \brief progress called by the operation as it goes, on whichever thread runs it
+     * \param done the amount of the current stage that is complete
+     * \param total the size of the current stage, in the same units
+     */
+    virtual void progress(qint64 done, qint64 total){Q_UNUSED(done);Q_UNUSED(total);}
+
+private:
+    QAtomicInt _cancelled;
+};
+
+#endif // IOMONITOR_H
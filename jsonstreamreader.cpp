@@ -0,0 +1,237 @@
+#include "jsonstreamreader.h"
+
+static const int BLOCK_SIZE = 64 * 1024;
+
+JsonStreamReader::JsonStreamReader(QIODevice *device):_device(device),_pos(0),_bufferOffset(0),_state(ExpectValue),
+    _token(NoToken),_number(0),_bool(false),_errorOffset(-1){}
+
+bool JsonStreamReader::fill(){
+    _bufferOffset += _buffer.size();
+    _buffer = _device->read(BLOCK_SIZE);
+    _pos = 0;
+    return !_buffer.isEmpty();
+}
+
+int JsonStreamReader::peek(){
+    if(_pos >= _buffer.size() && !fill()) return -1;
+    return (unsigned char)_buffer[_pos];
+}
+
+int JsonStreamReader::get(){
+    int c = peek();
+    if(c >= 0) _pos++;
+    return c;
+}
+
+void JsonStreamReader::skipWhitespace(){
+    for(int c = peek(); c == ' ' || c == '\n' || c == '\r' || c == '\t'; c = peek()){
+        _pos++;
+    }
+}
+
+JsonStreamReader::TokenType JsonStreamReader::raiseError(const QString &message){
+    if(_token == Invalid) return _token;
+    _error = message;
+    _errorOffset = offset();
+    _token = Invalid;
+    return _token;
+}
+
+void JsonStreamReader::valueDone(){
+    _state = _containers.isEmpty() ? ExpectEndDocument : ExpectCommaOrEnd;
+}
+
+JsonStreamReader::TokenType JsonStreamReader::readNext(){
+    if(_token == Invalid || _token == EndDocument) return _token;
+    skipWhitespace();
+    int c = peek();
+    switch(_state){
+    case ExpectEndDocument:
+        if(c >= 0) return raiseError(QString("Unexpected data after the end of the document"));
+        return _token = EndDocument;
+    case ExpectCommaOrEnd:
+        if(c == ','){
+            _pos++;
+            _state = _containers.last() == '{' ? ExpectName : ExpectValue;
+            return readNext();
+        }
+        if((c == '}' && _containers.last() == '{') || (c == ']' && _containers.last() == '[')){
+            _pos++;
+            _containers.removeLast();
+            valueDone();
+            return _token = (c == '}' ? EndObject : EndArray);
+        }
+        return raiseError(QString("Expected ',' or the end of the %1").arg(_containers.last() == '{' ? "object" : "array"));
+    case ExpectNameOrEnd:
+        if(c == '}'){
+            _pos++;
+            _containers.removeLast();
+            valueDone();
+            return _token = EndObject;
+        }
+        // fall through
+    case ExpectName:
+        if(c != '"') return raiseError(QString("Expected an object key"));
+        _pos++;
+        if(!readString()) return _token;
+        skipWhitespace();
+        if(get() != ':') return raiseError(QString("Expected ':' after object key"));
+        _state = ExpectValue;
+        return _token = Name;
+    case ExpectValueOrEnd:
+        if(c == ']'){
+            _pos++;
+            _containers.removeLast();
+            valueDone();
+            return _token = EndArray;
+        }
+        // fall through
+    case ExpectValue:
+        return readValue();
+    }
+    return raiseError(QString("Bad reader state"));
+}
+
+JsonStreamReader::TokenType JsonStreamReader::readValue(){
+    int c = peek();
+    switch(c){
+    case '{':
+        _pos++;
+        _containers << '{';
+        _state = ExpectNameOrEnd;
+        return _token = BeginObject;
+    case '[':
+        _pos++;
+        _containers << '[';
+        _state = ExpectValueOrEnd;
+        return _token = BeginArray;
+    case '"':
+        _pos++;
+        if(!readString()) return _token;
+        valueDone();
+        return _token = String;
+    case 't':
+        if(!readLiteral("true")) return _token;
+        _bool = true;
+        valueDone();
+        return _token = Bool;
+    case 'f':
+        if(!readLiteral("false")) return _token;
+        _bool = false;
+        valueDone();
+        return _token = Bool;
+    case 'n':
+        if(!readLiteral("null")) return _token;
+        valueDone();
+        return _token = Null;
+    case -1:
+        return raiseError(QString("Unexpected end of the document"));
+    default:
+        if(c == '-' || (c >= '0' && c <= '9')){
+            if(!readNumber()) return _token;
+            valueDone();
+            return _token = Number;
+        }
+        return raiseError(QString("Unexpected character '%1'").arg(QChar(c)));
+    }
+}
+
+bool JsonStreamReader::readLiteral(const char *literal){
+    for(const char* l = literal; *l; l++){
+        if(get() != *l){
+            raiseError(QString("Expected '%1'").arg(literal));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonStreamReader::readNumber(){
+    _scratch.clear();
+    for(int c = peek(); c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9'); c = peek()){
+        _scratch.append(char(c));
+        _pos++;
+    }
+    bool ok;
+    _number = _scratch.toDouble(&ok);
+    if(!ok){
+        raiseError(QString("Malformed number '%1'").arg(QString::fromLatin1(_scratch)));
+        return false;
+    }
+    return true;
+}
+
+static int hexValue(int c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool JsonStreamReader::readString(){
+    _scratch.clear();
+    for(;;){
+        int c = get();
+        if(c < 0){
+            raiseError(QString("Unterminated string"));
+            return false;
+        }
+        if(c == '"') break;
+        if(c < 0x20){
+            raiseError(QString("Control character in string"));
+            return false;
+        }
+        if(c != '\\'){
+            _scratch.append(char(c));
+            continue;
+        }
+        c = get();
+        switch(c){
+        case '"': case '\\': case '/': _scratch.append(char(c)); break;
+        case 'b': _scratch.append('\b'); break;
+        case 'f': _scratch.append('\f'); break;
+        case 'n': _scratch.append('\n'); break;
+        case 'r': _scratch.append('\r'); break;
+        case 't': _scratch.append('\t'); break;
+        case 'u':{
+            QString chars;
+            for(;;){
+                int code = 0;
+                for(int i = 0; i < 4; i++){
+                    int h = hexValue(get());
+                    if(h < 0){
+                        raiseError(QString("Malformed \\u escape"));
+                        return false;
+                    }
+                    code = code * 16 + h;
+                }
+                chars.append(QChar(code));
+                // a high surrogate is followed by the escaped low half
+                if(!QChar(code).isHighSurrogate() || peek() != '\\') break;
+                _pos++;
+                if(get() != 'u'){
+                    raiseError(QString("Unpaired surrogate in \\u escape"));
+                    return false;
+                }
+            }
+            _scratch.append(chars.toUtf8());
+            break;
+        }
+        default:
+            raiseError(QString("Unknown escape in string"));
+            return false;
+        }
+    }
+    _string = QString::fromUtf8(_scratch);
+    return true;
+}
+
+bool JsonStreamReader::skipValue(){
+    if(_token != BeginObject && _token != BeginArray) return !hasError();
+    int depth = _containers.size();
+    while(_containers.size() >= depth){
+        TokenType t = readNext();
+        if(t == Invalid || t == EndDocument) return false;
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+#ifndef JSONSTREAMREADER_H
+#define JSONSTREAMREADER_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+
+/*!
+ * \brief The JsonStreamReader class is a pull parser for JSON
+ * Reads the device in small blocks and hands out one token at a time, so a document
+ * can be turned into models without holding the whole file or a DOM in memory.
+ */
+class JsonStreamReader
+{
+public:
+    //! The kinds of token readNext() can return
+    typedef enum{
+        NoToken,
+        BeginObject,
+        EndObject,
+        BeginArray,
+        EndArray,
+        Name,       // an object key, see string()
+        String,     // see string()
+        Number,     // see number()
+        Bool,       // see boolean()
+        Null,
+        EndDocument,
+        Invalid     // see errorString() and errorOffset()
+    }TokenType;
+
+    /*!
+     * \brief JsonStreamReader constructor
+     * \param device an open device positioned at the start of the document
+     */
+    explicit JsonStreamReader(QIODevice* device);
+
+    //! Read the next token
+    TokenType readNext();
+    //! The last token read
+    TokenType tokenType() const{return _token;}
+    //! The text of the last Name or String token
+    const QString& string() const{return _string;}
+    //! The value of the last Number token
+    double number() const{return _number;}
+    //! The value of the last Bool token
+    bool boolean() const{return _bool;}
+
+    /*!
+     * \brief skipValue skip past the value starting at the last token
+     * Containers are skipped up to their matching end token, anything else is already complete.
+     * \return false if the document is malformed
+     */
+    bool skipValue();
+
+    //! If the document is malformed
+    bool hasError() const{return _token == Invalid;}
+    //! What was wrong with the document
+    QString errorString() const{return _error;}
+    //! The byte offset in the document where the problem was found
+    qint64 errorOffset() const{return _errorOffset;}
+    //! The byte offset of the next unread character
+    qint64 offset() const{return _bufferOffset + _pos;}
+
+    /*!
+     * \brief raiseError stop reading with a problem found by the caller, e.g. a value of the wrong type
+     * \param message
+     * \return Invalid
+     */
+    TokenType raiseError(const QString& message);
+
+private:
+    //! What may come next
+    typedef enum{
+        ExpectValue,
+        ExpectValueOrEnd,   // just after '['
+        ExpectName,         // just after ','
+        ExpectNameOrEnd,    // just after '{'
+        ExpectCommaOrEnd,   // after a value inside a container
+        ExpectEndDocument   // after the top level value
+    }State;
+
+    int peek();
+    int get();
+    bool fill();
+    void skipWhitespace();
+    TokenType readValue();
+    bool readString();
+    bool readNumber();
+    bool readLiteral(const char* literal);
+    //! The state after a value ends, depending on the enclosing container
+    void valueDone();
+
+private:
+    QIODevice* _device;
+    QByteArray _buffer; //! The current block of the document
+    int _pos; //! Read position in _buffer
+    qint64 _bufferOffset; //! The document offset of _buffer[0]
+    QVector<char> _containers; //! The open '{' and '[' characters
+    State _state;
+
+    TokenType _token;
+    QString _string;
+    QByteArray _scratch; //! Reused while decoding strings and numbers
+    double _number;
+    bool _bool;
+    QString _error;
+    qint64 _errorOffset;
+};
+
+#endif // JSONSTREAMREADER_H
@@ -1,11 +1,30 @@
 #include "mainwindow.h"
+#include "tracing.h"
 #include <QApplication>
+#include <QLoggingCategory>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);       
-    MainWindow w;
-    w.show();
-
-    return a.exec();
+    // build floors one at a time, makes loader problems reproducible under a debugger
+    if(qEnvironmentVariableIsSet("FLOORPLAN_SINGLE_THREADED_LOAD")){
+        DiagramModels::Building::setSingleThreadedLoading(true);
+    }
+    // record every trace category and write them out on exit, for builds with tracing compiled in
+    QString traceFile = QString::fromLocal8Bit(qgetenv("FLOORPLAN_TRACE_FILE"));
+    if(!traceFile.isEmpty()){
+        if(Tracing::compiledIn()) QLoggingCategory::setFilterRules("floorplan.*.debug=true");
+        else qWarning("FLOORPLAN_TRACE_FILE is ignored, tracing is not compiled in");
+    }
+    int re;
+    {
+        MainWindow w;
+        w.show();
+        re = a.exec();
+    }
+    QString error;
+    if(!traceFile.isEmpty() && Tracing::compiledIn() && !Tracing::writeChromeTrace(traceFile,&error)){
+        qWarning("Failed to write trace to %s: %s",qPrintable(traceFile),qPrintable(error));
+    }
+    return re;
 }
@@ -16,10 +16,16 @@
 #include <QStringList>
 #include <QProcess>
 #include <QInputDialog>
+#include <QMessageBox>
+#include <QStatusBar>
+#include <QTimer>
+#include <QMenu>
+#include <QMenuBar>
+#include <QItemSelectionModel>
 
 
 using namespace DiagramModels;
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),ui(new Ui::MainWindow){
+MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),ui(new Ui::MainWindow),building(NULL),journal(NULL){
     ui->setupUi(this);
 
     QGridLayout* renderLayout = new QGridLayout();
@@ -48,6 +54,67 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),ui(new Ui::MainWin
     connect(renderArea,SIGNAL(selectedFeatureChanged(Feature*)),this,SLOT(setSelectedItem(Feature*)));
     connect(ui->actionNew,SIGNAL(triggered(bool)),this,SLOT(newBuilding()));
     connect(renderArea,SIGNAL(openStairsDialog(Feature*,Floor*)),this,SLOT(openStairLinker(Feature*,Floor*)));
+
+    // Background loading and saving, progress is shown in the status bar
+    io = new FileService(this);
+    ioLabel = new QLabel(this);
+    ioProgressBar = new QProgressBar(this);
+    ioProgressBar->setMaximumWidth(200);
+    ioCancel = new QToolButton(this);
+    ioCancel->setText("Cancel");
+    statusBar()->addPermanentWidget(ioLabel);
+    statusBar()->addPermanentWidget(ioProgressBar);
+    statusBar()->addPermanentWidget(ioCancel);
+    ioDone();
+    connect(ioCancel,SIGNAL(clicked(bool)),io,SLOT(cancel()));
+    connect(io,SIGNAL(started(QString)),this,SLOT(ioStarted(QString)));
+    connect(io,SIGNAL(progress(QString,int)),this,SLOT(ioProgress(QString,int)));
+    connect(io,SIGNAL(loaded(DiagramModels::Building*,QString)),this,SLOT(buildingLoaded(DiagramModels::Building*,QString)));
+    connect(io,SIGNAL(saved(QString)),this,SLOT(buildingSaved(QString)));
+    connect(io,SIGNAL(tilesExported(QString,int)),this,SLOT(tilesExported(QString,int)));
+    connect(io,SIGNAL(failed(QString,QString)),this,SLOT(ioFailed(QString,QString)));
+    connect(io,SIGNAL(cancelled(QString)),this,SLOT(ioCancelled(QString)));
+    floorLoading = new QFutureWatcher<void>(this);
+    connect(floorLoading,SIGNAL(finished()),this,SLOT(floorsLoaded()));
+
+    journalAction = ui->menuFile->addAction("Journaled Saves");
+    journalAction->setCheckable(true);
+    journalAction->setChecked(true);
+    connect(journalAction,SIGNAL(toggled(bool)),this,SLOT(setJournaled(bool)));
+
+    QMenu* exportMenu = ui->menuFile->addMenu("Export");
+    connect(exportMenu->addAction("OpenStreetMap..."),SIGNAL(triggered(bool)),this,SLOT(exportToOSM()));
+    connect(exportMenu->addAction("SVG..."),SIGNAL(triggered(bool)),this,SLOT(exportToSVG()));
+    connect(exportMenu->addAction("PDF..."),SIGNAL(triggered(bool)),this,SLOT(exportToPDF()));
+    connect(exportMenu->addAction("GeoJSON..."),SIGNAL(triggered(bool)),this,SLOT(exportToGeoJSON()));
+    connect(exportMenu->addAction("Map Tiles..."),SIGNAL(triggered(bool)),this,SLOT(exportTiles()));
+
+    QAction* hudAction = menuBar()->addMenu("View")->addAction("Performance Overlay");
+    hudAction->setCheckable(true);
+    hudAction->setShortcut(Qt::Key_F12);
+    connect(hudAction,SIGNAL(toggled(bool)),renderArea,SLOT(setHudVisible(bool)));
+
+    autosaver = new Autosaver(this);
+    connect(autosaver,SIGNAL(failed(QString)),this,SLOT(autosaveFailed(QString)));
+    QTimer::singleShot(0,this,SLOT(offerRecovery()));
+}
+
+void MainWindow::offerRecovery(){
+    if(!Autosaver::hasRecovery()) return;
+    QString origin = Autosaver::recoveredFrom();
+    QString text = QString("%1 has changes from %2 that were never saved. Recover them?")
+            .arg(origin.isEmpty() ? QString("A new building") : QFileInfo(origin).fileName())
+            .arg(Autosaver::recoveryTime().toString());
+    if(QMessageBox::question(this,"Recover unsaved changes",text) != QMessageBox::Yes){
+        Autosaver::discard();
+        return;
+    }
+    recoveringAs = origin;
+    io->load(Autosaver::recoveryPath());
+}
+
+void MainWindow::autosaveFailed(QString error){
+    statusBar()->showMessage("Autosave failed: " + error,5000);
 }
 
 void MainWindow::newBuilding(){
@@ -76,11 +143,17 @@ void MainWindow::newBuilding(){
 
 
 
-    Building* bldg= FileReader::loadBuidling("file.txt");
-    building = new BuildingModel(bldg,this);
-    ui->building_list_view->setModel(building);
+    QString error;
+    Building* bldg= FileReader::loadBuidling("file.txt",&error);
+    if(bldg == NULL){
+        QMessageBox::warning(this,"Unable to read the scanned floorplans",error);
+        return;
+    }
+    setBuilding(bldg);
     qDebug() << "Loaded building: " << bldg->name();
     filepath = "";
+    resetJournal(filepath);
+    autosaver->setBuilding(bldg,filepath);
     setWindowTitle("--New Building--");
 
 
@@ -97,7 +170,6 @@ void MainWindow::openStairLinker(Feature *feature, Floor *floor){
     bool ok;
     QString floorName = QInputDialog::getItem(this,"Select floor to connect to","Floor:",floorNames,0,false,&ok);
     if(!ok || floorName.isEmpty())return;
-    qDebug() << floorName;
     Floor* ofloor;
     for(Floor* f: building->getModel()->floors()){
         if(f->name() == floorName){
@@ -123,18 +195,178 @@ void MainWindow::openStairLinker(Feature *feature, Floor *floor){
 }
 
 void MainWindow::openFile(){
-    QString path = QFileDialog::getOpenFileName(this,"Open building file","","Building files (*.bldg)");
+    QString path = QFileDialog::getOpenFileName(this,"Open building file","","Building files (*.bldg *.json)");
     if(!path.isNull() && !path.isEmpty()){
-        Building* bldg= FileReader::loadBuidling(path);
-        building = new BuildingModel(bldg,this);
-        ui->building_list_view->setModel(building);        
-        qDebug() << "Loaded building: " << bldg->name();
-        filepath = path;
-        QFileInfo f(filepath);
-        setWindowTitle(f.fileName());
+        io->load(path);
+    }
+}
+
+void MainWindow::saveFile(){
+    if(!building) return;
+    if(journal && journal->basePath() == filepath){
+        QString error;
+        if(!journal->save(&error)){
+            QMessageBox::warning(this,"Unable to save to " + filepath,error);
+            return;
+        }
+        autosaver->saved(filepath);
+        statusBar()->showMessage("Saved " + QFileInfo(filepath).fileName(),3000);
+        return;
+    }
+    QString path = FileDialogs::savePath(this,building->getModel(),filepath);
+    if(!path.isEmpty()) saveTo(path);
+}
+
+void MainWindow::saveAs(){
+    if(!building) return;
+    QString path = FileDialogs::savePath(this,building->getModel(),"",true);
+    if(!path.isEmpty()) saveTo(path);
+}
+
+void MainWindow::saveTo(QString path){
+    if(!io->save(building->getModel(),path)) return;
+    // the snapshot was taken inside save(), the journal and autosave pick up every edit after it
+    resetJournal(path);
+    autosaver->saved(path);
+}
+
+void MainWindow::setBuilding(Building *bldg){
+    // nothing may point into the old building by the time it is deleted
+    renderArea->clearHistory();
+    renderArea->setSelectedFeature(NULL);
+    renderArea->floor(NULL);
+    PropertyManager::instance(this)->onItemSelected(NULL,PropertyManager::FLOOR,QModelIndex());
+    ui->selection_props_type->setDisabled(true);
+    resetJournal(QString());
+    autosaver->setBuilding(NULL,QString());
+
+    BuildingModel* old = building;
+    QItemSelectionModel* oldSelection = ui->building_list_view->selectionModel();
+    building = new BuildingModel(bldg,this);
+    ui->building_list_view->setModel(building);
+    // the view doesn't delete the selection model it made for the old building
+    delete oldSelection;
+    // deleting the building stops its background loading, waiting for the floor being decoded
+    if(old) old->deleteLater();
+    floorLoading->setFuture(bldg->backgroundLoading());
+}
+
+void MainWindow::resetJournal(QString path){
+    delete journal;
+    journal = NULL;
+    if(journalAction->isChecked() && building && !path.isEmpty()){
+        journal = new EditJournal(building->getModel(),path,this);
+        connect(journal,SIGNAL(compactionFailed(QString)),this,SLOT(journalCompactionFailed(QString)));
     }
 }
 
+void MainWindow::setJournaled(bool on){
+    // edits made before now aren't in a journal, so turning it on waits for the next full save
+    if(!on) resetJournal(QString());
+}
+
+void MainWindow::journalCompactionFailed(QString error){
+    statusBar()->showMessage("Unable to compact the edit journal: " + error,5000);
+}
+
+void MainWindow::buildingLoaded(Building *bldg, QString path){
+    ioDone();
+    setBuilding(bldg);
+    qDebug() << "Loaded building: " << bldg->name();
+    if(path == Autosaver::recoveryPath()){
+        // keep the recovery file until the recovered changes are saved, a full save is needed
+        // because the file on disk doesn't have them
+        filepath = recoveringAs;
+        resetJournal(QString());
+        autosaver->setBuilding(bldg,filepath);
+        setWindowTitle((filepath.isEmpty() ? QString("--New Building--") : QFileInfo(filepath).fileName()) + " (recovered)");
+        return;
+    }
+    filepath = path;
+    QFileInfo f(filepath);
+    setWindowTitle(f.fileName());
+    resetJournal(path);
+    autosaver->setBuilding(bldg,filepath);
+}
+
+void MainWindow::buildingSaved(QString path){
+    ioDone();
+    filepath = path;
+    QFileInfo f(filepath);
+    setWindowTitle(f.fileName());
+    statusBar()->showMessage("Saved " + f.fileName(),3000);
+}
+
+void MainWindow::exportTiles(){
+    if(!building) return;
+    QString directory = FileDialogs::tilesDirectory(this);
+    if(directory.isEmpty()) return;
+    TileOptions options = TileExporter::defaults();
+    options.incremental = true;
+    if(!io->exportTiles(building->getModel(),directory,options)){
+        statusBar()->showMessage("Wait for the current file operation to finish",3000);
+    }
+}
+
+void MainWindow::tilesExported(QString directory, int rendered){
+    ioDone();
+    statusBar()->showMessage(QString("Exported %1 tiles to %2").arg(rendered).arg(directory),3000);
+}
+
+void MainWindow::ioFailed(QString path, QString error){
+    ioDone();
+    // a journal started for a save that didn't happen has no building file under it
+    if(journal && journal->basePath() == path){
+        resetJournal(QString());
+        autosaver->unsaved();
+    }
+    QMessageBox::warning(this,"Unable to access " + path,error);
+}
+
+void MainWindow::ioCancelled(QString path){
+    ioDone();
+    if(journal && journal->basePath() == path){
+        resetJournal(QString());
+        autosaver->unsaved();
+    }
+    statusBar()->showMessage("Cancelled " + QFileInfo(path).fileName(),3000);
+}
+
+void MainWindow::floorsLoaded(){
+    if(!building) return;
+    // only the floors that are in, a floor still unloaded is reported when it is first used or saved
+    for(Floor* floor : building->getModel()->floors()){
+        if(floor->loadError().isEmpty()) continue;
+        QMessageBox::warning(this,"Unable to read floor " + floor->name(),
+                             floor->loadError() + "\n\nThe floor is shown empty and the building can't be saved over its file.");
+    }
+}
+
+void MainWindow::ioStarted(QString description){
+    ioLabel->setText(description);
+    ioProgressBar->setValue(0);
+    ioLabel->show();
+    ioProgressBar->show();
+    ioCancel->show();
+    ui->actionOpen->setEnabled(false);
+    ui->actionSave->setEnabled(false);
+    ui->actionSave_As->setEnabled(false);
+}
+
+void MainWindow::ioProgress(QString stage, int percent){
+    ioProgressBar->setFormat(stage + " %p%");
+    ioProgressBar->setValue(percent);
+}
+
+void MainWindow::ioDone(){
+    ioLabel->hide();
+    ioProgressBar->hide();
+    ioCancel->hide();
+    ui->actionOpen->setEnabled(true);
+    ui->actionSave->setEnabled(true);
+    ui->actionSave_As->setEnabled(true);
+}
+
 
 void MainWindow::setSelectedItem(Feature* feature){
     Floor* floor = renderArea->floor();
@@ -206,6 +438,11 @@ void MainWindow::listItemSelected(const QModelIndex& index){
 
 MainWindow::~MainWindow()
 {
+    delete io; // stops any background load or save before the building goes away
+    delete journal;
+    // a clean exit leaves nothing to recover
+    autosaver->setBuilding(NULL,QString());
+    Autosaver::discard();
     delete ui;
     delete renderArea;
     delete building;
@@ -4,10 +4,18 @@
 #include <QMainWindow>
 #include <QFileDialog>
 #include <QTreeWidgetItem>
+#include <QProgressBar>
+#include <QLabel>
+#include <QToolButton>
+#include <QFutureWatcher>
 
 #include "diagrammodels.h"
 #include "filereader.h"
 #include "renderarea.h"
+#include "fileservice.h"
+#include "filedialogs.h"
+#include "editjournal.h"
+#include "autosaver.h"
 
 namespace Ui {
 class MainWindow;
@@ -28,33 +36,80 @@ private slots:
     void openStairLinker(Feature*,Floor*);
     //! open a .bldg file
     void openFile();
-    //! save to a .bldg file
-    void saveFile(){
-        Building *bldg = building->getModel();
-        filepath = FileWriter::instance()->saveFile(this,bldg,filepath);
-        QFileInfo f(filepath);
-        setWindowTitle(f.fileName());
-    }
+    //! save to a .bldg file, only appending the edits to its journal when journaled saves are on
+    void saveFile();
     //! save to a new .bldg file
-    void saveAs(){
-        Building *bldg = building->getModel();
-        filepath = FileWriter::instance()->saveFile(this,bldg,"",true);
-        QFileInfo f(filepath);
-        setWindowTitle(f.fileName());
-    }
+    void saveAs();
+    //! turn journaled saves on or off, they start with the next full save or open
+    void setJournaled(bool on);
+    //! the journal couldn't be compacted into the building file
+    void journalCompactionFailed(QString error);
+    //! ask whether to load the building a crashed session left in the recovery file
+    void offerRecovery();
+    //! an autosave couldn't be written
+    void autosaveFailed(QString error);
     //! export the OSM file
     void exportToOSM(){
-        FileWriter::instance()->exportFile(this,building->getModel(),OSM);
+        FileDialogs::exportFile(this,building->getModel(),OSM);
+    }
+    //! export an SVG drawing of every floor
+    void exportToSVG(){
+        FileDialogs::exportFile(this,building->getModel(),SVG);
+    }
+    //! export a PDF with a page per floor
+    void exportToPDF(){
+        FileDialogs::exportFile(this,building->getModel(),PDF);
     }
+    //! export the GeoJSON file
+    void exportToGeoJSON(){
+        FileDialogs::exportFile(this,building->getModel(),GEOJSON);
+    }
+    //! export map tiles for a web viewer in the background, redrawing only what changed since the last export
+    void exportTiles();
     //! list item selection changed
     void listItemSelected(const QModelIndex& index);
     //! change the selected item
     void setSelectedItem(Feature* feature);
 
+    //! a background load or save has started
+    void ioStarted(QString description);
+    //! show the progress of a background load or save
+    void ioProgress(QString stage, int percent);
+    //! a building file has been read in the background
+    void buildingLoaded(DiagramModels::Building* bldg, QString path);
+    //! a building file has been written in the background
+    void buildingSaved(QString path);
+    //! map tiles have been written in the background
+    void tilesExported(QString directory, int rendered);
+    //! a background load or save failed
+    void ioFailed(QString path, QString error);
+    //! a background load or save was cancelled
+    void ioCancelled(QString path);
+    //! the floors of the open building have finished loading in the background, report any that failed
+    void floorsLoaded();
+
 private:
+    //! hide the file progress widgets in the status bar
+    void ioDone();
+    //! show \param bldg in place of the open building, which is deleted
+    void setBuilding(DiagramModels::Building* bldg);
+    //! write the whole building to \param path in the background
+    void saveTo(QString path);
+    //! journal the edits from now on against \param path, or stop journaling if it is empty
+    void resetJournal(QString path);
+
     Ui::MainWindow *ui;
     DiagramModels::BuildingModel *building;
     RenderArea* renderArea;
+    FileService* io; //! Loads and saves off the GUI thread
+    QFutureWatcher<void>* floorLoading; //! Signals when the open building's floors are all loaded
+    EditJournal* journal; //! Records edits for journaled saves, NULL when saves rewrite the whole file
+    QAction* journalAction;
+    Autosaver* autosaver; //! Writes the building to a recovery file in the background
+    QString recoveringAs; //! The file the building being recovered was edited as
+    QLabel* ioLabel; //! What the file service is doing
+    QProgressBar* ioProgressBar;
+    QToolButton* ioCancel;
 
     QMap<QString,FeatureType>* typeOptions;
     QString filepath;
@@ -0,0 +1,206 @@
+#include "osmexporter.h"
+#include "tracing.h"
+
+#include <QBuffer>
+#include <QHash>
+#include <QThread>
+#include <QXmlStreamWriter>
+#include <QtConcurrent/QtConcurrentMap>
+#include <functional>
+
+using namespace DiagramModels;
+
+//! An id for the \param index th element of its kind on the floor at \param position
+static qint64 packId(int position, int index){
+    return -((qint64(position) << 32) | qint64(index + 1));
+}
+
+static uint qHash(const QPoint& point, uint seed = 0){
+    return ::qHash((quint64(quint32(point.x())) << 32) | quint32(point.y()),seed);
+}
+
+//! Numbers the distinct vertices of a floor in the order they are first met, the same on every pass
+class VertexIds{
+public:
+    //! The node index of \param point, \param added set if it hadn't been seen before
+    int index(const QPoint& point, bool* added){
+        QHash<QPoint,int>::const_iterator it = _ids.constFind(point);
+        *added = it == _ids.constEnd();
+        if(!*added) return it.value();
+        int re = _ids.size();
+        _ids.insert(point,re);
+        return re;
+    }
+private:
+    QHash<QPoint,int> _ids;
+};
+
+QByteArray OsmExporter::encodeFloor(Floor *floor, int position, Part part) const{
+    TRACE_SPAN(traceSave,"encodeOsmFloor");
+    QByteArray re;
+    QBuffer buffer(&re);
+    buffer.open(QIODevice::WriteOnly);
+    QXmlStreamWriter xml(&buffer);
+    xml.setAutoFormatting(true);
+
+    VertexIds vertices;
+    QList<Feature*> features = floor->features();
+    QString level = QString::number(floor->floorIndex());
+    for(int i = 0; i < features.size(); i++){
+        Feature* feature = features[i];
+        QPolygon bounds = feature->bounds();
+        if(part == PART_WAYS){
+            xml.writeStartElement("way");
+            xml.writeAttribute("id",QString::number(packId(position,i)));
+            xml.writeAttribute("version","1");
+        }
+        for(int v = 0; !bounds.isEmpty() && v <= bounds.size(); v++){
+            // the way closes on its first node
+            const QPoint& point = bounds[v % bounds.size()];
+            bool added;
+            int index = vertices.index(point,&added);
+            if(part == PART_NODES && added){
+                xml.writeEmptyElement("node");
+                xml.writeAttribute("id",QString::number(packId(position,index)));
+                xml.writeAttribute("version","1");
+                xml.writeAttribute("lat",QString::number(_geo.latitude(point),'f',9));
+                xml.writeAttribute("lon",QString::number(_geo.longitude(point),'f',9));
+            }else if(part == PART_WAYS){
+                xml.writeEmptyElement("nd");
+                xml.writeAttribute("ref",QString::number(packId(position,index)));
+            }
+        }
+        if(part == PART_WAYS){
+            xml.writeEmptyElement("tag");
+            xml.writeAttribute("k","indoor");
+            xml.writeAttribute("v","room");
+            if(feature->type() == STAIRS){
+                xml.writeEmptyElement("tag");
+                xml.writeAttribute("k","stairs");
+                xml.writeAttribute("v","yes");
+            }
+            xml.writeEmptyElement("tag");
+            xml.writeAttribute("k","level");
+            xml.writeAttribute("v",level);
+            if(!feature->name().isEmpty()){
+                xml.writeEmptyElement("tag");
+                xml.writeAttribute("k","name");
+                xml.writeAttribute("v",feature->name());
+            }
+            xml.writeEndElement();
+        }
+    }
+    // the last empty element is only closed by whatever is written after it
+    xml.writeEndDocument();
+    return re;
+}
+
+bool OsmExporter::writePart(const QList<Floor*>& floors, Part part, QIODevice *device,
+                            QString *error, IoMonitor *monitor, int* done, int total) const{
+    // enough floors to keep every core busy, few enough that memory doesn't grow with the building
+    int window = qMax(1,QThread::idealThreadCount());
+    for(int first = 0; first < floors.size(); first += window){
+        if(monitor && monitor->isCancelled()){
+            if(error) *error = "Export cancelled";
+            return false;
+        }
+        QList<int> positions;
+        for(int i = first; i < qMin(first + window,floors.size()); i++) positions << i;
+        std::function<QByteArray(int)> encode = [this,&floors,part](int position){
+            return encodeFloor(floors[position],position,part);
+        };
+        // blockingMapped keeps the input order, whichever floor finishes first
+        QList<QByteArray> chunks = QtConcurrent::blockingMapped<QList<QByteArray> >(positions,encode);
+        for(const QByteArray& chunk : chunks){
+            if(device->write(chunk) != chunk.size()){
+                if(error) *error = device->errorString();
+                return false;
+            }
+            if(monitor) monitor->progress(++*done,total);
+        }
+    }
+    return true;
+}
+
+bool OsmExporter::write(Building *building, QIODevice *device, QString *error, IoMonitor *monitor) const{
+    TRACE_SPAN(traceSave,"exportOsm");
+    QList<Floor*> floors = building->floors();
+    int done = 0, total = floors.size() * 2 + 1;
+
+    QXmlStreamWriter xml(device);
+    xml.setAutoFormatting(true);
+    xml.writeStartDocument();
+    xml.writeStartElement("osm");
+    xml.writeAttribute("version","0.6");
+    xml.writeAttribute("generator",building->name());
+    xml.writeCharacters(""); // close the start tag before the floors are appended straight to the device
+    if(!writePart(floors,PART_NODES,device,error,monitor,&done,total) ||
+            !writePart(floors,PART_WAYS,device,error,monitor,&done,total)){
+        return false;
+    }
+
+    // a relation per floor, then one per staircase connection, each pair once;
+    // floor relations take the ids of "floor 0", connections those of "floor 1"
+    for(int position = 0; position < floors.size(); position++){
+        Floor* floor = floors[position];
+        xml.writeStartElement("relation");
+        xml.writeAttribute("id",QString::number(packId(0,position)));
+        xml.writeAttribute("version","1");
+        for(int i = 0; i < floor->featureCount(); i++){
+            xml.writeEmptyElement("member");
+            xml.writeAttribute("type","way");
+            xml.writeAttribute("ref",QString::number(packId(position,i)));
+            xml.writeAttribute("role","room");
+        }
+        xml.writeEmptyElement("tag");
+        xml.writeAttribute("k","type");
+        xml.writeAttribute("v","level");
+        xml.writeEmptyElement("tag");
+        xml.writeAttribute("k","level");
+        xml.writeAttribute("v",QString::number(floor->floorIndex()));
+        xml.writeEmptyElement("tag");
+        xml.writeAttribute("k","name");
+        xml.writeAttribute("v",floor->name());
+        xml.writeEndElement();
+    }
+    // floor_index is the floor's position, as Building::resolveConnections() checks it
+    int connection = 0;
+    for(int position = 0; position < floors.size(); position++){
+        QList<Feature*> features = floors[position]->features();
+        for(int i = 0; i < features.size(); i++){
+            for(const FeatureConnection& con : features[i]->connections()){
+                int other = con.floor_index;
+                if(other < 0 || other >= floors.size()) continue;
+                if(con.feature_index < 0 || con.feature_index >= floors[other]->featureCount()) continue;
+                FeatureConnection back = {position,i};
+                bool mutual = floors[other]->features()[con.feature_index]->connections().contains(back);
+                // written from the lower end of a mutual link, or from the only end of a one-way one
+                if(mutual && qMakePair(other,con.feature_index) < qMakePair(position,i)) continue;
+                xml.writeStartElement("relation");
+                xml.writeAttribute("id",QString::number(packId(1,connection++)));
+                xml.writeAttribute("version","1");
+                xml.writeEmptyElement("member");
+                xml.writeAttribute("type","way");
+                xml.writeAttribute("ref",QString::number(packId(position,i)));
+                xml.writeAttribute("role","from");
+                xml.writeEmptyElement("member");
+                xml.writeAttribute("type","way");
+                xml.writeAttribute("ref",QString::number(packId(other,con.feature_index)));
+                xml.writeAttribute("role","to");
+                xml.writeEmptyElement("tag");
+                xml.writeAttribute("k","type");
+                xml.writeAttribute("v","connection");
+                xml.writeEndElement();
+            }
+        }
+    }
+    if(monitor) monitor->progress(++done,total);
+
+    xml.writeEndElement();
+    xml.writeEndDocument();
+    if(xml.hasError()){
+        if(error) *error = device->errorString();
+        return false;
+    }
+    return true;
+}
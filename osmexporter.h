@@ -0,0 +1,53 @@
+#ifndef OSMEXPORTER_H
+#define OSMEXPORTER_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QString>
+
+#include "diagrammodels.h"
+#include "iomonitor.h"
+#include "georeference.h"
+
+/*!
+ * \brief The OsmExporter class writes a building as an OpenStreetMap XML file
+ *
+ * Every feature becomes a closed way tagged with the Simple Indoor Tagging scheme (indoor=room, plus
+ * stairs=yes for stairs, level and name). Vertices shared by features on the same floor become one node.
+ * Each floor becomes a relation of its ways, and each staircase connection a relation between two ways.
+ *
+ * The file is streamed: nodes, then ways, then relations, as the format expects. Floors are encoded
+ * in parallel a few at a time and appended in order, so memory stays at a handful of floors however
+ * large the building is. Ids are negative, as for data that hasn't been uploaded, and packed as
+ * floor << 32 | index so each floor is encoded without knowing the sizes of the others.
+ */
+class OsmExporter
+{
+public:
+    //! Where the floor coordinates are on the globe
+    void setGeoReference(const GeoReference& reference){_geo = reference;}
+
+    /*!
+     * \brief write encode \param building to \param device
+     * \param monitor reports progress per floor and stops the export if it is cancelled
+     * \return false if writing failed or was cancelled
+     */
+    bool write(DiagramModels::Building* building, QIODevice* device, QString* error = 0, IoMonitor* monitor = 0) const;
+
+private:
+    //! Which part of a floor to encode, the file needs every node before any way
+    typedef enum{
+        PART_NODES,
+        PART_WAYS
+    }Part;
+
+    //! The XML for one part of the floor at \param position in the building
+    QByteArray encodeFloor(DiagramModels::Floor* floor, int position, Part part) const;
+    //! Write \param part of every floor, a few floors in parallel at a time
+    bool writePart(const QList<DiagramModels::Floor*>& floors, Part part, QIODevice* device,
+                   QString* error, IoMonitor* monitor, int* done, int total) const;
+
+    GeoReference _geo;
+};
+
+#endif // OSMEXPORTER_H
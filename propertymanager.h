@@ -44,6 +44,7 @@ public slots:
      * \param text
      */
     void onItemNameChange(QString text){
+        if(!_item) return;
         switch(_itemType){
         case FLOOR:
             ((Floor*)_item)->name(text);
@@ -60,12 +61,13 @@ public slots:
      * \param typeIndex
      */
     void onItemTypeChange(int typeIndex){
+        if(!_item || _itemType != FEATURE) return;
         Feature* feature = (Feature*)_item;
         feature->type(FeatureType(typeIndex));        
     }
 
 private:
-    PropertyManager(MainWindow* parent):QObject(parent){
+    PropertyManager(MainWindow* parent):QObject(parent),_item(NULL),_itemType(FLOOR){
     }
 
 private:    
@@ -1,5 +1,7 @@
 #include "renderarea.h"
 #include "mainwindow.h"
+#include "floorrenderer.h"
+#include "tracing.h"
 
 #include <QPainter>
 #include <QDebug>
@@ -7,6 +9,11 @@
 #include <QPalette>
 #include <QPointer>
 #include <QInputDialog>
+#include <QWheelEvent>
+#include <QtMath>
+
+static const qreal MIN_ZOOM = 0.01;
+static const qreal MAX_ZOOM = 50;
 
 RenderArea::RenderArea(QWidget *parent) : QWidget(parent)
 {
@@ -16,34 +23,62 @@ RenderArea::RenderArea(QWidget *parent) : QWidget(parent)
     setPalette(pal);
     setMouseTracking(true);
 
-    pen.setColor(Qt::black);
-    pen.setWidth(1);
+    pen = FloorRenderer::outlinePen();
 
     _floor = NULL;
+    _staticFloor = NULL;
+    _staticExcluded = NULL;
+    _staticRevision = 0;
+    _knownRevision = 0;
+    _hoverFeature = NULL;
+    _scale = 1;
+    _panning = false;
     selectedFeature = NULL;
+    _draggedFeature = NULL;
     _state = SELECT;
     _shouldSnapToRoom = true;
     _shouldSnapToDegree = false;
+    _hudVisible = false;
+    _hudForcedCategories = 0;
+    _inputTime = -1;
+    _lastDraw = DrawCounts();
+    for(qint64& baseline : _hudBaseline) baseline = 0;
     show();
 }
 
 void RenderArea::mouseMoveEvent(QMouseEvent*){
+    if(!_floor)return;
+    markInput();
+    if(_panning){
+        QPoint widgetPos = mapFromGlobal(QCursor::pos());
+        _offset += widgetPos - _panLast;
+        _panLast = widgetPos;
+        updateView();
+        return;
+    }
     QPoint pos = QCursor::pos();
-    pos = mapFromGlobal(pos);
+    pos = toWorld(mapFromGlobal(pos));
+    if(_floor->revision() != _knownRevision){
+        // edited from outside the render area (renamed, linked), the damage is unknown
+        _damage += rect();
+    }
     if(_state == DRAG){
-        QPoint delta;
-        delta.setX(pos.x() - _dragLastPoint->x());
-        delta.setY(pos.y() - _dragLastPoint->y());
-        QPolygon bounds = selectedFeature->bounds();
-        QPolygon nbounds;
-        for(QPoint p : bounds){
-            nbounds << p + delta;
-        }
-        selectedFeature->bounds(nbounds);
-        _dragLastPoint->setX(pos.x());
-        _dragLastPoint->setY(pos.y());
+        // only the drawing moves, the bounds and indexes are updated once on release
+        damageFeature(_draggedFeature);
+        _dragOffset = pos - _dragOrigin;
+        damageFeature(_draggedFeature);
     }
-    repaint();
+    Feature* hoverFeature = _state != EDIT ? _floor->featureAt(pos) : NULL;
+    if(hoverFeature != _hoverFeature){
+        damageFeature(_hoverFeature);
+        damageFeature(hoverFeature);
+        _hoverFeature = hoverFeature;
+    }
+    if(_state == EDIT){
+        _editPoint = snapPoint(pos);
+    }
+    damagePreview();
+    flushDamage();
 }
 
 void RenderArea::keyReleaseEvent(QKeyEvent *evt){
@@ -54,38 +89,30 @@ void RenderArea::keyReleaseEvent(QKeyEvent *evt){
     case Qt::Key_Shift:
         if(_state == EDIT)_shouldSnapToDegree = false;
     case Qt::Key_S:
-        if(evt->modifiers().testFlag(Qt::AltModifier)){
-            qDebug() << "ALT PASS";
-            if(selectedFeature && selectedFeature->type() == STAIRS){
-                qDebug() << "OPEN STAIRS";
-                openStairsDialog(selectedFeature,_floor);
-            }else{
-                qDebug() << "DONT OPEN STAIRS";
-            }
+        if(evt->modifiers().testFlag(Qt::AltModifier) && selectedFeature && selectedFeature->type() == STAIRS){
+            openStairsDialog(selectedFeature,_floor);
         }
     }
 }
 
 void RenderArea::keyPressEvent(QKeyEvent *evt){
+    markInput();
     switch(evt->key()){
     case Qt::Key_Delete:
     case Qt::Key_Backspace:
         this->removeSelectedFeature();    
     case Qt::Key_Escape:
+        cancelDrag();
         if(selectedFeature != NULL){
-            EditorAction action;
-            action.type = SELECT_FEATURE;
-            Feature* f[2];
-            f[0] = selectedFeature;
-            f[1] = NULL;
-            action.data = f;
-            pushUndo(action);
+            pushCommand(CMD_SELECT,NULL,selectedFeature);
+            damageFeature(selectedFeature);
             if(selectedFeature->bounds().size() < 3){
                 removeSelectedFeature();
             }
             selectedFeature = NULL;
             selectedFeatureChanged(NULL);            
-            repaint();
+            damagePreview();
+            flushDamage();
         }
         break;
     case Qt::Key_C:
@@ -93,18 +120,144 @@ void RenderArea::keyPressEvent(QKeyEvent *evt){
         break;
     case Qt::Key_Shift:
         _shouldSnapToDegree = true;
+        break;
+    case Qt::Key_Home:
+        resetView();
+        break;
+    case Qt::Key_Left:
+    case Qt::Key_Right:
+    case Qt::Key_Up:
+    case Qt::Key_Down:{
+        // one floor unit, or ten with Ctrl held
+        int step = evt->modifiers().testFlag(Qt::ControlModifier) ? 10 : 1;
+        QPoint delta;
+        if(evt->key() == Qt::Key_Left) delta.setX(-step);
+        else if(evt->key() == Qt::Key_Right) delta.setX(step);
+        else if(evt->key() == Qt::Key_Up) delta.setY(-step);
+        else delta.setY(step);
+        nudgeSelected(delta);
+        break;
+    }
     }
 }
 
+void RenderArea::pushCommand(EditCommandType type, Feature *feature, Feature *previous, QPoint point){
+    EditCommand command = {type,_floor,feature,previous,point};
+    _history.push(command);
+}
+
+void RenderArea::nudgeSelected(QPoint delta){
+    if(!_floor || !selectedFeature || _state != SELECT) return;
+    damageFeature(selectedFeature);
+    selectedFeature->bounds(selectedFeature->bounds().translated(delta));
+    pushCommand(CMD_MOVE,selectedFeature,NULL,delta);
+    damageFeature(selectedFeature);
+    flushDamage();
+}
+
+void RenderArea::undo(){
+    if(!_floor) return;
+    TRACE_SPAN(traceUndo,"undo");
+    const EditCommand* next = _history.peekUndo(_floor);
+    if(!next) return;
+    cancelDrag();
+    damageFeature(selectedFeature);
+    damageFeature(_hoverFeature);
+    damageFeature(next->feature);
+    _hoverFeature = NULL;
+    EditCommand command;
+    _history.undo(_floor,&command);
+    Feature* selected = selectedFeature;
+    if(command.type == CMD_SELECT || command.type == CMD_ADD_FEATURE){
+        selected = command.previous;
+    }
+    if(command.type == CMD_ADD_FEATURE || command.type == CMD_DELETE_FEATURE){
+        featureListChanged(command.feature);
+    }
+    damageFeature(command.feature);
+    if(selected != selectedFeature){
+        selectedFeature = selected;
+        selectedFeatureChanged(selectedFeature);
+    }
+    damageFeature(selectedFeature);
+    damagePreview();
+    flushDamage();
+}
+
+void RenderArea::redo(){
+    if(!_floor) return;
+    TRACE_SPAN(traceUndo,"redo");
+    const EditCommand* next = _history.peekRedo(_floor);
+    if(!next) return;
+    cancelDrag();
+    damageFeature(selectedFeature);
+    damageFeature(_hoverFeature);
+    damageFeature(next->feature);
+    _hoverFeature = NULL;
+    EditCommand command;
+    _history.redo(_floor,&command);
+    Feature* selected = selectedFeature;
+    if(command.type == CMD_SELECT || command.type == CMD_ADD_FEATURE){
+        selected = command.feature;
+    }else if(command.type == CMD_DELETE_FEATURE && selected == command.feature){
+        selected = NULL;
+    }
+    if(command.type == CMD_ADD_FEATURE || command.type == CMD_DELETE_FEATURE){
+        featureListChanged(command.feature);
+    }
+    damageFeature(command.feature);
+    if(selected != selectedFeature){
+        selectedFeature = selected;
+        selectedFeatureChanged(selectedFeature);
+    }
+    damageFeature(selectedFeature);
+    damagePreview();
+    flushDamage();
+}
+
+void RenderArea::wheelEvent(QWheelEvent *evt){
+    markInput();
+    qreal steps = evt->angleDelta().y() / 120.0;
+    if(steps == 0) return;
+    zoomAt(mapFromGlobal(QCursor::pos()),qPow(1.15,steps));
+}
+
+QPoint RenderArea::toWorld(const QPoint &widgetPos) const{
+    return QPointF((widgetPos.x() - _offset.x()) / _scale,(widgetPos.y() - _offset.y()) / _scale).toPoint();
+}
+
+QRect RenderArea::toWidget(const QRect &worldRect) const{
+    return _view.mapRect(worldRect);
+}
+
+void RenderArea::zoomAt(const QPoint &widgetPos, qreal factor){
+    QPointF world((widgetPos.x() - _offset.x()) / _scale,(widgetPos.y() - _offset.y()) / _scale);
+    _scale = qBound<qreal>(MIN_ZOOM,_scale * factor,MAX_ZOOM);
+    _offset = QPointF(widgetPos) - world * _scale;
+    updateView();
+}
+
+void RenderArea::resetView(){
+    _scale = 1;
+    _offset = QPointF();
+    updateView();
+}
+
+void RenderArea::updateView(){
+    _view = QTransform(_scale,0,0,_scale,_offset.x(),_offset.y());
+    _previewRect = QRect();
+    update();
+}
+
 void RenderArea::mouseDoubleClickEvent(QMouseEvent *){
     QPoint mousePos = QCursor::pos();
-    mousePos = mapFromGlobal(mousePos);
+    mousePos = toWorld(mapFromGlobal(mousePos));
     switch(_state){
     case SELECT:
     case DRAG:{
-        if(selectedFeature && selectedFeature->bounds().containsPoint(mousePos,Qt::OddEvenFill)){
+        if(selectedFeature && selectedFeature->contains(mousePos)){
             if(selectedFeature->type() == STAIRS){
-                _state = SELECT;
+                cancelDrag();
                 openStairsDialog(selectedFeature,_floor);                
             }
         }
@@ -113,81 +266,81 @@ void RenderArea::mouseDoubleClickEvent(QMouseEvent *){
     }
 }
 
-void RenderArea::mousePressEvent(QMouseEvent *){
+void RenderArea::mousePressEvent(QMouseEvent *evt){
     setFocus();
+    markInput();
+    if(evt->button() == Qt::MiddleButton){
+        _panning = true;
+        _panLast = mapFromGlobal(QCursor::pos());
+        setCursor(Qt::ClosedHandCursor);
+        return;
+    }
     QPoint mousePos = QCursor::pos();
-    mousePos = mapFromGlobal(mousePos);
+    mousePos = toWorld(mapFromGlobal(mousePos));
     if(selectedFeature &&
-            selectedFeature->bounds().containsPoint(mousePos,Qt::OddEvenFill)&&
+            selectedFeature->contains(mousePos)&&
             _state == SELECT){
         _state = DRAG;
-        _dragDelta = new QPoint(0,0);
-        _dragOrigin = new QPoint(mousePos);
-        _dragLastPoint = new QPoint(mousePos);
+        _draggedFeature = selectedFeature;
+        _dragOrigin = mousePos;
+        _dragOffset = QPoint();
     }
 }
 
-void RenderArea::mouseReleaseEvent(QMouseEvent *){
+void RenderArea::mouseReleaseEvent(QMouseEvent *evt){
+    markInput();
+    if(evt->button() == Qt::MiddleButton){
+        _panning = false;
+        unsetCursor();
+        return;
+    }
     if(!_floor)return;
     QPoint mousePos = QCursor::pos();
-    mousePos = mapFromGlobal(mousePos);
+    mousePos = toWorld(mapFromGlobal(mousePos));
     if(_state == SELECT){
         bool nSelect = false;
-        for(Feature* feature: _floor->features()){
-            if(feature->bounds().containsPoint(mousePos,Qt::OddEvenFill)){
-                EditorAction action;
-                Feature* f[2];
-                f[0] = selectedFeature;
-                f[1] = feature;
-                action.data = f;
-                action.type = SELECT_FEATURE;
-                pushUndo(action);
-                selectedFeature = feature;
-                selectedFeatureChanged(selectedFeature);
-                nSelect = true;
-            }            
-        }        
-        repaint();
-        if(nSelect) return;
+        Feature* feature = _floor->featureAt(mousePos);
+        damageFeature(selectedFeature);
+        if(feature){
+            pushCommand(CMD_SELECT,feature,selectedFeature);
+            selectedFeature = feature;
+            selectedFeatureChanged(selectedFeature);
+            nSelect = true;
+        }
+        damageFeature(selectedFeature);
+        if(nSelect){
+            flushDamage();
+            return;
+        }
         if(selectedFeature && selectedFeature->bounds().size() < 3){
             removeSelectedFeature();
         }
         selectedFeature = NULL;        
         selectedFeatureChanged(selectedFeature);
-        repaint();
     }
     else if(_state == DRAG){
-        _dragDelta = new QPoint(mousePos - *_dragOrigin);
-        EditorAction action;
-        action.type = MOVE_FEATURE;
-        moveData* data = new moveData();
-        data->feature = selectedFeature;
-        data->delta = _dragDelta;
-        action.data = data;
-        pushUndo(action);
+        Feature* dragged = _draggedFeature;
+        damageFeature(dragged);
+        QPoint delta = _dragOffset;
+        _dragOffset = QPoint();
+        _draggedFeature = NULL;
         _state = SELECT;
+        if(!delta.isNull()){
+            dragged->bounds(dragged->bounds().translated(delta));
+            pushCommand(CMD_MOVE,dragged,NULL,delta);
+        }
+        damageFeature(dragged);
     }
     else if(_state == EDIT){
-        QPoint editPoint = mousePos;
-        if(_shouldSnapToDegree){
-            editPoint = snapToDegree(editPoint);
-        }
-        if(_shouldSnapToRoom){
-            editPoint = snapToRoom(editPoint);
-        }
+        QPoint editPoint = snapPoint(mousePos);
+        damageFeature(selectedFeature);
         if(selectedFeature == NULL){
             QPolygon bounds;
             bounds << editPoint;
             Feature* f = new Feature(FeatureType::ROOM,bounds,_floor);
             f->name("New Room");
-            Feature* a[2];
-            a[1] = f;
-            a[0] = selectedFeature;
-            EditorAction action;
-            action.data = a;
-            action.type = ADD_FEATURE;
-            pushUndo(action);
-            _floor->addFeature(f);            
+            _floor->addFeature(f);
+            pushCommand(CMD_ADD_FEATURE,f,selectedFeature);
             selectedFeature = f;
             featureListChanged(f);
             selectedFeatureChanged(selectedFeature);
@@ -195,69 +348,158 @@ void RenderArea::mouseReleaseEvent(QMouseEvent *){
             QPolygon bounds = selectedFeature->bounds();
             bounds << editPoint;
             selectedFeature->bounds(bounds);
-            EditorAction action;
-            action.data = &editPoint;
-            action.type = ADD_POINT;
-            pushUndo(action);
+            pushCommand(CMD_ADD_POINT,selectedFeature,NULL,editPoint);
         }
+        damageFeature(selectedFeature);
+        _editPoint = editPoint;
+        damagePreview();
     }
-    repaint();
+    flushDamage();
+}
+
+void RenderArea::cancelDrag(){
+    if(_state != DRAG) return;
+    damageFeature(_draggedFeature);
+    _state = SELECT;
+    _dragOffset = QPoint();
+    damageFeature(_draggedFeature);
+    _draggedFeature = NULL;
+    flushDamage();
 }
 
 void RenderArea::removeSelectedFeature(){
+    cancelDrag();
     if(selectedFeature){
+        damageFeature(selectedFeature);
+        if(_hoverFeature == selectedFeature) _hoverFeature = NULL;
         _floor->removeFeature(selectedFeature);
-        EditorAction action;
-        action.data = selectedFeature;
-        action.type = DELETE_FEATURE;
-        pushUndo(action);
+        pushCommand(CMD_DELETE_FEATURE,selectedFeature);
         selectedFeature = NULL;        
         featureListChanged(NULL);
         selectedFeatureChanged(NULL);
-        repaint();
+        damagePreview();
+        flushDamage();
+    }
+}
+
+QRect RenderArea::featureRect(Feature *feature){
+    QRect label = fontMetrics().boundingRect(feature->name()).translated(feature->labelPosition());
+    QRect rect = feature->boundingRect().united(label);
+    if(feature == draggedFeature()) rect.translate(_dragOffset);
+    // leave room for the outline pen and the vertex handles
+    return toWidget(rect).adjusted(-6,-6,6,6);
+}
+
+void RenderArea::damageFeature(Feature *feature){
+    if(feature && feature->floor() == _floor) _damage += featureRect(feature);
+}
+
+void RenderArea::damagePreview(){
+    _damage += _previewRect;
+    _previewRect = QRect();
+    if(_state == EDIT && selectedFeature && !selectedFeature->bounds().empty()){
+        _previewRect = toWidget(QRect(selectedFeature->bounds().last(),_editPoint).normalized()).adjusted(-2,-2,2,2);
+        _damage += _previewRect;
+    }
+}
+
+void RenderArea::flushDamage(){
+    if(_floor) _knownRevision = _floor->revision();
+    if(_damage.isEmpty()) return;
+    if(_hudVisible) _damage += _hudRect;
+    update(_damage);
+    _damage = QRegion();
+}
+
+void RenderArea::updateStaticLayer(){
+    QSize size = this->size() * devicePixelRatioF();
+    if(_staticFloor == _floor && _staticRevision == _floor->revision() && _staticView == _view && _staticLayer.size() == size &&
+            _staticExcluded == draggedFeature()){
+        TRACE_COUNT(tracePaint,"static layer hits",1);
+        return;
+    }
+    TRACE_SPAN(tracePaint,"updateStaticLayer");
+    TRACE_COUNT(tracePaint,"static layer misses",1);
+    if(_staticLayer.size() != size){
+        _staticLayer = QImage(size,QImage::Format_RGB32);
+    }
+    _staticLayer.setDevicePixelRatio(devicePixelRatioF());
+    _staticLayer.fill(palette().color(QPalette::Background));
+    QPainter painter(&_staticLayer);
+    painter.setPen(pen);
+    painter.setTransform(_view);
+    DrawCounts before = drawCounts();
+    FloorRenderer::drawFloor(painter,_floor,_view.inverted().mapRect(rect()),draggedFeature());
+    DrawCounts after = drawCounts();
+    _lastDraw.drawn = after.drawn - before.drawn;
+    _lastDraw.simplified = after.simplified - before.simplified;
+    _lastDraw.aggregated = after.aggregated - before.aggregated;
+    _lastDraw.culled = after.culled - before.culled;
+    _lastDraw.vertices = after.vertices - before.vertices;
+    _staticFloor = _floor;
+    _staticExcluded = draggedFeature();
+    _staticRevision = _floor->revision();
+    _staticView = _view;
+}
+
+QBrush RenderArea::fillFor(Feature *feature) const{
+    if(feature == selectedFeature) return _state == EDIT ? QBrush(Qt::NoBrush) : QBrush(Qt::blue);
+    if(feature == _hoverFeature) return QBrush(QColor(0,0,255,100));
+    return FloorRenderer::featureBrush(feature);
+}
+
+void RenderArea::drawHighlight(QPainter &painter, Feature *feature, const QPoint& offset){
+    // the area from blank, so translucent and empty fills look as they would on the floor
+    qreal margin = 2 / _scale;
+    QRectF area = QRectF(feature->boundingRect().translated(offset)).adjusted(-margin,-margin,margin,margin);
+    painter.save();
+    painter.setClipRect(area);
+    painter.fillRect(area,palette().color(QPalette::Background));
+    Feature* dragged = draggedFeature();
+    for(Feature* other : _floor->featuresIn(area.toAlignedRect())){
+        if(other != dragged) FloorRenderer::drawFeature(painter,other,fillFor(other));
+    }
+    // the dragged feature isn't in the cached layer, it goes on top at its offset
+    if(dragged && area.intersects(QRectF(dragged->boundingRect().translated(_dragOffset)))){
+        painter.translate(_dragOffset);
+        FloorRenderer::drawFeature(painter,dragged,fillFor(dragged));
     }
+    painter.restore();
 }
 
-void RenderArea::paintEvent(QPaintEvent*){    
+void RenderArea::paintEvent(QPaintEvent* evt){    
     if(_floor == NULL){
         return;
     }
-    QPoint mousePos = QCursor::pos();
-    mousePos = mapFromGlobal(mousePos);
+    TRACE_SPAN(tracePaint,"paint");
+    TRACE_SPAN_SINCE(tracePaint,"input to paint",_inputTime);
+    _inputTime = -1;
+    updateStaticLayer();
     QPainter painter(this);
-    painter.eraseRect(0,0,width(),height());
+    const QRegion& region = evt->region();
+    qreal ratio = _staticLayer.devicePixelRatio();
+    for(const QRect& r : region){
+        QRectF source(r.x()*ratio,r.y()*ratio,r.width()*ratio,r.height()*ratio);
+        painter.drawImage(QRectF(r),_staticLayer,source);
+    }
     painter.setPen(pen);    
-    for(Feature* feature: _floor->features()){
-        if(feature == selectedFeature){
-            if(_state == EDIT) painter.setBrush(Qt::NoBrush);
-            else painter.setBrush(Qt::blue);
-        }else if(_state != EDIT && feature->bounds().containsPoint(mousePos,Qt::OddEvenFill)){
-            painter.setBrush(QBrush(QColor(0,0,255,100)));
-        }else if(feature->connections().size() > 0){
-            painter.setBrush(Qt::yellow);
-        }else{
-            painter.setBrush(Qt::lightGray);
-        }
-        painter.drawPolygon(feature->bounds());
-        painter.drawText(feature->center(),feature->name());
+    painter.setTransform(_view);
 
+    // overlay: hover, selection, vertex handles and the preview line
+    if(_hoverFeature && _hoverFeature != selectedFeature && region.intersects(featureRect(_hoverFeature))){
+        drawHighlight(painter,_hoverFeature);
+    }
+    if(selectedFeature && selectedFeature->floor() == _floor && region.intersects(featureRect(selectedFeature))){
+        drawHighlight(painter,selectedFeature,selectedFeature == draggedFeature() ? _dragOffset : QPoint());
     }
     if(_state == EDIT && selectedFeature != NULL){
         painter.setBrush(Qt::black);
         for(QPoint p : selectedFeature->bounds()){ // draw the points for the bounds
-            painter.drawEllipse(p,5,5);
+            painter.drawEllipse(QPointF(p),5/_scale,5/_scale);
         }
         QLine previewLine;
         previewLine.setP1(selectedFeature->bounds().last());
-        QPoint editPoint = QCursor::pos();
-        editPoint = mapFromGlobal(editPoint);
-        editPoint = editPoint;
-        if(_shouldSnapToDegree){
-            editPoint = snapToDegree(editPoint);
-        }
-        if(_shouldSnapToRoom){
-            editPoint = snapToRoom(editPoint);
-        }
+        QPoint editPoint = _editPoint;
         QPen previewPen(painter.pen());
         previewPen.setColor(Qt::gray);
         painter.setPen(previewPen);
@@ -267,4 +509,101 @@ void RenderArea::paintEvent(QPaintEvent*){
         //painter.drawLine(previewLine); // draw the preview lines
         painter.setPen(pen);
     }
+    if(_hudVisible){
+        drawHud(painter);
+    }
+}
+
+void RenderArea::setHudVisible(bool visible){
+    if(_hudVisible == visible) return;
+    _hudVisible = visible;
+#ifdef FLOORPLAN_TRACING
+    // the overlay is built from these, record them while it is shown
+    const QLoggingCategory* categories[] = {&tracePaint(),&traceHitTest()};
+    for(int i = 0; i < 2; i++){
+        if(visible && !categories[i]->isDebugEnabled()){
+            Tracing::setEnabled(*categories[i],true);
+            _hudForcedCategories |= 1 << i;
+        }else if(!visible && (_hudForcedCategories & (1 << i))){
+            Tracing::setEnabled(*categories[i],false);
+        }
+    }
+    if(!visible) _hudForcedCategories = 0;
+#endif
+    _hudBaseline[0] = Tracing::counterValue("static layer hits");
+    _hudBaseline[1] = Tracing::counterValue("static layer misses");
+    _hudBaseline[2] = Tracing::counterValue("geometry cache hits");
+    _hudBaseline[3] = Tracing::counterValue("geometry cache misses");
+    // redraw everything, including the static layer so the draw counts are fresh
+    _hudRect = QRect();
+    _staticFloor = NULL;
+    update();
+}
+
+RenderArea::DrawCounts RenderArea::drawCounts(){
+    DrawCounts counts;
+    counts.drawn = Tracing::counterValue("features drawn");
+    counts.simplified = Tracing::counterValue("features simplified");
+    counts.aggregated = Tracing::counterValue("features aggregated");
+    counts.culled = Tracing::counterValue("features culled");
+    counts.vertices = Tracing::counterValue("vertices drawn");
+    return counts;
+}
+
+//! "hits of total" as a percentage, or a dash before there is anything to rate
+static QString hitRate(qint64 hits, qint64 misses){
+    if(hits + misses <= 0) return "-";
+    return QString("%1%").arg(100.0 * hits / (hits + misses),0,'f',1);
+}
+
+//! "last / p95" of a span in milliseconds
+static QString spanTimes(const char* name){
+    Tracing::SpanStats stats = Tracing::spanStats(name);
+    if(stats.samples == 0) return "-";
+    return QString("%1 / %2 ms").arg(stats.last / 1e6,0,'f',2).arg(stats.p95 / 1e6,0,'f',2);
+}
+
+QStringList RenderArea::hudLines() const{
+    QStringList lines;
+    if(!Tracing::compiledIn()){
+        lines << "Performance overlay disabled: rebuild with qmake CONFIG+=tracing";
+    }else{
+        lines << QString("paint last/p95: %1").arg(spanTimes("paint"));
+        lines << QString("input to paint last/p95: %1").arg(spanTimes("input to paint"));
+        lines << QString("static redraw last/p95: %1").arg(spanTimes("updateStaticLayer"));
+        lines << QString("hit test last/p95: %1").arg(spanTimes("featureAt"));
+        lines << QString("features drawn %1, simplified %2, aggregated %3, culled %4")
+                 .arg(_lastDraw.drawn).arg(_lastDraw.simplified).arg(_lastDraw.aggregated).arg(_lastDraw.culled);
+        lines << QString("vertices drawn %1").arg(_lastDraw.vertices);
+        lines << QString("static layer hits %1, geometry cache hits %2")
+                 .arg(hitRate(Tracing::counterValue("static layer hits") - _hudBaseline[0],
+                              Tracing::counterValue("static layer misses") - _hudBaseline[1]))
+                 .arg(hitRate(Tracing::counterValue("geometry cache hits") - _hudBaseline[2],
+                              Tracing::counterValue("geometry cache misses") - _hudBaseline[3]));
+    }
+    lines << QString("undo history %1 KiB").arg(_history.memoryUsage() / 1024.0,0,'f',1);
+    return lines;
+}
+
+void RenderArea::drawHud(QPainter &painter){
+    QStringList lines = hudLines();
+    QFontMetrics metrics = fontMetrics();
+    int width = 0;
+    for(const QString& line : lines) width = qMax(width,metrics.boundingRect(line).width());
+    QRect box(8,8,width + 12,lines.size() * metrics.lineSpacing() + 8);
+    // only grows, so the text of a wider frame is always covered by the next repaint
+    _hudRect |= box;
+
+    painter.save();
+    painter.resetTransform();
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(QColor(0,0,0,180));
+    painter.drawRect(box);
+    painter.setPen(Qt::white);
+    int y = box.top() + 4 + metrics.ascent();
+    for(const QString& line : lines){
+        painter.drawText(box.left() + 6,y,line);
+        y += metrics.lineSpacing();
+    }
+    painter.restore();
 }
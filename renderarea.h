@@ -5,32 +5,17 @@
 
 #include <QWidget>
 #include <QPen>
-#include <QStack>
-#include <QQueue>
+#include <QImage>
+#include <QRegion>
+#include <QTransform>
+#include <QStringList>
 
 #include "diagrammodels.h"
+#include "edithistory.h"
+#include "tracing.h"
 
 using namespace DiagramModels;
 
-//! THe Editor Action Types for Undo functionality
-typedef enum{
-    ADD_POINT,
-    DELETE_FEATURE,
-    ADD_FEATURE,
-    SELECT_FEATURE, // data = array[2] <= [0] = previous, [1] = current
-    MOVE_FEATURE // data = Feature*,QPoint(dx,dy)*
-}EditorActionType;
-//! The move data type for editor action types for Undo Functionality
-typedef struct{
-    Feature* feature;
-    QPoint* delta;
-}moveData;
-//! Editor Actions
-typedef struct{
-    EditorActionType type;
-    void* data;
-}EditorAction;
-
 //! The state of the render area, either SELECT, DRAG, or EDIT
 typedef enum{
     SELECT,
@@ -51,14 +36,15 @@ public:
     void mouseReleaseEvent(QMouseEvent *evt) override;
     void mousePressEvent(QMouseEvent *)override;    
     void mouseDoubleClickEvent(QMouseEvent *) override;
+    void wheelEvent(QWheelEvent *evt) override;
 
     //! set the floor
     void floor(Floor* floor){
+        if(_floor == floor) return;
+        cancelDrag();
         _floor=floor;
-        if(!_redoQueue.keys().contains(_floor)){
-            _redoQueue[_floor] = QQueue<EditorAction>();
-            _undoStack[_floor] = QStack<EditorAction>();
-        }
+        _hoverFeature = NULL;
+        _previewRect = QRect();
         update();
     }
     //! get the floor
@@ -67,6 +53,55 @@ public:
     //! remove the selected feature from the floor
     void removeSelectedFeature();
 
+    /*!
+     * \brief snapToRoom snaps point to the nearest corner or wall of a room
+     * \param point
+     * \param alpha the snapping radius
+     * \return the nearest corner, perpendicular foot or wall point, or point if nothing is in range
+     */
+    QPoint snapToRoom(QPoint point,int alpha = 10){
+        QPoint anchor;
+        bool hasAnchor = selectedFeature && !selectedFeature->bounds().empty();
+        if(hasAnchor) anchor = selectedFeature->bounds().last();
+        const SnapIndex& index = _floor->snapIndex();
+        SnapResult snap = index.snap(point,alpha,hasAnchor? &anchor : 0);
+        if(snap.type == SNAP_NONE || !hasAnchor || !_shouldSnapToDegree || anchor == point) return snap.point;
+        // keep the angle chosen by snapToDegree: a corner or foot off that line is not used,
+        // and walls are met by sliding along the line onto them
+        QLine constraint(anchor,point);
+        if(onLine(constraint,snap.point)) return snap.point;
+        if(snap.type == SNAP_VERTEX) snap = index.nearestEdge(point,alpha);
+        QPoint onWall;
+        if(snap.type != SNAP_NONE && SnapIndex::intersect(constraint,snap.edge,&onWall) &&
+                (onWall - point).manhattanLength() <= 2*alpha){
+            return onWall;
+        }
+        return point;
+    }
+
+    //! An estimate of the bytes held by the undo history
+    qint64 historyMemoryUsage() const{return _history.memoryUsage();}
+    //! Forget the undo history, e.g. when the building is closed
+    void clearHistory(){_history.clear();}
+    //! Redraw the cached floor image on the next paint even if nothing changed
+    void invalidateStaticLayer(){
+        _staticFloor = NULL;
+        update();
+    }
+
+    //! map a widget position to floor coordinates
+    QPoint toWorld(const QPoint& widgetPos) const;
+    //! map a rectangle in floor coordinates to the widget
+    QRect toWidget(const QRect& worldRect) const;
+    /*!
+     * \brief zoomAt zoom in or out keeping a point under the cursor fixed
+     * \param widgetPos the point to keep fixed
+     * \param factor the change in scale
+     */
+    void zoomAt(const QPoint& widgetPos, qreal factor);
+    //! go back to 1:1 with the floor origin at the top left
+    void resetView();
+
 signals:
     /*!
      * \brief featureListChanged update to the feature list needed
@@ -91,7 +126,12 @@ public slots:
      * \param feature
      */
     void setSelectedFeature(Feature* feature){
+        if(feature != selectedFeature) cancelDrag();
+        damageFeature(selectedFeature);
         selectedFeature = feature;
+        damageFeature(selectedFeature);
+        damagePreview();
+        flushDamage();
     }  
 
     /*!
@@ -99,8 +139,13 @@ public slots:
      * \param state
      */
     void setState(RenderAreaState state){
+        cancelDrag();
+        damageFeature(selectedFeature);
+        damageFeature(_hoverFeature);
+        if(state == EDIT) _hoverFeature = NULL;
         _state = state;
-        repaint();
+        damagePreview();
+        flushDamage();
     }
 
     /*!
@@ -112,106 +157,21 @@ public slots:
     }
 
     /*!
-     * \brief pushUndo add an Action to the change stack
-     * \param action
+     * \brief undo undo the last edit on the current floor
      */
-    void pushUndo(EditorAction action){
-        _redoQueue[_floor].clear();
-        _undoStack[_floor].push(action);
-    }
+    void undo();
 
     /*!
-     * \brief undo undo the last action in the change stack
+     * \brief redo redo the last undone edit on the current floor
      */
-    void undo(){
-        if(_undoStack[_floor].empty()) return;
-        EditorAction action = _undoStack[_floor].pop();
-        qDebug() << "Undo: " << action.type << " : " << action.data;
-        _redoQueue[_floor].append(action);
-        if(action.type == ADD_POINT){
-            QPolygon bounds = selectedFeature->bounds();
-            bounds.removeLast();
-            selectedFeature->bounds(bounds);
-        }
-        else if(action.type == DELETE_FEATURE){
-            Feature* f = static_cast<Feature*>(action.data);
-            if(f){
-                _floor->addFeature(f);
-            }else{
-                qDebug() << "Tried to undo deletion of feature, bad cast";
-            }
-        }
-        else if(action.type == ADD_FEATURE){
-            Feature** f = static_cast<Feature**>(action.data);
-            if(f){
-                selectedFeature = f[0];
-                _floor->removeFeature(f[1]);
-            }else{
-                qDebug() << "Tried to undo addition of feature, bad cast";
-            }
-        }
-        else if(action.type == SELECT_FEATURE){
-            Feature** f = static_cast<Feature**>(action.data);
-            selectedFeature = f[0];
-        }
-        else if(action.type == MOVE_FEATURE){
-            moveData* data = static_cast<moveData*>(action.data);
-            Feature* f = data->feature;
-            QPoint* delta = data->delta;
-            QPolygon nbounds;
-            for(QPoint p : f->bounds()){
-                nbounds << p-*delta;
-            }
-            f->bounds(nbounds);
-        }
-        repaint();
-    }
+    void redo();
 
     /*!
-     * \brief redo redo the first change on the redo queue
+     * \brief setHudVisible show or hide the performance overlay
+     * The overlay reads the tracing counters, and turns on the paint and hit test categories while it is shown.
+     * \param visible
      */
-    void redo(){
-        if(_redoQueue[_floor].empty())return;
-        EditorAction action = _redoQueue[_floor].dequeue();
-        _undoStack[_floor].push(action);
-        if(action.type == ADD_POINT){
-            QPolygon bounds = selectedFeature->bounds();
-            QPoint* point = static_cast<QPoint*>(action.data);
-            bounds << *point;
-            selectedFeature->bounds(bounds);
-        }
-        else if(action.type == DELETE_FEATURE){
-            Feature* f = static_cast<Feature*>(action.data);
-            if(f){
-                _floor->removeFeature(f);
-            }else{
-                qDebug() << "Tried to undo deletion of feature, bad cast";
-            }
-        }
-        else if(action.type == ADD_FEATURE){
-            Feature* f = static_cast<Feature*>(action.data);
-            if(f){
-                _floor->addFeature(f);
-            }else{
-                qDebug() << "Tried to undo addition of feature, bad cast";
-            }
-        }
-        else if(action.type == SELECT_FEATURE){
-            Feature** f = static_cast<Feature**>(action.data);
-            selectedFeature = f[1];
-        }
-        else if(action.type == MOVE_FEATURE){
-            moveData* data = static_cast<moveData*>(action.data);
-            Feature* f = data->feature;
-            QPoint* delta = data->delta;
-            QPolygon nbounds;
-            for(QPoint p : f->bounds()){
-                nbounds << p+*delta;
-            }
-            f->bounds(nbounds);
-        }
-        repaint();
-    }
+    void setHudVisible(bool visible);
 
 protected:
     void paintEvent(QPaintEvent*) override;    
@@ -221,18 +181,17 @@ protected:
 private:    
 
     /*!
-     * \brief snapToRoom snaps point to the corner of the closest room
+     * \brief snapPoint apply the enabled snapping modes to an edit point
      * \param point
-     * \param alpha
-     * \return the corner QPoint of the nearest room to point
+     * \return the adjusted qpoint
      */
-    QPoint snapToRoom(QPoint point,int alpha = 10){
-        for(Feature* f: _floor->features()){
-            for(QPoint p : f->bounds()){
-                if((point - p).manhattanLength() <= alpha){
-                    return p;
-                }
-            }
+    QPoint snapPoint(QPoint point){
+        TRACE_SPAN(traceSnap,"snapPoint");
+        if(_shouldSnapToDegree && selectedFeature){
+            point = snapToDegree(point);
+        }
+        if(_shouldSnapToRoom){
+            point = snapToRoom(point,qMax(1,qRound(10 / _scale))); // 10 pixels at the current zoom
         }
         return point;
     }
@@ -256,6 +215,70 @@ private:
         return point;
     }
 
+    //! If \param point is within half a unit of the infinite line through \param line
+    static bool onLine(const QLine& line, const QPoint& point){
+        QPoint d = line.p2() - line.p1(), v = point - line.p1();
+        double cross = double(d.x()) * v.y() - double(d.y()) * v.x();
+        return cross * cross <= 0.25 * (double(d.x()) * d.x() + double(d.y()) * d.y());
+    }
+
+    /*!
+     * \brief updateStaticLayer redraw the cached floor image if the floor was edited or the widget resized
+     */
+    void updateStaticLayer();
+
+    /*!
+     * \brief drawHighlight redraw the area of a hovered or selected feature over the cached floor image
+     * Every feature in the area is drawn again in floor order with fillFor(), so the highlight keeps its
+     * place in the z-order: features nested in it stay on top and the ones under it show through.
+     * \param painter
+     * \param feature
+     * \param offset where the feature is drawn from its bounds, while it is dragged
+     */
+    void drawHighlight(QPainter& painter, Feature* feature, const QPoint& offset = QPoint());
+    //! The fill of \param feature: its highlight if it is hovered or selected, its usual fill otherwise
+    QBrush fillFor(Feature* feature) const;
+
+    /*!
+     * \brief featureRect the widget area a feature covers, including its name and vertex handles
+     * \param feature
+     * \return the area to repaint when the feature changes
+     */
+    QRect featureRect(Feature* feature);
+    //! Mark the area of \param feature for repainting, if it is on the current floor
+    void damageFeature(Feature* feature);
+    //! The feature being dragged, drawn at _dragOffset instead of its bounds, or NULL
+    Feature* draggedFeature() const{return _state == DRAG ? _draggedFeature : NULL;}
+    //! Drop a drag in progress without moving the feature, before the selection changes or the feature goes away
+    void cancelDrag();
+    //! Mark the old and new preview line for repainting
+    void damagePreview();
+    //! Repaint everything marked since the last flush in one update
+    void flushDamage();
+    //! Rebuild the view transform after a pan or zoom and repaint
+    void updateView();
+    //! Record an edit on the current floor that has already been made
+    void pushCommand(EditCommandType type, Feature* feature, Feature* previous = NULL, QPoint point = QPoint());
+    //! Move the selected feature by \param delta as one undoable step, merged with the moves just before it
+    void nudgeSelected(QPoint delta);
+    //! Note the time of an input event that hasn't been painted yet, for the input to paint latency
+    void markInput(){if(_inputTime < 0) TRACE_MARK(_inputTime);}
+
+    //! Feature counts of one static layer redraw, taken from the tracing counters
+    typedef struct{
+        qint64 drawn;
+        qint64 simplified;
+        qint64 aggregated;
+        qint64 culled;
+        qint64 vertices;
+    }DrawCounts;
+    //! The running totals of the draw counters
+    static DrawCounts drawCounts();
+    //! The lines of text the performance overlay shows
+    QStringList hudLines() const;
+    //! Draw the performance overlay in the top left corner, in widget coordinates
+    void drawHud(QPainter& painter);
+
 private:
     QPen pen;
     Floor* _floor;
@@ -264,10 +287,36 @@ private:
 
     bool _shouldSnapToRoom; // defaults to true
     bool _shouldSnapToDegree; // defaults to false (0º,45º,90º,etc)
-    QPoint* _dragDelta, *_dragOrigin,*_dragLastPoint;
+    Feature* _draggedFeature; // the feature picked up by the drag, kept apart from the selection
+    QPoint _dragOrigin; // where the drag started
+    QPoint _dragOffset; // how far the dragged feature is drawn from its bounds, committed on release
+
+    QImage _staticLayer; // every feature in its plain fill, redrawn only after edits
+    Floor* _staticFloor; // the floor _staticLayer was drawn from
+    Feature* _staticExcluded; // the feature left out of _staticLayer because it is being dragged
+    quint64 _staticRevision; // the floor revision _staticLayer was drawn at
+
+    QRegion _damage; // areas to repaint on the next flushDamage()
+    quint64 _knownRevision; // the floor revision after our last repaint request
+    Feature* _hoverFeature; // the feature under the cursor
+    QPoint _editPoint; // the snapped cursor position the preview line ends at
+    QRect _previewRect; // the area covered by the preview line
+
+    qreal _scale; // widget pixels per floor unit
+    QPointF _offset; // widget position of the floor origin
+    QTransform _view; // floor to widget transform built from _scale and _offset
+    QTransform _staticView; // the view _staticLayer was drawn with
+    bool _panning; // dragging the view with the middle button
+
+    bool _hudVisible; // show the performance overlay
+    QRect _hudRect; // the widget area the overlay has covered, repainted with every update
+    int _hudForcedCategories; // bit 0 paint, bit 1 hit test: categories turned on by the overlay
+    qint64 _inputTime; // trace time of the first input event since the last paint, -1 if there is none
+    DrawCounts _lastDraw; // the counts of the last static layer redraw
+    qint64 _hudBaseline[4]; // static layer hits and misses, geometry cache hits and misses when the overlay was shown
+    QPoint _panLast; // the widget position of the last pan event
 
-    QMap<Floor*,QStack<EditorAction>> _undoStack;
-    QMap<Floor*,QQueue<EditorAction>> _redoQueue;
+    EditHistory _history; // undo and redo for every floor
 
 };
 
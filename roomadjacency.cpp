@@ -0,0 +1,143 @@
+#include "roomadjacency.h"
+#include "tracing.h"
+
+#include <QSet>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtMath>
+#include <functional>
+
+using namespace DiagramModels;
+
+RoomAdjacency::RoomAdjacency(Floor *floor, int tolerance):_floor(floor),_tolerance(qMax(0,tolerance)),
+    _built(false),_revision(0){
+}
+
+//! The length of \param a that \param b runs along, measured on a's line only
+static double overlapAlong(const QLine &a, const QLine &b, int tolerance){
+    QPointF d = a.p2() - a.p1();
+    double length = qSqrt(d.x() * d.x() + d.y() * d.y());
+    if(length == 0) return 0;
+    QPointF u = d / length;
+    // b has to lie along a: both its ends within the tolerance of a's line
+    QPointF v1 = b.p1() - a.p1(), v2 = b.p2() - a.p1();
+    if(qAbs(v1.x() * u.y() - v1.y() * u.x()) > tolerance || qAbs(v2.x() * u.y() - v2.y() * u.x()) > tolerance) return 0;
+    double s1 = v1.x() * u.x() + v1.y() * u.y();
+    double s2 = v2.x() * u.x() + v2.y() * u.y();
+    double overlap = qMin(length,qMax(s1,s2)) - qMax(0.0,qMin(s1,s2));
+    // meeting at a corner, or end to end, isn't sharing a wall
+    return overlap > tolerance ? overlap : 0;
+}
+
+double RoomAdjacency::sharedLength(const QLine &a, const QLine &b, int tolerance){
+    // each wall has to lie along the other, and the shorter measure counts, so the order of the walls doesn't matter
+    return qMin(overlapAlong(a,b,tolerance),overlapAlong(b,a,tolerance));
+}
+
+QHash<Feature*,double> RoomAdjacency::sharedWalls(Floor *floor, Feature *feature, int tolerance){
+    QHash<Feature*,double> re;
+    QPolygon bounds = feature->bounds();
+    const SnapIndex& index = floor->snapIndex();
+    for(int i = 0; i < bounds.size(); i++){
+        QLine wall(bounds[i],bounds[(i + 1) % bounds.size()]);
+        for(const QPair<Feature*,QLine>& other : index.edgesNear(wall,tolerance)){
+            if(other.first == feature) continue;
+            double length = sharedLength(wall,other.second,tolerance);
+            if(length > 0) re[other.first] += length;
+        }
+    }
+    TRACE_COUNT(traceSnap,"adjacency walls compared",bounds.size());
+    return re;
+}
+
+void RoomAdjacency::forget(Feature *feature){
+    for(Feature* other : _neighbours.value(feature).keys()){
+        QHash<Feature*,QHash<Feature*,double> >::iterator it = _neighbours.find(other);
+        if(it != _neighbours.end()) it->remove(feature);
+    }
+    _neighbours.remove(feature);
+    _vertexHashes.remove(feature);
+}
+
+void RoomAdjacency::update(){
+    if(_built && _floor->revision() == _revision) return;
+    TRACE_SPAN(traceSnap,"updateAdjacency");
+    QList<Feature*> features = _floor->features();
+
+    // removed features, and the ones whose vertices moved, are compared again; the rest keep their walls
+    QSet<Feature*> present = features.toSet();
+    for(Feature* known : _vertexHashes.keys()){
+        if(!present.contains(known)) forget(known);
+    }
+    QList<Feature*> changed;
+    for(Feature* feature : features){
+        QHash<Feature*,uint>::const_iterator it = _vertexHashes.constFind(feature);
+        if(it == _vertexHashes.constEnd() || it.value() != feature->vertexHash()) changed << feature;
+    }
+    TRACE_COUNT(traceSnap,"adjacency features updated",changed.size());
+    for(Feature* feature : changed) forget(feature);
+    for(Feature* feature : changed){
+        // measured from the changed feature's walls, and the same length recorded on both sides
+        QHash<Feature*,double> walls = sharedWalls(_floor,feature,_tolerance);
+        for(QHash<Feature*,double>::const_iterator it = walls.constBegin(); it != walls.constEnd(); ++it){
+            _neighbours[feature][it.key()] = it.value();
+            _neighbours[it.key()][feature] = it.value();
+        }
+        _vertexHashes.insert(feature,feature->vertexHash());
+    }
+    _revision = _floor->revision();
+    _built = true;
+}
+
+QHash<Feature*,double> RoomAdjacency::neighbours(Feature *feature){
+    update();
+    return _neighbours.value(feature);
+}
+
+QVector<Adjacency> RoomAdjacency::pairs(){
+    update();
+    QVector<Adjacency> re;
+    QList<Feature*> features = _floor->features();
+    QHash<Feature*,int> order;
+    for(int i = 0; i < features.size(); i++) order.insert(features[i],i);
+    for(int i = 0; i < features.size(); i++){
+        QHash<Feature*,double> walls = _neighbours.value(features[i]);
+        for(QHash<Feature*,double>::const_iterator it = walls.constBegin(); it != walls.constEnd(); ++it){
+            if(order.value(it.key(),-1) <= i) continue;
+            Adjacency pair = {features[i],it.key(),it.value()};
+            re << pair;
+        }
+    }
+    return re;
+}
+
+QVector<Adjacency> RoomAdjacency::detect(Floor *floor, int tolerance){
+    TRACE_SPAN(traceSnap,"detectAdjacency");
+    QVector<Adjacency> re;
+    QList<Feature*> features = floor->features();
+    QHash<Feature*,int> order;
+    for(int i = 0; i < features.size(); i++) order.insert(features[i],i);
+    for(int i = 0; i < features.size(); i++){
+        QHash<Feature*,double> walls = sharedWalls(floor,features[i],tolerance);
+        for(QHash<Feature*,double>::const_iterator it = walls.constBegin(); it != walls.constEnd(); ++it){
+            // each pair from its first feature, so it is measured and listed once
+            if(order.value(it.key(),-1) <= i) continue;
+            Adjacency pair = {features[i],it.key(),it.value()};
+            re << pair;
+        }
+    }
+    return re;
+}
+
+QVector<QVector<Adjacency> > RoomAdjacency::detect(Building *building, int tolerance){
+    QList<Floor*> floors = building->floors();
+    std::function<QVector<Adjacency>(Floor*)> floorAdjacency = [tolerance](Floor* floor){
+        return detect(floor,tolerance);
+    };
+    if(Building::singleThreadedLoading()){
+        QVector<QVector<Adjacency> > re;
+        for(Floor* floor : floors) re << floorAdjacency(floor);
+        return re;
+    }
+    // a floor's features and indexes are only touched by its own task
+    return QtConcurrent::blockingMapped<QVector<QVector<Adjacency> > >(floors,floorAdjacency);
+}
@@ -0,0 +1,71 @@
+#ifndef ROOMADJACENCY_H
+#define ROOMADJACENCY_H
+
+#include <QHash>
+#include <QLine>
+#include <QVector>
+
+#include "diagrammodels.h"
+
+//! Two features on a floor that share a wall
+typedef struct{
+    DiagramModels::Feature* first;
+    DiagramModels::Feature* second;
+    double sharedLength;    // the length of wall they share, in floor units
+}Adjacency;
+
+/*!
+ * \brief The RoomAdjacency class finds the features of a floor that share walls
+ *
+ * Two features are adjacent when a wall of one runs along a wall of the other: the ends of each within the
+ * tolerance of the other's line, overlapping by more than the tolerance, so rooms traced either side of a wall
+ * are found and rooms meeting at a corner aren't. Candidate walls come from the floor's SnapIndex edge
+ * grid, so each wall is only compared with the few walls near it.
+ *
+ * An instance keeps the adjacency of one floor up to date: when the floor's revision changes, only the
+ * features whose vertices changed (or that were added or removed) have their walls compared again.
+ * Not thread safe, use it from the thread that edits the floor. detect() works out whole floors, every
+ * floor of a building on the global thread pool.
+ */
+class RoomAdjacency
+{
+public:
+    //! The default tolerance, about the thickness of a wall on a traced floorplan
+    enum{DEFAULT_TOLERANCE = 8};
+
+    explicit RoomAdjacency(DiagramModels::Floor* floor, int tolerance = DEFAULT_TOLERANCE);
+
+    //! The features sharing a wall with \param feature, and the length of wall they share
+    QHash<DiagramModels::Feature*,double> neighbours(DiagramModels::Feature* feature);
+    //! Every pair of adjacent features on the floor, each pair once
+    QVector<Adjacency> pairs();
+
+    //! The adjacent features of \param floor, each pair once
+    static QVector<Adjacency> detect(DiagramModels::Floor* floor, int tolerance = DEFAULT_TOLERANCE);
+    //! The adjacent features of each floor of \param building, in floor order, worked out in parallel
+    static QVector<QVector<Adjacency> > detect(DiagramModels::Building* building, int tolerance = DEFAULT_TOLERANCE);
+
+    //! The length of wall \param a and \param b share, each within \param tolerance of the other's line;
+    //! 0 if they don't share a wall. The same whichever way round the walls are given.
+    static double sharedLength(const QLine& a, const QLine& b, int tolerance);
+
+private:
+    Q_DISABLE_COPY(RoomAdjacency)
+
+    //! Bring the adjacency up to date with the floor
+    void update();
+    //! The features sharing walls with \param feature, found through the floor's edge grid
+    static QHash<DiagramModels::Feature*,double> sharedWalls(DiagramModels::Floor* floor, DiagramModels::Feature* feature,
+                                                             int tolerance);
+    //! Forget the adjacency of \param feature, on both sides
+    void forget(DiagramModels::Feature* feature);
+
+    DiagramModels::Floor* _floor;
+    int _tolerance;
+    bool _built;
+    quint64 _revision;                                                  // the floor revision the adjacency is for
+    QHash<DiagramModels::Feature*,uint> _vertexHashes;                  // of each feature when it was last compared
+    QHash<DiagramModels::Feature*,QHash<DiagramModels::Feature*,double> > _neighbours;
+};
+
+#endif // ROOMADJACENCY_H
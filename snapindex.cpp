@@ -0,0 +1,233 @@
+#include "snapindex.h"
+
+#include <QSet>
+#include <QtMath>
+#include <algorithm>
+
+using namespace DiagramModels;
+
+SnapIndex::SnapIndex(int cellSize):_cellSize(cellSize > 0 ? cellSize : 32){}
+
+int SnapIndex::cell(int v) const{
+    return v >= 0 ? v / _cellSize : -((-v - 1) / _cellSize) - 1;
+}
+
+QVector<QLine> SnapIndex::edges(const QPolygon &bounds){
+    QVector<QLine> re;
+    if(bounds.size() < 2) return re;
+    for(int i = 0; i < bounds.size() - 1; i++){
+        re << QLine(bounds[i],bounds[i+1]);
+    }
+    if(bounds.size() > 2) re << QLine(bounds.last(),bounds.first());
+    return re;
+}
+
+QVector<quint64> SnapIndex::edgeCells(const QLine &line) const{
+    QVector<quint64> keys;
+    QPoint a = line.p1(), b = line.p2();
+    if(a.x() > b.x()) qSwap(a,b);
+    for(int cx = cell(a.x()); cx <= cell(b.x()); cx++){
+        // the part of the segment inside this column of cells
+        double xl = qMax<double>(a.x(),double(cx) * _cellSize);
+        double xr = qMin<double>(b.x(),double(cx + 1) * _cellSize);
+        double yl = a.y(), yr = b.y();
+        if(a.x() != b.x()){
+            double slope = double(b.y() - a.y()) / (b.x() - a.x());
+            yl = a.y() + (xl - a.x()) * slope;
+            yr = a.y() + (xr - a.x()) * slope;
+        }
+        int cy0 = cell(qFloor(qMin(yl,yr)));
+        int cy1 = cell(qCeil(qMax(yl,yr)));
+        for(int cy = cy0; cy <= cy1; cy++){
+            keys << cellKey(cx,cy);
+        }
+    }
+    return keys;
+}
+
+QVector<quint64> SnapIndex::nearbyCells(const QPoint &point, int radius) const{
+    QVector<quint64> keys;
+    for(int cx = cell(point.x() - radius); cx <= cell(point.x() + radius); cx++){
+        for(int cy = cell(point.y() - radius); cy <= cell(point.y() + radius); cy++){
+            keys << cellKey(cx,cy);
+        }
+    }
+    return keys;
+}
+
+void SnapIndex::insert(Feature *feature, const QPolygon &bounds){
+    if(_polygons.contains(feature)) remove(feature);
+    _polygons.insert(feature,bounds);
+    for(const QPoint& p : bounds){
+        VertexRef ref = {feature,p};
+        _vertexCells[cellKey(cell(p.x()),cell(p.y()))] << ref;
+    }
+    for(const QLine& line : edges(bounds)){
+        EdgeRef ref = {feature,line};
+        for(quint64 key : edgeCells(line)){
+            _edgeCells[key] << ref;
+        }
+    }
+}
+
+void SnapIndex::remove(Feature *feature){
+    QHash<Feature*,QPolygon>::iterator it = _polygons.find(feature);
+    if(it == _polygons.end()) return;
+    QPolygon bounds = *it;
+    _polygons.erase(it);
+    for(const QPoint& p : bounds){
+        QHash<quint64,QVector<VertexRef> >::iterator c = _vertexCells.find(cellKey(cell(p.x()),cell(p.y())));
+        if(c == _vertexCells.end()) continue;
+        c->erase(std::remove_if(c->begin(),c->end(),[feature](const VertexRef& r){return r.feature == feature;}),c->end());
+        if(c->isEmpty()) _vertexCells.erase(c);
+    }
+    for(const QLine& line : edges(bounds)){
+        for(quint64 key : edgeCells(line)){
+            QHash<quint64,QVector<EdgeRef> >::iterator c = _edgeCells.find(key);
+            if(c == _edgeCells.end()) continue;
+            c->erase(std::remove_if(c->begin(),c->end(),[feature](const EdgeRef& r){return r.feature == feature;}),c->end());
+            if(c->isEmpty()) _edgeCells.erase(c);
+        }
+    }
+}
+
+void SnapIndex::update(Feature *feature, const QPolygon &bounds){
+    if(!_polygons.contains(feature)) return;
+    if(_polygons.value(feature) == bounds) return;
+    remove(feature);
+    insert(feature,bounds);
+}
+
+void SnapIndex::clear(){
+    _polygons.clear();
+    _vertexCells.clear();
+    _edgeCells.clear();
+}
+
+SnapResult SnapIndex::none(const QPoint &point){
+    SnapResult re = {SNAP_NONE,point,NULL,QLine()};
+    return re;
+}
+
+SnapResult SnapIndex::nearestVertex(const QPoint &point, int radius) const{
+    SnapResult re = none(point);
+    qint64 best = qint64(radius) * radius;
+    for(quint64 key : nearbyCells(point,radius)){
+        QHash<quint64,QVector<VertexRef> >::const_iterator c = _vertexCells.find(key);
+        if(c == _vertexCells.end()) continue;
+        for(const VertexRef& ref : *c){
+            qint64 dx = ref.point.x() - point.x();
+            qint64 dy = ref.point.y() - point.y();
+            qint64 d = dx*dx + dy*dy;
+            if(d <= best){
+                best = d;
+                re.type = SNAP_VERTEX;
+                re.point = ref.point;
+                re.feature = ref.feature;
+            }
+        }
+    }
+    return re;
+}
+
+SnapResult SnapIndex::nearestEdge(const QPoint &point, int radius) const{
+    SnapResult re = none(point);
+    double best = double(radius) * radius;
+    for(quint64 key : nearbyCells(point,radius)){
+        QHash<quint64,QVector<EdgeRef> >::const_iterator c = _edgeCells.find(key);
+        if(c == _edgeCells.end()) continue;
+        for(const EdgeRef& ref : *c){
+            QPointF a = ref.line.p1(), d = ref.line.p2() - ref.line.p1();
+            double len = d.x()*d.x() + d.y()*d.y();
+            double t = len == 0 ? 0 : ((point.x() - a.x())*d.x() + (point.y() - a.y())*d.y()) / len;
+            t = qBound(0.0,t,1.0);
+            QPointF q = a + d*t;
+            double dist = (q.x() - point.x())*(q.x() - point.x()) + (q.y() - point.y())*(q.y() - point.y());
+            if(dist <= best){
+                best = dist;
+                re.type = SNAP_EDGE;
+                re.point = q.toPoint();
+                re.feature = ref.feature;
+                re.edge = ref.line;
+            }
+        }
+    }
+    return re;
+}
+
+SnapResult SnapIndex::perpendicularFoot(const QPoint &anchor, const QPoint &point, int radius) const{
+    SnapResult re = none(point);
+    double best = double(radius) * radius;
+    for(quint64 key : nearbyCells(point,radius)){
+        QHash<quint64,QVector<EdgeRef> >::const_iterator c = _edgeCells.find(key);
+        if(c == _edgeCells.end()) continue;
+        for(const EdgeRef& ref : *c){
+            QPointF a = ref.line.p1(), d = ref.line.p2() - ref.line.p1();
+            double len = d.x()*d.x() + d.y()*d.y();
+            if(len == 0) continue;
+            double t = ((anchor.x() - a.x())*d.x() + (anchor.y() - a.y())*d.y()) / len;
+            if(t < 0 || t > 1) continue;
+            QPointF q = a + d*t;
+            double dist = (q.x() - point.x())*(q.x() - point.x()) + (q.y() - point.y())*(q.y() - point.y());
+            if(dist <= best){
+                best = dist;
+                re.type = SNAP_PERPENDICULAR;
+                re.point = q.toPoint();
+                re.feature = ref.feature;
+                re.edge = ref.line;
+            }
+        }
+    }
+    return re;
+}
+
+SnapResult SnapIndex::snap(const QPoint &point, int radius, const QPoint *anchor) const{
+    SnapResult re = nearestVertex(point,radius);
+    if(re.type != SNAP_NONE) return re;
+    if(anchor){
+        re = perpendicularFoot(*anchor,point,radius);
+        if(re.type != SNAP_NONE) return re;
+    }
+    return nearestEdge(point,radius);
+}
+
+QVector<QPair<Feature*,QLine> > SnapIndex::edgesNear(const QLine &line, int tolerance) const{
+    // the segment's cells, grown by enough rings of cells to cover the tolerance
+    int rings = (qMax(0,tolerance) + _cellSize - 1) / _cellSize;
+    QSet<quint64> keys;
+    for(quint64 key : edgeCells(line)){
+        int cx = int(quint32(key >> 32)), cy = int(quint32(key));
+        for(int dx = -rings; dx <= rings; dx++){
+            for(int dy = -rings; dy <= rings; dy++) keys << cellKey(cx + dx,cy + dy);
+        }
+    }
+    QVector<QPair<Feature*,QLine> > re;
+    for(quint64 key : keys){
+        QHash<quint64,QVector<EdgeRef> >::const_iterator c = _edgeCells.find(key);
+        if(c == _edgeCells.end()) continue;
+        for(const EdgeRef& ref : *c) re << qMakePair(ref.feature,ref.line);
+    }
+    // a wall is listed in every cell it crosses
+    auto less = [](const QPair<Feature*,QLine>& a, const QPair<Feature*,QLine>& b){
+        if(a.first != b.first) return a.first < b.first;
+        if(a.second.x1() != b.second.x1()) return a.second.x1() < b.second.x1();
+        if(a.second.y1() != b.second.y1()) return a.second.y1() < b.second.y1();
+        if(a.second.x2() != b.second.x2()) return a.second.x2() < b.second.x2();
+        return a.second.y2() < b.second.y2();
+    };
+    std::sort(re.begin(),re.end(),less);
+    re.erase(std::unique(re.begin(),re.end()),re.end());
+    return re;
+}
+
+bool SnapIndex::intersect(const QLine &line, const QLine &edge, QPoint *out){
+    QPointF p = line.p1(), r = line.p2() - line.p1();
+    QPointF q = edge.p1(), s = edge.p2() - edge.p1();
+    double denom = r.x()*s.y() - r.y()*s.x();
+    if(qFuzzyIsNull(denom)) return false;
+    QPointF qp = q - p;
+    double u = (qp.x()*r.y() - qp.y()*r.x()) / denom; // position along the edge
+    if(u < 0 || u > 1) return false;
+    if(out) *out = (q + s*u).toPoint();
+    return true;
+}
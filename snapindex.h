@@ -0,0 +1,127 @@
+#ifndef SNAPINDEX_H
+#define SNAPINDEX_H
+
+#include <QHash>
+#include <QLine>
+#include <QPair>
+#include <QPoint>
+#include <QPolygon>
+#include <QVector>
+
+namespace DiagramModels{
+    class Feature;
+
+    //! What a point was snapped to
+    typedef enum{
+        SNAP_NONE,
+        SNAP_VERTEX,        // a corner of a feature
+        SNAP_PERPENDICULAR, // the foot of the perpendicular from the anchor to a wall
+        SNAP_EDGE           // the closest point on a wall
+    }SnapType;
+
+    //! The result of a snap query
+    typedef struct{
+        SnapType type;
+        QPoint point;       // the snapped point, or the query point for SNAP_NONE
+        Feature* feature;   // the feature snapped to
+        QLine edge;         // the wall snapped to, for SNAP_EDGE and SNAP_PERPENDICULAR
+    }SnapResult;
+
+    /*!
+     * \brief The SnapIndex class
+     * Hash grid over the vertices and edges of the features on a floor, so snap
+     * queries only look at the few cells around the cursor
+     */
+    class SnapIndex{
+    public:
+        /*!
+         * \brief SnapIndex constructor
+         * \param cellSize the width and height of a grid cell, about the snapping radius
+         */
+        explicit SnapIndex(int cellSize = 32);
+
+        //! Add the vertices and edges of \param bounds for \param feature
+        void insert(Feature* feature, const QPolygon& bounds);
+        //! Remove everything indexed for \param feature
+        void remove(Feature* feature);
+        //! Replace the geometry of \param feature with \param bounds, ignored if the feature is not indexed
+        void update(Feature* feature, const QPolygon& bounds);
+        //! Remove every feature from the index
+        void clear();
+
+        /*!
+         * \brief nearestVertex find the closest feature corner
+         * \param point
+         * \param radius the maximum distance to snap
+         * \return a SNAP_VERTEX result, or SNAP_NONE if nothing is in range
+         */
+        SnapResult nearestVertex(const QPoint& point, int radius) const;
+        /*!
+         * \brief nearestEdge find the closest point on any wall
+         * \param point
+         * \param radius the maximum distance to snap
+         * \return a SNAP_EDGE result, or SNAP_NONE if nothing is in range
+         */
+        SnapResult nearestEdge(const QPoint& point, int radius) const;
+        /*!
+         * \brief perpendicularFoot find a wall near point that a line from anchor would meet at a right angle
+         * \param anchor the start of the line being drawn
+         * \param point
+         * \param radius the maximum distance between point and the foot
+         * \return a SNAP_PERPENDICULAR result, or SNAP_NONE if nothing is in range
+         */
+        SnapResult perpendicularFoot(const QPoint& anchor, const QPoint& point, int radius) const;
+        /*!
+         * \brief snap pick the best snap, preferring vertices, then perpendicular feet, then edges
+         * \param point
+         * \param radius
+         * \param anchor the start of the line being drawn, if any
+         * \return the snap result
+         */
+        SnapResult snap(const QPoint& point, int radius, const QPoint* anchor = 0) const;
+
+        /*!
+         * \brief edgesNear find the walls indexed in the cells within tolerance of a segment
+         * A coarse filter: every wall within \param tolerance of \param line is returned, and some further away
+         * \return each wall once, with its feature
+         */
+        QVector<QPair<Feature*,QLine> > edgesNear(const QLine& line, int tolerance) const;
+
+        /*!
+         * \brief intersect intersect the infinite line through \param line with the segment \param edge
+         * \param out the intersection
+         * \return false if the line misses the segment or is parallel to it
+         */
+        static bool intersect(const QLine& line, const QLine& edge, QPoint* out);
+
+    private:
+        typedef struct{
+            Feature* feature;
+            QPoint point;
+        }VertexRef;
+        typedef struct{
+            Feature* feature;
+            QLine line;
+        }EdgeRef;
+
+        int cell(int v) const;
+        static quint64 cellKey(int cx, int cy){
+            return (quint64(quint32(cx)) << 32) | quint32(cy);
+        }
+        //! The cells a segment passes through
+        QVector<quint64> edgeCells(const QLine& line) const;
+        //! The edges of a polygon, closing back to the first point
+        static QVector<QLine> edges(const QPolygon& bounds);
+        //! The cells covering the square of \param radius around \param point
+        QVector<quint64> nearbyCells(const QPoint& point, int radius) const;
+        static SnapResult none(const QPoint& point);
+
+    private:
+        int _cellSize; //! The size of a grid cell
+        QHash<Feature*,QPolygon> _polygons; //! The geometry each feature was indexed with
+        QHash<quint64,QVector<VertexRef> > _vertexCells; //! Vertices per cell
+        QHash<quint64,QVector<EdgeRef> > _edgeCells; //! Edges passing through each cell
+    };
+}
+
+#endif // SNAPINDEX_H
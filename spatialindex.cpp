@@ -0,0 +1,114 @@
+#include "spatialindex.h"
+
+#include <QSet>
+#include <algorithm>
+
+using namespace DiagramModels;
+
+SpatialIndex::SpatialIndex(int cellSize):_cellSize(cellSize > 0 ? cellSize : 128),_nextOrder(0){}
+
+int SpatialIndex::cell(int v) const{
+    return v >= 0 ? v / _cellSize : -((-v - 1) / _cellSize) - 1;
+}
+
+void SpatialIndex::addToCells(Feature *feature, const QRect &rect){
+    if(rect.isEmpty()) return;
+    for(int cx = cell(rect.left()); cx <= cell(rect.right()); cx++){
+        for(int cy = cell(rect.top()); cy <= cell(rect.bottom()); cy++){
+            _cells[cellKey(cx,cy)] << feature;
+        }
+    }
+}
+
+void SpatialIndex::removeFromCells(Feature *feature, const QRect &rect){
+    if(rect.isEmpty()) return;
+    for(int cx = cell(rect.left()); cx <= cell(rect.right()); cx++){
+        for(int cy = cell(rect.top()); cy <= cell(rect.bottom()); cy++){
+            QHash<quint64,QVector<Feature*> >::iterator it = _cells.find(cellKey(cx,cy));
+            if(it == _cells.end()) continue;
+            it->removeOne(feature);
+            if(it->isEmpty()) _cells.erase(it);
+        }
+    }
+}
+
+void SpatialIndex::insert(Feature *feature, const QRect &rect){
+    if(_entries.contains(feature)){
+        update(feature,rect);
+        return;
+    }
+    Entry entry = {rect,_nextOrder++};
+    _entries.insert(feature,entry);
+    addToCells(feature,rect);
+}
+
+void SpatialIndex::remove(Feature *feature){
+    QHash<Feature*,Entry>::iterator it = _entries.find(feature);
+    if(it == _entries.end()) return;
+    removeFromCells(feature,it->rect);
+    _entries.erase(it);
+}
+
+void SpatialIndex::update(Feature *feature, const QRect &rect){
+    QHash<Feature*,Entry>::iterator it = _entries.find(feature);
+    if(it == _entries.end() || it->rect == rect) return;
+    removeFromCells(feature,it->rect);
+    it->rect = rect;
+    addToCells(feature,rect);
+}
+
+QRect SpatialIndex::bounds() const{
+    QRect re;
+    for(QHash<Feature*,Entry>::const_iterator it = _entries.begin(); it != _entries.end(); ++it){
+        re |= it->rect;
+    }
+    return re;
+}
+
+void SpatialIndex::clear(){
+    _entries.clear();
+    _cells.clear();
+    _nextOrder = 0;
+}
+
+QList<Feature*> SpatialIndex::ordered(QList<Feature *> features) const{
+    std::sort(features.begin(),features.end(),[this](Feature* a, Feature* b){
+        return _entries.value(a).order < _entries.value(b).order;
+    });
+    return features;
+}
+
+QList<Feature*> SpatialIndex::query(const QPoint &point) const{
+    QList<Feature*> re;
+    QVector<Feature*> candidates = _cells.value(cellKey(cell(point.x()),cell(point.y())));
+    for(Feature* f : candidates){
+        if(_entries.value(f).rect.contains(point)) re << f;
+    }
+    return ordered(re);
+}
+
+QList<Feature*> SpatialIndex::query(const QRect &rect) const{
+    QList<Feature*> re;
+    if(rect.isEmpty()) return re;
+    qint64 cellCount = qint64(cell(rect.right()) - cell(rect.left()) + 1) * (cell(rect.bottom()) - cell(rect.top()) + 1);
+    if(cellCount >= _entries.size()){
+        // the rect covers more cells than there are features, a straight scan is cheaper
+        for(QHash<Feature*,Entry>::const_iterator it = _entries.begin(); it != _entries.end(); ++it){
+            if(it->rect.intersects(rect)) re << it.key();
+        }
+        return ordered(re);
+    }
+    QSet<Feature*> seen;
+    for(int cx = cell(rect.left()); cx <= cell(rect.right()); cx++){
+        for(int cy = cell(rect.top()); cy <= cell(rect.bottom()); cy++){
+            QHash<quint64,QVector<Feature*> >::const_iterator it = _cells.find(cellKey(cx,cy));
+            if(it == _cells.end()) continue;
+            for(Feature* f : *it){
+                if(seen.contains(f)) continue;
+                seen << f;
+                if(_entries.value(f).rect.intersects(rect)) re << f;
+            }
+        }
+    }
+    return ordered(re);
+}
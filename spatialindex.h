@@ -0,0 +1,80 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+
+namespace DiagramModels{
+    class Feature;
+
+    /*!
+     * \brief The SpatialIndex class
+     * A uniform grid over the bounding boxes of the features on a floor.
+     * Used to answer point and rectangle queries without scanning every feature.
+     */
+    class SpatialIndex{
+    public:
+        /*!
+         * \brief SpatialIndex constructor
+         * \param cellSize the width and height of a grid cell in floor coordinates
+         */
+        explicit SpatialIndex(int cellSize = 128);
+
+        //! Add \param feature to the index with the bounding box \param rect
+        void insert(Feature* feature, const QRect& rect);
+        //! Remove \param feature from the index
+        void remove(Feature* feature);
+        //! Move \param feature to its new bounding box \param rect, ignored if the feature is not indexed
+        void update(Feature* feature, const QRect& rect);
+        //! Remove every feature from the index
+        void clear();
+
+        //! If \param feature is in the index
+        bool contains(Feature* feature) const{return _entries.contains(feature);}
+        //! The number of indexed features
+        int size() const{return _entries.size();}
+        //! The union of every indexed bounding box
+        QRect bounds() const;
+
+        /*!
+         * \brief query find the features whose bounding box contains a point
+         * \param point
+         * \return the candidate features, in the order they were inserted
+         */
+        QList<Feature*> query(const QPoint& point) const;
+        /*!
+         * \brief query find the features whose bounding box intersects a rectangle
+         * \param rect
+         * \return the candidate features, in the order they were inserted
+         */
+        QList<Feature*> query(const QRect& rect) const;
+
+    private:
+        typedef struct{
+            QRect rect;
+            quint64 order;
+        }Entry;
+
+        //! The grid cell containing the coordinate \param v
+        int cell(int v) const;
+        //! The hash key for the cell at \param cx, \param cy
+        static quint64 cellKey(int cx, int cy){
+            return (quint64(quint32(cx)) << 32) | quint32(cy);
+        }
+        void addToCells(Feature* feature, const QRect& rect);
+        void removeFromCells(Feature* feature, const QRect& rect);
+        //! Sort \param features by insertion order
+        QList<Feature*> ordered(QList<Feature*> features) const;
+
+    private:
+        int _cellSize; //! The size of a grid cell
+        quint64 _nextOrder; //! Insertion counter, keeps query results in floor order
+        QHash<Feature*,Entry> _entries; //! The indexed features
+        QHash<quint64,QVector<Feature*> > _cells; //! The features overlapping each grid cell
+    };
+}
+
+#endif // SPATIALINDEX_H
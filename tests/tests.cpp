@@ -0,0 +1,653 @@
+#include <QtTest>
+#include <QBuffer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QXmlStreamReader>
+
+#include "diagrammodels.h"
+#include "binaryformat.h"
+#include "bytestream.h"
+#include "edithistory.h"
+#include "editjournal.h"
+#include "filereader.h"
+#include "filewriter.h"
+#include "jsonstreamreader.h"
+#include "roomadjacency.h"
+
+using namespace DiagramModels;
+
+/*!
+ * \brief The Tests class checks the exports, the file formats, the journal, the undo history and the geometry queries
+ * on small hand made buildings
+ */
+class Tests : public QObject
+{
+    Q_OBJECT
+private slots:
+    void geoJsonWinding_data();
+    void geoJsonWinding();
+    void osmExport();
+    void sharedLengthSymmetric_data();
+    void sharedLengthSymmetric();
+    void adjacencyUpdate();
+    void binaryRoundTrip();
+    void binaryRejects_data();
+    void binaryRejects();
+    void binaryLazyDamage();
+    void jsonErrorOffset_data();
+    void jsonErrorOffset();
+    void readJsonError();
+    void journalReplay();
+    void journalTornTail();
+    void journalStale();
+    void historyMergesMoves();
+    void historyEvictsAcrossFloors();
+    void historyOwnsRemovedFeatures();
+
+private:
+    //! A one floor building of \param bounds, each a room
+    static Building* building(const QList<QPolygon>& bounds);
+    //! A rectangular room's bounds
+    static QPolygon rect(int x, int y, int width, int height);
+    //! \param pairs keyed by their features, to compare lists found in different orders
+    static QMap<QPair<Feature*,Feature*>,double> byFeatures(const QVector<Adjacency>& pairs);
+    //! Three floors of named rooms and stairs, one of them empty, with a staircase connection between the others
+    static Building* sample();
+    //! The first way \param a and \param b differ in names, floors, features or connections, empty if they don't
+    static QString difference(Building* a, Building* b);
+    //! The contents of \param path, empty if it can't be read
+    static QByteArray readFile(const QString& path);
+    //! The number of whole records in the journal of \param basePath
+    static int journalRecords(const QString& basePath);
+};
+
+Building* Tests::building(const QList<QPolygon> &bounds){
+    Floor* floor = new Floor(0,"Ground");
+    for(const QPolygon& polygon : bounds) floor->addFeature(new Feature(ROOM,polygon,floor));
+    return new Building("Test",QList<Floor*>() << floor);
+}
+
+QPolygon Tests::rect(int x, int y, int width, int height){
+    QPolygon re;
+    re << QPoint(x,y) << QPoint(x + width,y) << QPoint(x + width,y + height) << QPoint(x,y + height);
+    return re;
+}
+
+QMap<QPair<Feature*,Feature*>,double> Tests::byFeatures(const QVector<Adjacency> &pairs){
+    QMap<QPair<Feature*,Feature*>,double> re;
+    for(const Adjacency& pair : pairs){
+        re.insert(pair.first < pair.second ? qMakePair(pair.first,pair.second) : qMakePair(pair.second,pair.first),
+                  pair.sharedLength);
+    }
+    return re;
+}
+
+Building* Tests::sample(){
+    Floor* ground = new Floor(0,"Ground");
+    Feature* hall = new Feature(ROOM,rect(0,0,400,200),ground);
+    hall->name("Hall");
+    Feature* office = new Feature(ROOM,rect(400,0,200,200),ground);
+    office->name("Office");
+    Feature* stairs = new Feature(STAIRS,rect(0,200,100,100),ground);
+    stairs->name("Stairs");
+    ground->addFeature(hall);
+    ground->addFeature(office);
+    ground->addFeature(stairs);
+    Floor* first = new Floor(1,"First");
+    Feature* landing = new Feature(STAIRS,rect(0,200,100,100),first);
+    landing->name("Stairs");
+    QPolygon lShape;
+    lShape << QPoint(-300,-50) << QPoint(100,-50) << QPoint(100,150) << QPoint(-100,150) << QPoint(-100,400) << QPoint(-300,400);
+    Feature* wing = new Feature(ROOM,lShape,first);
+    wing->name("West wing");
+    first->addFeature(landing);
+    first->addFeature(wing);
+    stairs->addConnection(1,0);
+    landing->addConnection(0,2);
+    return new Building("Sample",QList<Floor*>() << ground << first << new Floor(2,"Roof"));
+}
+
+QString Tests::difference(Building *a, Building *b){
+    if(a->name() != b->name()) return QString("building \"%1\" is \"%2\"").arg(a->name()).arg(b->name());
+    if(a->floorCount() != b->floorCount()) return QString("%1 floors are %2").arg(a->floorCount()).arg(b->floorCount());
+    for(int f = 0; f < a->floorCount(); f++){
+        Floor* fa = a->floors()[f];
+        Floor* fb = b->floors()[f];
+        if(fa->name() != fb->name()) return QString("floor %1 \"%2\" is \"%3\"").arg(f).arg(fa->name()).arg(fb->name());
+        QList<Feature*> features = fa->features(), others = fb->features();
+        if(features.size() != others.size()){
+            return QString("floor %1 has %2 features, not %3").arg(f).arg(others.size()).arg(features.size());
+        }
+        for(int i = 0; i < features.size(); i++){
+            Feature* x = features[i];
+            Feature* y = others[i];
+            QString where = QString("floor %1 feature %2").arg(f).arg(i);
+            if(x->name() != y->name()) return where + QString(" \"%1\" is \"%2\"").arg(x->name()).arg(y->name());
+            if(x->type() != y->type()) return where + " changed type";
+            if(x->bounds() != y->bounds()) return where + " changed bounds";
+            if(x->connections() != y->connections()) return where + " changed connections";
+        }
+    }
+    return QString();
+}
+
+QByteArray Tests::readFile(const QString &path){
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)) return QByteArray();
+    return file.readAll();
+}
+
+int Tests::journalRecords(const QString &basePath){
+    QByteArray data = readFile(EditJournal::journalPath(basePath));
+    // past the header: magic, version, flags, building file size and time
+    ByteReader in(data,4 + 2 + 2 + 8 + 8,data.size());
+    int records = 0;
+    while(in.ok() && in.pos() < data.size()){
+        in.bytes(int(in.varint()));
+        in.u16();
+        if(in.ok()) records++;
+    }
+    return records;
+}
+
+void Tests::geoJsonWinding_data(){
+    QTest::addColumn<QPolygon>("bounds");
+    QPolygon square;
+    square << QPoint(0,0) << QPoint(100,0) << QPoint(100,100) << QPoint(0,100);
+    QPolygon reversed;
+    for(int i = square.size() - 1; i >= 0; i--) reversed << square[i];
+    QTest::newRow("clockwise on the plan") << square;
+    QTest::newRow("counterclockwise on the plan") << reversed;
+}
+
+void Tests::geoJsonWinding(){
+    QFETCH(QPolygon,bounds);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("square.geojson");
+    Building* b = building(QList<QPolygon>() << bounds);
+    QString error;
+    bool exported = FileWriter::exportTo(b,path,GEOJSON,&error);
+    delete b;
+    QVERIFY2(exported,qPrintable(error));
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QJsonArray features = QJsonDocument::fromJson(file.readAll()).object().value("features").toArray();
+    QCOMPARE(features.size(),1);
+    QJsonArray ring = features[0].toObject().value("geometry").toObject().value("coordinates").toArray()[0].toArray();
+    QCOMPARE(ring.size(),bounds.size() + 1);
+    QCOMPARE(ring.first(),ring.last());
+
+    // RFC 7946: the outer ring is counterclockwise, a positive area with longitude as x and latitude as y
+    double area = 0;
+    for(int i = 0; i + 1 < ring.size(); i++){
+        QJsonArray a = ring[i].toArray(), c = ring[i + 1].toArray();
+        area += a[0].toDouble() * c[1].toDouble() - c[0].toDouble() * a[1].toDouble();
+    }
+    QVERIFY(area > 0);
+}
+
+void Tests::osmExport(){
+    // floor indexes that differ from the positions, connections refer to positions
+    Floor* ground = new Floor(5,"Ground");
+    ground->addFeature(new Feature(ROOM,rect(0,0,100,100),ground));
+    ground->addFeature(new Feature(ROOM,rect(100,0,100,100),ground));
+    Floor* first = new Floor(7,"First");
+    first->addFeature(new Feature(STAIRS,rect(0,0,50,50),first));
+    ground->features()[0]->addConnection(1,0);
+    first->features()[0]->addConnection(0,0);
+    Building b("Test",QList<Floor*>() << ground << first);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("building.xml");
+    QString error;
+    QVERIFY2(FileWriter::exportTo(&b,path,OSM,&error),qPrintable(error));
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QXmlStreamReader xml(&file);
+    QSet<QString> nodes;
+    QStringList refs;
+    int ways = 0, relations = 0;
+    while(!xml.atEnd()){
+        if(xml.readNext() != QXmlStreamReader::StartElement) continue;
+        if(xml.name() == "node") nodes << xml.attributes().value("id").toString();
+        else if(xml.name() == "way") ways++;
+        else if(xml.name() == "relation") relations++;
+        else if(xml.name() == "nd") refs << xml.attributes().value("ref").toString();
+    }
+    QVERIFY2(!xml.hasError(),qPrintable(QString("%1 at line %2").arg(xml.errorString()).arg(xml.lineNumber())));
+    // the two rooms share a wall, so two of their corners
+    QCOMPARE(nodes.size(),6 + 4);
+    QCOMPARE(ways,3);
+    // a level per floor and the one staircase connection, written once for both ends
+    QCOMPARE(relations,2 + 1);
+    for(const QString& ref : refs) QVERIFY2(nodes.contains(ref),qPrintable(ref));
+}
+
+void Tests::sharedLengthSymmetric_data(){
+    QTest::addColumn<QLine>("a");
+    QTest::addColumn<QLine>("b");
+    QTest::addColumn<double>("expected");
+    QTest::newRow("same wall") << QLine(0,0,100,0) << QLine(100,0,0,0) << 100.0;
+    QTest::newRow("short along long") << QLine(20,0,60,0) << QLine(0,0,100,0) << 40.0;
+    QTest::newRow("offset within tolerance") << QLine(0,0,100,0) << QLine(50,5,150,5) << 50.0;
+    QTest::newRow("end to end") << QLine(0,0,100,0) << QLine(100,0,200,0) << 0.0;
+    // a short wall that is nearly on the long one's line, while the long one's ends are far off the short one's
+    QTest::newRow("short wall at an angle") << QLine(0,0,20,4) << QLine(-200,0,200,0) << 0.0;
+    QTest::newRow("across") << QLine(0,0,100,0) << QLine(50,-50,50,50) << 0.0;
+}
+
+void Tests::sharedLengthSymmetric(){
+    QFETCH(QLine,a);
+    QFETCH(QLine,b);
+    QFETCH(double,expected);
+    double ab = RoomAdjacency::sharedLength(a,b,RoomAdjacency::DEFAULT_TOLERANCE);
+    double ba = RoomAdjacency::sharedLength(b,a,RoomAdjacency::DEFAULT_TOLERANCE);
+    QCOMPARE(ab,ba);
+    QVERIFY(qAbs(ab - expected) < 0.5);
+}
+
+void Tests::adjacencyUpdate(){
+    // a row of three rooms with a gap before the last
+    Building* b = building(QList<QPolygon>() << rect(0,0,100,100) << rect(100,0,100,100) << rect(300,0,100,100));
+    Floor* floor = b->floors().first();
+    QList<Feature*> rooms = floor->features();
+    RoomAdjacency adjacency(floor);
+    QCOMPARE(byFeatures(adjacency.pairs()),byFeatures(RoomAdjacency::detect(floor)));
+    QCOMPARE(adjacency.pairs().size(),1);
+
+    // each move is followed incrementally and has to match working the floor out afresh
+    QList<QPolygon> moves;
+    moves << rect(204,0,100,100)    // the last room closes the gap, within the tolerance
+          << rect(0,50,100,100)     // the first room slides half off its neighbour
+          << rect(0,200,100,100)    // and away from it altogether
+          << rect(100,100,100,100); // then under the middle room
+    QList<Feature*> moved;
+    moved << rooms[2] << rooms[0] << rooms[0] << rooms[0];
+    for(int i = 0; i < moves.size(); i++){
+        moved[i]->bounds(moves[i]);
+        QCOMPARE(byFeatures(adjacency.pairs()),byFeatures(RoomAdjacency::detect(floor)));
+    }
+    QCOMPARE(adjacency.neighbours(rooms[1]).value(rooms[0]),100.0);
+    QCOMPARE(adjacency.neighbours(rooms[0]).value(rooms[1]),100.0);
+    delete b;
+}
+
+void Tests::binaryRoundTrip(){
+    Building* original = sample();
+    QString error;
+    Building* decoded = BinaryFormat::decode(BinaryFormat::encode(original),&error);
+    QVERIFY2(decoded,qPrintable(error));
+    QString diff = difference(original,decoded);
+    QVERIFY2(diff.isEmpty(),qPrintable(diff));
+    delete decoded;
+
+    // and through a file, with the floors decoded on first use
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("sample.bldg");
+    QVERIFY2(FileWriter::write(original,path,BLDG_BINARY,&error),qPrintable(error));
+    Building* opened = BinaryFormat::open(path,&error);
+    QVERIFY2(opened,qPrintable(error));
+    QCOMPARE(opened->floors()[0]->featureCount(),3);
+    QVERIFY(!opened->floors()[0]->isLoaded());
+    diff = difference(original,opened);
+    QVERIFY2(diff.isEmpty(),qPrintable(diff));
+    delete opened;
+    delete original;
+}
+
+void Tests::binaryRejects_data(){
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<QString>("expected");
+    Building* b = sample();
+    QByteArray data = BinaryFormat::encode(b);
+    delete b;
+    BinaryFormat::Directory directory;
+    QVERIFY(BinaryFormat::readDirectory(data,&directory));
+
+    QTest::newRow("not a building") << QByteArray("{\"name\": \"Sample\"}") << "Not a binary building file";
+    QTest::newRow("truncated header") << data.left(13) << "Truncated header";
+    QTest::newRow("truncated chunk") << data.left(data.size() - 1) << "runs past the end of the file";
+    QByteArray damaged = data;
+    damaged[int(directory.floors[1].offset) + 2] = damaged[int(directory.floors[1].offset) + 2] ^ 0x5a;
+    QTest::newRow("bad checksum") << damaged << "Floor 1 chunk";
+}
+
+void Tests::binaryRejects(){
+    QFETCH(QByteArray,data);
+    QFETCH(QString,expected);
+    QString error;
+    Building* b = BinaryFormat::decode(data,&error);
+    QVERIFY(!b);
+    QVERIFY2(error.contains(expected),qPrintable(error));
+}
+
+void Tests::binaryLazyDamage(){
+    // a damaged chunk only shows once its floor is decoded, the floor then fails and the building can't be saved over
+    Building* b = sample();
+    QByteArray data = BinaryFormat::encode(b);
+    delete b;
+    BinaryFormat::Directory directory;
+    QVERIFY(BinaryFormat::readDirectory(data,&directory));
+    data[int(directory.floors[1].offset)] = data[int(directory.floors[1].offset)] ^ 0x5a;
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("damaged.bldg");
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(data);
+    file.close();
+
+    QString error;
+    Building* opened = BinaryFormat::open(path,&error);
+    QVERIFY2(opened,qPrintable(error));
+    QVERIFY(!opened->floors()[0]->loadFailed());
+    QVERIFY(opened->floors()[1]->loadFailed());
+    QVERIFY(opened->floors()[1]->loadError().contains("checksum"));
+    QCOMPARE(opened->floors()[1]->featureCount(),0);
+    QVERIFY(opened->loadFailed());
+    QVERIFY(!FileWriter::write(opened,path,&error));
+    delete opened;
+    QFile unchanged(path);
+    QVERIFY(unchanged.open(QIODevice::ReadOnly));
+    QCOMPARE(unchanged.readAll(),data);
+}
+
+void Tests::jsonErrorOffset_data(){
+    QTest::addColumn<QByteArray>("document");
+    QTest::addColumn<qint64>("offset");
+    QTest::addColumn<QString>("expected");
+    QTest::newRow("trailing comma") << QByteArray("{\"a\": 1,}") << qint64(8) << "Expected an object key";
+    QTest::newRow("unclosed array") << QByteArray("[1, 2") << qint64(5) << "Expected ',' or the end of the array";
+    QTest::newRow("bad value") << QByteArray("{\"a\": @}") << qint64(6) << "Unexpected character '@'";
+    QTest::newRow("data after the end") << QByteArray("{} x") << qint64(3) << "Unexpected data after the end";
+    QTest::newRow("unterminated string") << QByteArray("[\"abc") << qint64(5) << "Unterminated string";
+    // past the first block read from the device
+    QTest::newRow("second block") << QByteArray("[" + QByteArray("1,").repeated(40000) + "@]") << qint64(80001)
+                                  << "Unexpected character '@'";
+}
+
+void Tests::jsonErrorOffset(){
+    QFETCH(QByteArray,document);
+    QFETCH(qint64,offset);
+    QFETCH(QString,expected);
+    QBuffer buffer(&document);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+    JsonStreamReader reader(&buffer);
+    JsonStreamReader::TokenType token;
+    int tokens = 0;
+    do{
+        token = reader.readNext();
+        tokens++;
+    }while(token != JsonStreamReader::Invalid && token != JsonStreamReader::EndDocument && tokens < 100000);
+    QCOMPARE(token,JsonStreamReader::Invalid);
+    QVERIFY(reader.hasError());
+    QVERIFY2(reader.errorString().contains(expected),qPrintable(reader.errorString()));
+    QCOMPARE(reader.errorOffset(),offset);
+    // an invalid reader stays invalid
+    QCOMPARE(reader.readNext(),JsonStreamReader::Invalid);
+    QCOMPARE(reader.errorOffset(),offset);
+}
+
+void Tests::readJsonError(){
+    QByteArray document("{\"name\": \"x\", \"floors\": 3}");
+    QBuffer buffer(&document);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+    QString error;
+    Building* b = FileReader::readJson(&buffer,&error);
+    QVERIFY(!b);
+    QCOMPARE(error,QString("Building floors must be an array at byte 25"));
+}
+
+void Tests::journalReplay(){
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("plan.bldg");
+    QString error;
+    Building* original = sample();
+    QVERIFY2(FileWriter::write(original,path,BLDG_BINARY,&error),qPrintable(error));
+    delete original;
+
+    Building* edited = FileReader::loadBuidling(path,&error,false);
+    QVERIFY2(edited,qPrintable(error));
+    {
+        EditJournal journal(edited,path);
+        Floor* ground = edited->floors()[0];
+        Floor* first = edited->floors()[1];
+        Floor* roof = edited->floors()[2];
+        Feature* hall = ground->features()[0];
+        // a drag is one record however many steps it takes
+        for(int width = 300; width <= 400; width += 10) hall->bounds(rect(0,0,width,180));
+        ground->features()[1]->name("Meeting room");
+        // not the same drag, another record came in between
+        hall->bounds(rect(0,0,400,150));
+        Feature* plant = new Feature(ROOM,rect(0,0,50,50),roof);
+        plant->name("Plant");
+        roof->addFeature(plant);
+        Feature* wing = first->features()[1];
+        first->removeFeature(wing);
+        delete wing;
+        ground->name("Lobby");
+        QVERIFY(journal.hasUnsavedEdits());
+        QVERIFY2(journal.save(&error),qPrintable(error));
+        QVERIFY(!journal.hasUnsavedEdits());
+    }
+    QCOMPARE(journalRecords(path),6);
+
+    Building* replayed = BinaryFormat::decode(readFile(path),&error);
+    QVERIFY2(replayed,qPrintable(error));
+    QVERIFY2(EditJournal::replay(replayed,path,&error),qPrintable(error));
+    QString diff = difference(edited,replayed);
+    QVERIFY2(diff.isEmpty(),qPrintable(diff));
+    QCOMPARE(replayed->floors()[0]->features()[0]->bounds(),rect(0,0,400,150));
+    delete replayed;
+    delete edited;
+}
+
+void Tests::journalTornTail(){
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("plan.bldg");
+    QString error;
+    Building* original = sample();
+    QVERIFY2(FileWriter::write(original,path,BLDG_BINARY,&error),qPrintable(error));
+    delete original;
+
+    Building* edited = FileReader::loadBuidling(path,&error,false);
+    QVERIFY2(edited,qPrintable(error));
+    {
+        EditJournal journal(edited,path);
+        edited->floors()[0]->features()[0]->name("Atrium");
+        QVERIFY2(journal.save(&error),qPrintable(error));
+    }
+    // a crash part way through the next append: a length of 10 with only 2 bytes after it
+    int saved = readFile(EditJournal::journalPath(path)).size();
+    QFile file(EditJournal::journalPath(path));
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Append));
+    file.write(QByteArray("\x0a\x03\x01",3));
+    file.close();
+
+    Building* replayed = BinaryFormat::decode(readFile(path),&error);
+    QVERIFY2(replayed,qPrintable(error));
+    QVERIFY(!EditJournal::replay(replayed,path,&error));
+    QCOMPARE(error,QString("The journal is damaged at byte %1").arg(saved));
+    QString diff = difference(edited,replayed);
+    QVERIFY2(diff.isEmpty(),qPrintable(diff));
+
+    // the next journal drops the tail before appending, or its records would be lost behind it
+    {
+        EditJournal journal(replayed,path);
+        replayed->floors()[2]->name("Plant room");
+        QVERIFY2(journal.save(&error),qPrintable(error));
+    }
+    QCOMPARE(journalRecords(path),2);
+    Building* again = BinaryFormat::decode(readFile(path),&error);
+    QVERIFY2(again,qPrintable(error));
+    QVERIFY2(EditJournal::replay(again,path,&error),qPrintable(error));
+    diff = difference(replayed,again);
+    QVERIFY2(diff.isEmpty(),qPrintable(diff));
+    delete again;
+    delete replayed;
+    delete edited;
+}
+
+void Tests::journalStale(){
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("plan.bldg");
+    QString error;
+    Building* original = sample();
+    QVERIFY2(FileWriter::write(original,path,BLDG_BINARY,&error),qPrintable(error));
+    delete original;
+
+    Building* edited = FileReader::loadBuidling(path,&error,false);
+    QVERIFY2(edited,qPrintable(error));
+    {
+        EditJournal journal(edited,path);
+        edited->floors()[0]->features()[0]->name("Atrium");
+        QVERIFY2(journal.save(&error),qPrintable(error));
+    }
+    delete edited;
+
+    // the building file saved over by something that didn't know about the journal
+    Building* rewritten = sample();
+    rewritten->floors()[1]->name("First floor, rebuilt");
+    QVERIFY2(FileWriter::write(rewritten,path,BLDG_BINARY,&error),qPrintable(error));
+
+    Building* replayed = BinaryFormat::decode(readFile(path),&error);
+    QVERIFY2(replayed,qPrintable(error));
+    QVERIFY(!EditJournal::replay(replayed,path,&error));
+    QVERIFY2(error.contains("different version"),qPrintable(error));
+    QString diff = difference(rewritten,replayed);
+    QVERIFY2(diff.isEmpty(),qPrintable(diff));
+    delete replayed;
+    delete rewritten;
+}
+
+void Tests::historyMergesMoves(){
+    Building* b = building(QList<QPolygon>() << rect(0,0,100,100) << rect(100,0,100,100));
+    Floor* floor = b->floors()[0];
+    Feature* dragged = floor->features()[0];
+    Feature* other = floor->features()[1];
+    EditHistory history;
+    // a drag as the view records it, the feature moved first and the step pushed after
+    for(int i = 0; i < 3; i++){
+        dragged->bounds(dragged->bounds().translated(10,5));
+        EditCommand move = {CMD_MOVE,floor,dragged,NULL,QPoint(10,5)};
+        history.push(move);
+    }
+    QCOMPARE(history.count(),1);
+    QCOMPARE(history.peekUndo(floor)->point,QPoint(30,15));
+
+    other->bounds(other->bounds().translated(0,20));
+    EditCommand moveOther = {CMD_MOVE,floor,other,NULL,QPoint(0,20)};
+    history.push(moveOther);
+    QCOMPARE(history.count(),2);
+    // a move of the first feature again doesn't merge across the other one
+    dragged->bounds(dragged->bounds().translated(-5,0));
+    EditCommand moveBack = {CMD_MOVE,floor,dragged,NULL,QPoint(-5,0)};
+    history.push(moveBack);
+    QCOMPARE(history.count(),3);
+
+    EditCommand command;
+    while(history.undo(floor,&command)) QCOMPARE(command.type,CMD_MOVE);
+    QCOMPARE(dragged->bounds(),rect(0,0,100,100));
+    QCOMPARE(other->bounds(),rect(100,0,100,100));
+    QVERIFY(!history.canUndo(floor));
+    QCOMPARE(history.count(),3);
+    delete b;
+}
+
+void Tests::historyEvictsAcrossFloors(){
+    Floor* a = new Floor(0,"A");
+    Floor* b = new Floor(1,"B");
+    Building* twoFloors = new Building("Two floors",QList<Floor*>() << a << b);
+    EditHistory history;
+    EditCommand a1 = {CMD_SELECT,a,NULL,NULL,QPoint(1,0)};
+    history.push(a1);
+    // a command holding no feature, the unit the limit is set in
+    qint64 unit = history.memoryUsage();
+    QVERIFY(unit > 0);
+    history.setByteLimit(3 * unit);
+    EditCommand b1 = {CMD_SELECT,b,NULL,NULL,QPoint(1,1)};
+    EditCommand a2 = {CMD_SELECT,a,NULL,NULL,QPoint(2,0)};
+    EditCommand b2 = {CMD_SELECT,b,NULL,NULL,QPoint(2,1)};
+    history.push(b1);
+    history.push(a2);
+    QCOMPARE(history.count(),3);
+    // over the limit: the oldest command goes, though it is on another floor
+    history.push(b2);
+    QCOMPARE(history.count(),3);
+    QCOMPARE(history.memoryUsage(),3 * unit);
+    EditCommand command;
+    QVERIFY(history.undo(a,&command));
+    QCOMPARE(command.point,QPoint(2,0));
+    QVERIFY(!history.canUndo(a));
+    QVERIFY(history.redo(a,&command));
+    QCOMPARE(history.peekUndo(b)->point,QPoint(2,1));
+
+    // lowering the limit drops the oldest of both floors in order
+    history.setByteLimit(unit);
+    QCOMPARE(history.count(),1);
+    QVERIFY(!history.canUndo(a));
+    QCOMPARE(history.peekUndo(b)->point,QPoint(2,1));
+    QVERIFY(history.undo(b,&command));
+    QVERIFY(!history.canUndo(b));
+    delete twoFloors;
+}
+
+void Tests::historyOwnsRemovedFeatures(){
+    Building* b = building(QList<QPolygon>() << rect(0,0,100,100) << rect(100,0,100,100));
+    Floor* floor = b->floors()[0];
+    EditHistory history;
+    EditCommand select = {CMD_SELECT,floor,NULL,NULL,QPoint()};
+    history.push(select);
+    qint64 unit = history.memoryUsage();
+
+    // a deleted feature is on no floor, the history holds it until the delete is undone
+    Feature* removed = floor->features()[1];
+    floor->removeFeature(removed);
+    EditCommand remove = {CMD_DELETE_FEATURE,floor,removed,NULL,QPoint()};
+    history.push(remove);
+    QVERIFY(history.memoryUsage() > 2 * unit);
+    EditCommand command;
+    QVERIFY(history.undo(floor,&command));
+    QCOMPARE(command.type,CMD_DELETE_FEATURE);
+    QVERIFY(floor->features().contains(removed));
+    QCOMPARE(history.memoryUsage(),2 * unit);
+    QVERIFY(history.redo(floor,&command));
+    QVERIFY(!floor->features().contains(removed));
+    QVERIFY(history.memoryUsage() > 2 * unit);
+    QVERIFY(history.undo(floor,&command));
+
+    // an added feature is on its floor until the add is undone; pushing it drops the delete from
+    // the redo stack without deleting the feature, which is back on the floor
+    Feature* added = new Feature(ROOM,rect(0,100,100,100),floor);
+    floor->addFeature(added);
+    EditCommand add = {CMD_ADD_FEATURE,floor,added,NULL,QPoint()};
+    history.push(add);
+    QCOMPARE(history.count(),2);
+    QCOMPARE(history.memoryUsage(),2 * unit);
+    QVERIFY(history.undo(floor,&command));
+    QVERIFY(!floor->features().contains(added));
+    QVERIFY(history.memoryUsage() > 2 * unit);
+
+    // clearing deletes the undone add, and leaves what is on the floor to the building
+    history.clear();
+    QCOMPARE(history.count(),0);
+    QCOMPARE(history.memoryUsage(),qint64(0));
+    QCOMPARE(floor->features().size(),2);
+    QVERIFY(floor->features().contains(removed));
+    QCOMPARE(removed->bounds(),rect(100,0,100,100));
+    delete b;
+}
+
+QTEST_GUILESS_MAIN(Tests)
+
+#include "tests.moc"
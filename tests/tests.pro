@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Checks of behaviour that is easy to get subtly wrong, run headless:
+#     qmake && make && make check
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent testlib
+
+TARGET = tests
+TEMPLATE = app
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../core.pri)
+
+SOURCES += \
+    tests.cpp
@@ -0,0 +1,269 @@
+#include "tileexporter.h"
+#include "floorrenderer.h"
+#include "tracing.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMultiHash>
+#include <QPainter>
+#include <QSaveFile>
+#include <QSet>
+#include <QThread>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtMath>
+#include <functional>
+
+using namespace DiagramModels;
+
+const char* TileExporter::MANIFEST_NAME = "tiles.json";
+
+//! Labels can spill past their feature, tiles draw the features this many pixels around them as well
+static const int LABEL_PADDING = 64;
+//! Bumped when the way tiles are drawn changes, so old manifests force a full export
+static const int MANIFEST_VERSION = 1;
+
+TileOptions TileExporter::defaults(){
+    TileOptions options;
+    options.minZoom = 0;
+    options.maxZoom = 5;
+    options.tileSize = 256;
+    options.incremental = false;
+    return options;
+}
+
+//! Everything the drawing of a feature depends on: its vertices, name, type and fill
+static quint64 signature(Feature* feature){
+    uint look = qHash(qMakePair(feature->name(),int(feature->type()) * 2 + (feature->connections().isEmpty() ? 0 : 1)));
+    return (quint64(feature->vertexHash()) << 32) | look;
+}
+
+double TileExporter::scale(const TileGrid &grid, const TileOptions &options, int z){
+    return double(options.tileSize) / grid.span * (1 << z);
+}
+
+QRect TileExporter::tilesIn(const TileGrid &grid, const TileOptions &options, int z, const QRect &rect){
+    double s = scale(grid,options,z);
+    int last = (1 << z) - 1;
+    int padding = qCeil(LABEL_PADDING / s);
+    QRect padded = rect.adjusted(-padding,-padding,padding,padding);
+    int x0 = qBound(0,qFloor((padded.left() - grid.origin.x()) * s / options.tileSize),last);
+    int y0 = qBound(0,qFloor((padded.top() - grid.origin.y()) * s / options.tileSize),last);
+    int x1 = qBound(0,qFloor((padded.right() + 1 - grid.origin.x()) * s / options.tileSize),last);
+    int y1 = qBound(0,qFloor((padded.bottom() + 1 - grid.origin.y()) * s / options.tileSize),last);
+    return QRect(QPoint(x0,y0),QPoint(x1,y1));
+}
+
+QRect TileExporter::tileRect(const TileGrid &grid, const TileOptions &options, const Tile &tile){
+    double size = options.tileSize / scale(grid,options,tile.z);
+    QRectF re(grid.origin.x() + tile.x * size,grid.origin.y() + tile.y * size,size,size);
+    return re.toAlignedRect();
+}
+
+TileExporter::TileResult TileExporter::render(Building *building, const QString &directory, const TileGrid &grid,
+                                              const TileOptions &options, const Tile &tile){
+    TRACE_SPAN(tracePaint,"renderTile");
+    Floor* floor = building->floors()[tile.floor];
+    QString path = QString("%1/%2/%3/%4/%5.png").arg(directory).arg(tile.floor).arg(tile.z).arg(tile.x).arg(tile.y);
+    QRect rect = tileRect(grid,options,tile);
+    double s = scale(grid,options,tile.z);
+    int padding = qCeil(LABEL_PADDING / s);
+    QRect visible = rect.adjusted(-padding,-padding,padding,padding);
+    if(floor->featuresIn(visible).isEmpty()){
+        return QFile::remove(path) ? TILE_REMOVED : TILE_EMPTY;
+    }
+
+    // transparent around the features, so the viewer can put the tiles over anything
+    QImage image(options.tileSize,options.tileSize,QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setPen(FloorRenderer::outlinePen());
+    painter.translate(-tile.x * options.tileSize,-tile.y * options.tileSize);
+    painter.scale(s,s);
+    painter.translate(-grid.origin);
+    FloorRenderer::drawFloor(painter,floor,visible);
+    painter.end();
+
+    if(!QDir().mkpath(QFileInfo(path).absolutePath())) return TILE_FAILED;
+    QSaveFile file(path);
+    if(!file.open(QIODevice::WriteOnly) || !image.save(&file,"PNG") || !file.commit()) return TILE_FAILED;
+    return TILE_WRITTEN;
+}
+
+bool TileExporter::changedSince(Building *building, const QString &directory, const TileGrid &grid,
+                                const TileOptions &options, QVector<QList<QRect> > *changed){
+    QFile file(QDir(directory).filePath(MANIFEST_NAME));
+    if(!file.open(QIODevice::ReadOnly)) return false;
+    QJsonObject manifest = QJsonDocument::fromJson(file.readAll()).object();
+    QJsonArray origin = manifest.value("origin").toArray();
+    QJsonArray floors = manifest.value("floors").toArray();
+    if(manifest.value("version").toInt() != MANIFEST_VERSION ||
+            manifest.value("tileSize").toInt() != options.tileSize ||
+            manifest.value("minZoom").toInt() != options.minZoom ||
+            manifest.value("maxZoom").toInt() != options.maxZoom ||
+            manifest.value("span").toInt() != grid.span ||
+            QPoint(origin.at(0).toInt(),origin.at(1).toInt()) != grid.origin ||
+            floors.size() != building->floorCount()){
+        return false;
+    }
+
+    QList<Floor*> list = building->floors();
+    changed->resize(list.size());
+    for(int f = 0; f < list.size(); f++){
+        // what was drawn last time, less each feature that is still the same; the rest are gone or changed
+        QMultiHash<quint64,QRect> before;
+        for(const QJsonValue& value : floors.at(f).toArray()){
+            QJsonArray entry = value.toArray();
+            QRect rect(entry.at(1).toInt(),entry.at(2).toInt(),entry.at(3).toInt(),entry.at(4).toInt());
+            before.insert(entry.at(0).toString().toULongLong(0,16),rect);
+        }
+        for(Feature* feature : list[f]->features()){
+            QMultiHash<quint64,QRect>::iterator it = before.find(signature(feature),feature->boundingRect());
+            if(it != before.end()) before.erase(it);
+            else (*changed)[f] << feature->boundingRect();
+        }
+        for(const QRect& rect : before) (*changed)[f] << rect;
+    }
+    return true;
+}
+
+bool TileExporter::writeManifest(Building *building, const QString &directory, const TileGrid &grid,
+                                 const TileOptions &options, QString *error){
+    QJsonArray floors;
+    for(Floor* floor : building->floors()){
+        QJsonArray features;
+        for(Feature* feature : floor->features()){
+            QRect rect = feature->boundingRect();
+            features.append(QJsonArray() << QString::number(signature(feature),16)
+                            << rect.x() << rect.y() << rect.width() << rect.height());
+        }
+        floors.append(features);
+    }
+    QJsonObject manifest;
+    manifest.insert("version",MANIFEST_VERSION);
+    manifest.insert("tileSize",options.tileSize);
+    manifest.insert("minZoom",options.minZoom);
+    manifest.insert("maxZoom",options.maxZoom);
+    manifest.insert("origin",QJsonArray() << grid.origin.x() << grid.origin.y());
+    manifest.insert("span",grid.span);
+    manifest.insert("floors",floors);
+
+    QSaveFile file(QDir(directory).filePath(MANIFEST_NAME));
+    if(!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(manifest).toJson(QJsonDocument::Compact)) < 0 ||
+            !file.commit()){
+        if(error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool TileExporter::clearTiles(const QString &directory, QString *error){
+    QDir dir(directory);
+    // first, so a full export that stops halfway isn't mistaken for a complete one
+    if(dir.exists(MANIFEST_NAME) && !dir.remove(MANIFEST_NAME)){
+        if(error) *error = "Cannot remove the old manifest from " + directory;
+        return false;
+    }
+    for(const QString& floor : dir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)){
+        bool isFloor;
+        floor.toInt(&isFloor);
+        if(!isFloor) continue;
+        QDir floorDir(dir.filePath(floor));
+        for(const QString& z : floorDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)){
+            bool isZoom;
+            z.toInt(&isZoom);
+            if(isZoom && !QDir(floorDir.filePath(z)).removeRecursively()){
+                if(error) *error = "Cannot remove the old tiles in " + floorDir.filePath(z);
+                return false;
+            }
+        }
+        dir.rmdir(floor); // only if nothing else was in it
+    }
+    return true;
+}
+
+bool TileExporter::exportTiles(Building *building, const QString &directory, const TileOptions &options,
+                               QString *error, IoMonitor *monitor, TileStats *stats){
+    TRACE_SPAN(tracePaint,"exportTiles");
+    TileStats none = {0,0,0};
+    if(stats) *stats = none;
+    if(options.minZoom < 0 || options.maxZoom > MAX_TILE_ZOOM || options.minZoom > options.maxZoom || options.tileSize < 1){
+        if(error) *error = QString("Zoom levels must be within 0 to %1 and tiles at least a pixel").arg(int(MAX_TILE_ZOOM));
+        return false;
+    }
+    if(!QDir().mkpath(directory)){
+        if(error) *error = "Cannot create " + directory;
+        return false;
+    }
+
+    // the geometry caches are built on first use, which isn't safe from several threads at once
+    QList<Floor*> floors = building->floors();
+    QRect extents;
+    for(Floor* floor : floors){
+        for(Feature* feature : floor->features()) feature->geometry();
+        extents |= floor->extents();
+    }
+    TileGrid grid = {extents.topLeft(),qMax(1,qMax(extents.width(),extents.height()))};
+
+    // the areas to redraw on each floor, all of it unless the manifest says otherwise
+    QVector<QList<QRect> > changed;
+    if(!options.incremental || !changedSince(building,directory,grid,options,&changed)){
+        // tiles left from another grid, or from floors that are gone, would look current under the new manifest
+        if(!clearTiles(directory,error)) return false;
+        changed.fill(QList<QRect>(),floors.size());
+        for(int f = 0; f < floors.size(); f++){
+            if(!floors[f]->extents().isEmpty()) changed[f] << floors[f]->extents();
+        }
+    }
+
+    QList<Tile> tiles;
+    for(int f = 0; f < floors.size(); f++){
+        for(int z = options.minZoom; z <= options.maxZoom; z++){
+            QSet<QPair<int,int> > seen;
+            for(const QRect& rect : changed[f]){
+                QRect range = tilesIn(grid,options,z,rect);
+                for(int x = range.left(); x <= range.right(); x++){
+                    for(int y = range.top(); y <= range.bottom(); y++){
+                        if(seen.contains(qMakePair(x,y))) continue;
+                        seen << qMakePair(x,y);
+                        Tile tile = {f,z,x,y};
+                        tiles << tile;
+                    }
+                }
+            }
+        }
+    }
+
+    // a batch keeps every core busy between the checks for cancellation
+    if(monitor) monitor->stage("Rendering tiles");
+    int batch = qMax(1,QThread::idealThreadCount()) * 16;
+    std::function<TileResult(const Tile&)> draw = [building,&directory,&grid,&options](const Tile& tile){
+        return render(building,directory,grid,options,tile);
+    };
+    bool failed = false;
+    for(int first = 0; first < tiles.size(); first += batch){
+        if(monitor && monitor->isCancelled()){
+            if(error) *error = "Export cancelled";
+            return false;
+        }
+        QList<TileResult> results = QtConcurrent::blockingMapped<QList<TileResult> >(tiles.mid(first,batch),draw);
+        for(TileResult result : results){
+            if(result == TILE_FAILED) failed = true;
+            if(!stats) continue;
+            if(result == TILE_WRITTEN) stats->rendered++;
+            else if(result == TILE_REMOVED) stats->removed++;
+            else if(result == TILE_EMPTY) stats->skipped++;
+        }
+        if(monitor) monitor->progress(qMin(first + batch,tiles.size()),tiles.size());
+    }
+    if(failed){
+        // the old manifest stays, so the next incremental export draws these tiles again
+        if(error) *error = "Some tiles couldn't be written to " + directory;
+        return false;
+    }
+    return writeManifest(building,directory,grid,options,error);
+}
@@ -0,0 +1,109 @@
+#ifndef TILEEXPORTER_H
+#define TILEEXPORTER_H
+
+#include <QList>
+#include <QPoint>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+#include "diagrammodels.h"
+#include "iomonitor.h"
+
+//! What TileExporter::exportTiles() renders
+typedef struct{
+    int minZoom;
+    int maxZoom;        // each zoom level doubles the tiles across, at most MAX_TILE_ZOOM
+    int tileSize;       // the width and height of a tile, in pixels
+    bool incremental;   // only redraw the tiles touched by features changed since the last export to the directory
+}TileOptions;
+
+//! What an export did
+typedef struct{
+    int rendered;   // tiles drawn and written
+    int removed;    // tiles that became empty and were deleted
+    int skipped;    // empty tiles that weren't written
+}TileStats;
+
+/*!
+ * \brief The TileExporter class renders the floors as PNG tile pyramids for slippy map viewers
+ *
+ * Tiles go to directory/floor/z/x/y.png, floor being the floor's position in the building. At zoom 0
+ * one tile covers every floor, so the pyramids of the floors line up; y grows down as in the editor,
+ * which suits a flat (non geographic) map projection. Tiles are drawn with FloorRenderer, the same
+ * code and level of detail as the editor, on the global thread pool, and tiles with no features
+ * aren't written.
+ *
+ * Each export leaves a manifest with the zoom settings and the bounding box and a hash of every
+ * feature. An incremental export compares the building with it and only redraws the tiles around
+ * features that were added, removed or changed; it falls back to a full export if the settings
+ * or the overall extents differ. A full export first removes the tiles and manifest of the previous
+ * one, as its grid may not line up with the new one.
+ */
+class TileExporter
+{
+public:
+    //! Zooms 0 to 5 of 256 pixel tiles, redrawn in full
+    static TileOptions defaults();
+
+    enum{MAX_TILE_ZOOM = 20};
+
+    //! The manifest kept next to the tiles, in the export directory
+    static const char* MANIFEST_NAME;
+
+    /*!
+     * \brief exportTiles render the tiles of every floor of a building into a directory
+     * \param building
+     * \param directory created if it doesn't exist
+     * \param options
+     * \param error set to a description of the problem if exporting fails
+     * \param monitor reports progress in tiles and stops the export if it is cancelled
+     * \param stats set to the number of tiles written and skipped
+     * \return false if the tiles couldn't all be written; the ones that were are kept and the
+     * next incremental export redoes the rest
+     */
+    static bool exportTiles(DiagramModels::Building* building, const QString& directory, const TileOptions& options,
+                            QString* error = 0, IoMonitor* monitor = 0, TileStats* stats = 0);
+
+private:
+    //! One tile to draw, of the floor at \a floor in the building
+    typedef struct{
+        int floor;
+        int z;
+        int x;
+        int y;
+    }Tile;
+
+    typedef enum{
+        TILE_WRITTEN,
+        TILE_EMPTY,
+        TILE_REMOVED,
+        TILE_FAILED
+    }TileResult;
+
+    //! Where zoom 0 is: the top left corner and the side of the square tile in floor units
+    typedef struct{
+        QPoint origin;
+        int span;
+    }TileGrid;
+
+    //! The scale of \param z, in pixels per floor unit
+    static double scale(const TileGrid& grid, const TileOptions& options, int z);
+    //! The tiles of zoom \param z that overlap \param rect, in floor units
+    static QRect tilesIn(const TileGrid& grid, const TileOptions& options, int z, const QRect& rect);
+    //! The area drawn into a tile, in floor units
+    static QRect tileRect(const TileGrid& grid, const TileOptions& options, const Tile& tile);
+    //! Draw one tile and write it, or remove it if it is empty
+    static TileResult render(DiagramModels::Building* building, const QString& directory, const TileGrid& grid,
+                             const TileOptions& options, const Tile& tile);
+    //! The parts of each floor that changed since the manifest in \param directory was written,
+    //! \return false if there is no usable manifest and everything has to be drawn
+    static bool changedSince(DiagramModels::Building* building, const QString& directory, const TileGrid& grid,
+                             const TileOptions& options, QVector<QList<QRect> >* changed);
+    static bool writeManifest(DiagramModels::Building* building, const QString& directory, const TileGrid& grid,
+                              const TileOptions& options, QString* error);
+    //! Remove the manifest and the floor/zoom directories of tiles in \param directory, nothing else in it
+    static bool clearTiles(const QString& directory, QString* error);
+};
+
+#endif // TILEEXPORTER_H
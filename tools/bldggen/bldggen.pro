@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# Writes synthetic buildings for profiling and stress tests, see BuildingGenerator:
+#     bldggen --floors 20 --rooms 5000 --seed 7 big.bldg
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent
+
+TARGET = bldggen
+TEMPLATE = app
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../../core.pri)
+
+SOURCES += \
+    main.cpp
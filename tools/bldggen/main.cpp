@@ -0,0 +1,65 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+#include "buildinggenerator.h"
+#include "filewriter.h"
+
+using namespace DiagramModels;
+
+//! Read an integer option of at least \param minimum into \param value, false if it isn't one
+static bool intOption(QCommandLineParser& parser, const QString& name, int minimum, int* value){
+    if(!parser.isSet(name)) return true;
+    bool ok;
+    int v = parser.value(name).toInt(&ok);
+    if(!ok || v < minimum) return false;
+    *value = v;
+    return true;
+}
+
+int main(int argc, char *argv[]){
+    QCoreApplication app(argc,argv);
+    QCoreApplication::setApplicationName("bldggen");
+    QTextStream err(stderr);
+    GeneratorOptions options = BuildingGenerator::defaults();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Write a synthetic building, the same options always give the same file.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("output","The file to write, JSON if it ends in .json and binary otherwise.");
+    parser.addOption(QCommandLineOption("seed","Random seed.","n",QString::number(options.seed)));
+    parser.addOption(QCommandLineOption("floors","Number of floors.","n",QString::number(options.floors)));
+    parser.addOption(QCommandLineOption("rooms","Rooms per floor.","n",QString::number(options.roomsPerFloor)));
+    parser.addOption(QCommandLineOption("vertices","Vertices per room, at least 4.","n",QString::number(options.verticesPerRoom)));
+    parser.addOption(QCommandLineOption("stairs","Fraction of rooms that are stairs.","f",QString::number(options.stairDensity)));
+    parser.addOption(QCommandLineOption("fan-out","Floors above each staircase links to.","n",QString::number(options.connectionFanOut)));
+    parser.process(app);
+
+    if(parser.positionalArguments().size() != 1){
+        err << "Expected one output file, see --help" << endl;
+        return 2;
+    }
+    bool seedOk, stairsOk;
+    options.seed = parser.value("seed").toUInt(&seedOk);
+    double stairs = parser.value("stairs").toDouble(&stairsOk);
+    if(!seedOk || !stairsOk || stairs < 0 || stairs > 1 ||
+            !intOption(parser,"floors",1,&options.floors) ||
+            !intOption(parser,"rooms",0,&options.roomsPerFloor) ||
+            !intOption(parser,"vertices",4,&options.verticesPerRoom) ||
+            !intOption(parser,"fan-out",0,&options.connectionFanOut)){
+        err << "Invalid option value, see --help" << endl;
+        return 2;
+    }
+    options.stairDensity = stairs;
+
+    QString output = parser.positionalArguments().first();
+    Building* building = BuildingGenerator::generate(options);
+    QString error;
+    bool written = FileWriter::write(building,output,&error);
+    delete building;
+    if(!written){
+        err << "Failed to write " << output << ": " << error << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#-------------------------------------------------
+#
+# Validates, converts and exports building files in batch, without a display:
+#     bldgtool validate *.bldg
+#     bldgtool convert --to json --output-dir out/ *.bldg
+#     bldgtool export --format osm,svg,pdf,geojson -j 8 *.bldg
+#     bldgtool tiles --max-zoom 6 --incremental --output-dir www/ *.bldg
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent
+
+TARGET = bldgtool
+TEMPLATE = app
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../../core.pri)
+
+SOURCES += \
+    main.cpp
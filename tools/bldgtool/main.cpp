@@ -0,0 +1,274 @@
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include "diagrammodels.h"
+#include "filereader.h"
+#include "filewriter.h"
+#include "exportpipeline.h"
+#include "tileexporter.h"
+#include "editjournal.h"
+
+using namespace DiagramModels;
+
+//! What to do with every file
+typedef enum{
+    CMD_VALIDATE,
+    CMD_CONVERT,
+    CMD_EXPORT,
+    CMD_TILES
+}BatchCommand;
+
+//! The options shared by every file of a batch
+typedef struct{
+    BatchCommand command;
+    BuildingFormat to;          // for CMD_CONVERT
+    QList<ExportFormat> exportFormats;  // for CMD_EXPORT
+    TileOptions tiles;                  // for CMD_TILES
+    GeoReference geo;                   // for CMD_EXPORT, where OSM and GeoJSON place the building
+    QString outputDir;          // empty to write next to the input
+}BatchJob;
+
+//! The outcome for one file
+typedef struct{
+    QString input;
+    QString output;         // the files written, comma separated
+    QString error;          // why the file couldn't be processed, empty if it was
+    QStringList problems;   // what validation found wrong with a file that did load
+}BatchResult;
+
+//! Problems in a loaded building that the loaders let through
+static QStringList validate(Building* building){
+    QStringList re;
+    if(building->floorCount() == 0) re << "no floors";
+    QList<Floor*> floors = building->floors();
+    for(int f = 0; f < floors.size(); f++){
+        QList<Feature*> features = floors[f]->features();
+        for(int i = 0; i < features.size(); i++){
+            Feature* feature = features[i];
+            QString where = QString("floor %1 feature %2 \"%3\"").arg(f).arg(i).arg(feature->name());
+            if(feature->bounds().size() < 3){
+                re << where + QString(" has %1 vertices").arg(feature->bounds().size());
+            }
+            for(const FeatureConnection& connection : feature->connections()){
+                if(connection.floor_index < 0 || connection.floor_index >= floors.size() ||
+                        connection.feature_index < 0 ||
+                        connection.feature_index >= floors[connection.floor_index]->featureCount()){
+                    re << where + QString(" connects to missing feature %1 on floor %2")
+                          .arg(connection.feature_index).arg(connection.floor_index);
+                }
+            }
+        }
+    }
+    return re;
+}
+
+//! Where the result of processing \param input goes, as a file with \param extension
+static QString outputPath(const BatchJob& job, const QString& input, const QString& extension){
+    QFileInfo info(input);
+    QDir dir = job.outputDir.isEmpty() ? info.absoluteDir() : QDir(job.outputDir);
+    return dir.filePath(info.completeBaseName() + "." + extension);
+}
+
+static BatchResult process(const BatchJob& job, const QString& input){
+    BatchResult result;
+    result.input = input;
+    // floors are decoded up front so a broken chunk fails here rather than on first use
+    Building* building = FileReader::loadBuidling(input,&result.error,false);
+    if(!building){
+        if(result.error.isEmpty()) result.error = "unreadable";
+        return result;
+    }
+    switch(job.command){
+    case CMD_VALIDATE:
+        result.problems = validate(building);
+        break;
+    case CMD_CONVERT:
+        result.output = outputPath(job,input,job.to == BLDG_JSON ? "json" : "bldg");
+        // the format asked for, even when converting a .bldg file in place
+        if(FileWriter::write(building,result.output,job.to,&result.error) &&
+                QFileInfo(result.output).absoluteFilePath() == QFileInfo(input).absoluteFilePath()){
+            // rewritten in place with the journal's edits included, replaying it again would be wrong
+            QFile::remove(EditJournal::journalPath(input));
+        }
+        break;
+    case CMD_EXPORT:{
+        // the sink formats share one pass over the building, OSM is written on its own
+        ExportPipeline pipeline;
+        pipeline.setGeoReference(job.geo);
+        bool piped = false;
+        QStringList outputs;
+        for(ExportFormat format : job.exportFormats){
+            QString output = outputPath(job,input,FileWriter::extensionFor(format));
+            outputs << output;
+            if(ExportPipeline::supports(format)){
+                pipeline.addSink(format,output);
+                piped = true;
+            }else if(!FileWriter::exportTo(building,output,format,job.geo,&result.error)){
+                break;
+            }
+        }
+        if(piped && result.error.isEmpty()) pipeline.run(building,&result.error);
+        result.output = outputs.join(", ");
+        break;
+    }
+    case CMD_TILES:
+        // a directory of tiles per building, named after it
+        result.output = outputPath(job,input,"tiles");
+        TileExporter::exportTiles(building,result.output,job.tiles,&result.error);
+        break;
+    }
+    delete building;
+    return result;
+}
+
+int main(int argc, char *argv[]){
+    // PDF export paints text, which needs a QGuiApplication, but never a display
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM","offscreen");
+    QGuiApplication app(argc,argv);
+    QCoreApplication::setApplicationName("bldgtool");
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Validate, convert, export or tile building files, several at once.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command","validate, convert, export or tiles");
+    parser.addPositionalArgument("files","The building files to process.","files...");
+    QCommandLineOption jobsOption(QStringList() << "j" << "jobs","Files processed at once, the number of cores by default.","n",
+                                  QString::number(QThread::idealThreadCount()));
+    QCommandLineOption toOption("to","convert: the format to write, bldg or json.","format","bldg");
+    QCommandLineOption formatOption("format","export: the formats to write, comma separated: osm, svg, pdf, geojson.",
+                                    "formats","osm");
+    GeoReference geo;
+    QCommandLineOption originOption("origin","export: the latitude and longitude of floor point (0, 0) for osm and geojson.",
+                                    "lat,lon",QString("%1,%2").arg(geo.originLat).arg(geo.originLon));
+    QCommandLineOption scaleOption("metres-per-unit","export: the length of one floor unit for osm and geojson.","metres",
+                                   QString::number(geo.metresPerUnit));
+    TileOptions tiles = TileExporter::defaults();
+    QCommandLineOption minZoomOption("min-zoom","tiles: the first zoom level.","z",QString::number(tiles.minZoom));
+    QCommandLineOption maxZoomOption("max-zoom","tiles: the last zoom level.","z",QString::number(tiles.maxZoom));
+    QCommandLineOption tileSizeOption("tile-size","tiles: the size of a tile in pixels.","pixels",QString::number(tiles.tileSize));
+    QCommandLineOption incrementalOption("incremental","tiles: only redraw the tiles of features changed since the last run.");
+    QCommandLineOption outputOption("output-dir","Write results here instead of next to each input.","dir");
+    parser.addOption(jobsOption);
+    parser.addOption(toOption);
+    parser.addOption(formatOption);
+    parser.addOption(originOption);
+    parser.addOption(scaleOption);
+    parser.addOption(minZoomOption);
+    parser.addOption(maxZoomOption);
+    parser.addOption(tileSizeOption);
+    parser.addOption(incrementalOption);
+    parser.addOption(outputOption);
+    parser.process(app);
+
+    QStringList args = parser.positionalArguments();
+    if(args.size() < 2){
+        err << "Expected a command and at least one file, see --help" << endl;
+        return 2;
+    }
+    BatchJob job;
+    QString command = args.takeFirst();
+    if(command == "validate") job.command = CMD_VALIDATE;
+    else if(command == "convert") job.command = CMD_CONVERT;
+    else if(command == "export") job.command = CMD_EXPORT;
+    else if(command == "tiles") job.command = CMD_TILES;
+    else{
+        err << "Unknown command " << command << ", see --help" << endl;
+        return 2;
+    }
+    QString to = parser.value(toOption);
+    if(to != "bldg" && to != "json"){
+        err << "Unknown format " << to << " for --to" << endl;
+        return 2;
+    }
+    job.to = to == "json" ? BLDG_JSON : BLDG_BINARY;
+    for(const QString& format : parser.value(formatOption).split(',',QString::SkipEmptyParts)){
+        if(format == "osm") job.exportFormats << OSM;
+        else if(format == "svg") job.exportFormats << SVG;
+        else if(format == "pdf") job.exportFormats << PDF;
+        else if(format == "geojson") job.exportFormats << GEOJSON;
+        else{
+            err << "Unknown format " << format << " for --format" << endl;
+            return 2;
+        }
+    }
+    if(job.exportFormats.isEmpty()){
+        err << "--format needs at least one format" << endl;
+        return 2;
+    }
+    QStringList origin = parser.value(originOption).split(',');
+    bool latOk = false, lonOk = false, scaleOk;
+    if(origin.size() == 2){
+        geo.originLat = origin[0].trimmed().toDouble(&latOk);
+        geo.originLon = origin[1].trimmed().toDouble(&lonOk);
+    }
+    geo.metresPerUnit = parser.value(scaleOption).toDouble(&scaleOk);
+    if(!latOk || !lonOk || qAbs(geo.originLat) >= 90 || qAbs(geo.originLon) > 180){
+        err << "--origin must be a latitude within -90 to 90 and a longitude within -180 to 180, e.g. 51.5,-0.12" << endl;
+        return 2;
+    }
+    if(!scaleOk || geo.metresPerUnit <= 0){
+        err << "--metres-per-unit must be more than 0" << endl;
+        return 2;
+    }
+    job.geo = geo;
+    bool minOk, maxOk, sizeOk;
+    tiles.minZoom = parser.value(minZoomOption).toInt(&minOk);
+    tiles.maxZoom = parser.value(maxZoomOption).toInt(&maxOk);
+    tiles.tileSize = parser.value(tileSizeOption).toInt(&sizeOk);
+    tiles.incremental = parser.isSet(incrementalOption);
+    if(!minOk || !maxOk || !sizeOk || tiles.minZoom < 0 || tiles.maxZoom > TileExporter::MAX_TILE_ZOOM ||
+            tiles.minZoom > tiles.maxZoom || tiles.tileSize < 1){
+        err << "Zoom levels must be within 0 to " << int(TileExporter::MAX_TILE_ZOOM) << " and the tile size at least 1" << endl;
+        return 2;
+    }
+    job.tiles = tiles;
+    job.outputDir = parser.value(outputOption);
+    if(!job.outputDir.isEmpty() && !QDir().mkpath(job.outputDir)){
+        err << "Cannot create " << job.outputDir << endl;
+        return 2;
+    }
+    bool ok;
+    int jobs = parser.value(jobsOption).toInt(&ok);
+    if(!ok || jobs < 1){
+        err << "--jobs must be at least 1" << endl;
+        return 2;
+    }
+
+    // the files are the unit of parallelism, building each one on several threads as well would oversubscribe
+    if(jobs > 1) Building::setSingleThreadedLoading(true);
+    QThreadPool pool;
+    pool.setMaxThreadCount(jobs);
+    QList<QFuture<BatchResult> > futures;
+    for(const QString& input : args){
+        futures << QtConcurrent::run(&pool,process,job,input);
+    }
+
+    // reported in the order given, each as soon as it and the ones before it are done
+    int failed = 0;
+    for(QFuture<BatchResult>& future : futures){
+        BatchResult result = future.result();
+        if(!result.error.isEmpty() || !result.problems.isEmpty()) failed++;
+        if(!result.error.isEmpty()){
+            out << "FAIL\t" << result.input << "\t" << result.error << endl;
+        }else if(!result.problems.isEmpty()){
+            out << "INVALID\t" << result.input << "\t" << result.problems.size() << " problems" << endl;
+            for(const QString& problem : result.problems) out << "\t" << problem << endl;
+        }else if(!result.output.isEmpty()){
+            out << "OK\t" << result.input << "\t" << result.output << endl;
+        }else{
+            out << "OK\t" << result.input << endl;
+        }
+    }
+    err << args.size() - failed << " of " << args.size() << " files OK" << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,241 @@
+#include "tracing.h"
+
+#ifdef FLOORPLAN_TRACING
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(traceLoad,"floorplan.load",QtInfoMsg)
+Q_LOGGING_CATEGORY(traceSave,"floorplan.save",QtInfoMsg)
+Q_LOGGING_CATEGORY(tracePaint,"floorplan.paint",QtInfoMsg)
+Q_LOGGING_CATEGORY(traceHitTest,"floorplan.hittest",QtInfoMsg)
+Q_LOGGING_CATEGORY(traceSnap,"floorplan.snap",QtInfoMsg)
+Q_LOGGING_CATEGORY(traceUndo,"floorplan.undo",QtInfoMsg)
+Q_LOGGING_CATEGORY(traceRoute,"floorplan.route",QtInfoMsg)
+
+namespace{
+    //! Spans kept for the trace file, older ones are dropped past this
+    const int MAX_EVENTS = 1000000;
+    //! Durations kept per span name for spanStats()
+    const int STATS_WINDOW = 256;
+
+    typedef struct{
+        const char* category;
+        const char* name;
+        qint64 start;
+        qint64 duration;
+        Qt::HANDLE thread;
+    }Event;
+
+    //! The last STATS_WINDOW durations of one span name
+    typedef struct{
+        QVector<qint64> durations;
+        int next;
+    }SpanHistory;
+
+    //! Everything recorded since the first span or counter, shared by every thread
+    struct Registry{
+        QMutex mutex;
+        QElapsedTimer clock;
+        QVector<Event> events;
+        int first; // the oldest event once events has wrapped around
+        qint64 dropped;
+        QHash<QByteArray,QAtomicInteger<qint64>*> counters;
+        QHash<QByteArray,SpanHistory> spans;
+
+        Registry():first(0),dropped(0){clock.start();}
+    };
+
+    Registry& registry(){
+        static Registry instance;
+        return instance;
+    }
+
+    //! Append \param text to \param out as a JSON string
+    void appendString(QByteArray& out, const char* text){
+        out += '"';
+        for(const char* c = text; *c; c++){
+            if(*c == '"' || *c == '\\') out += '\\';
+            if(uchar(*c) >= 0x20) out += *c;
+        }
+        out += '"';
+    }
+}
+
+Tracing::Counter::Counter(const char *name){
+    Registry& r = registry();
+    QMutexLocker lock(&r.mutex);
+    QAtomicInteger<qint64>*& value = r.counters[QByteArray(name)];
+    if(!value) value = new QAtomicInteger<qint64>(0);
+    _value = value;
+}
+
+Tracing::Span::Span(const QLoggingCategory &category, const char *name):
+    _category(category.categoryName()),_name(name),_start(-1){
+    if(category.isDebugEnabled()) _start = registry().clock.nsecsElapsed();
+}
+
+Tracing::Span::Span(const QLoggingCategory &category, const char *name, qint64 start):
+    _category(category.categoryName()),_name(name),_start(category.isDebugEnabled() ? start : -1){}
+
+Tracing::Span::~Span(){
+    if(_start < 0) return;
+    Registry& r = registry();
+    Event event = {_category,_name,_start,r.clock.nsecsElapsed() - _start,QThread::currentThreadId()};
+    QMutexLocker lock(&r.mutex);
+    if(r.events.size() < MAX_EVENTS){
+        r.events << event;
+    }else{
+        r.events[r.first] = event;
+        r.first = (r.first + 1) % MAX_EVENTS;
+        r.dropped++;
+    }
+    SpanHistory& history = r.spans[QByteArray::fromRawData(_name,int(qstrlen(_name)))];
+    if(history.durations.size() < STATS_WINDOW){
+        history.durations << event.duration;
+        history.next = 0;
+    }else{
+        history.durations[history.next] = event.duration;
+        history.next = (history.next + 1) % STATS_WINDOW;
+    }
+}
+
+bool Tracing::compiledIn(){
+    return true;
+}
+
+void Tracing::setEnabled(const QLoggingCategory &category, bool enabled){
+    // categories are only handed out const, but each one is a plain static object
+    const_cast<QLoggingCategory&>(category).setEnabled(QtDebugMsg,enabled);
+}
+
+qint64 Tracing::counterValue(const char *name){
+    Registry& r = registry();
+    QMutexLocker lock(&r.mutex);
+    QAtomicInteger<qint64>* value = r.counters.value(QByteArray(name));
+    return value ? value->load() : 0;
+}
+
+Tracing::SpanStats Tracing::spanStats(const char *name){
+    SpanStats stats = {0,0,0};
+    QVector<qint64> durations;
+    {
+        Registry& r = registry();
+        QMutexLocker lock(&r.mutex);
+        auto it = r.spans.constFind(QByteArray::fromRawData(name,int(qstrlen(name))));
+        if(it == r.spans.constEnd() || it->durations.isEmpty()) return stats;
+        durations = it->durations;
+        int lastIndex = durations.size() < STATS_WINDOW ? durations.size() - 1 : (it->next + STATS_WINDOW - 1) % STATS_WINDOW;
+        stats.last = durations[lastIndex];
+    }
+    stats.samples = durations.size();
+    QVector<qint64>::iterator p95 = durations.begin() + (durations.size() - 1) * 95 / 100;
+    std::nth_element(durations.begin(),p95,durations.end());
+    stats.p95 = *p95;
+    return stats;
+}
+
+qint64 Tracing::now(){
+    return registry().clock.nsecsElapsed();
+}
+
+void Tracing::reset(){
+    Registry& r = registry();
+    QMutexLocker lock(&r.mutex);
+    r.events.clear();
+    r.first = 0;
+    r.dropped = 0;
+    r.spans.clear();
+    for(QAtomicInteger<qint64>* value : r.counters) value->store(0);
+}
+
+bool Tracing::writeChromeTrace(const QString &filepath, QString *error){
+    Registry& r = registry();
+    QVector<Event> events;
+    QHash<QByteArray,qint64> counters;
+    qint64 now;
+    {
+        QMutexLocker lock(&r.mutex);
+        // oldest first, so the file reads in time order
+        events.reserve(r.events.size());
+        for(int i = 0; i < r.events.size(); i++) events << r.events[(r.first + i) % r.events.size()];
+        for(auto it = r.counters.constBegin(); it != r.counters.constEnd(); ++it) counters[it.key()] = it.value()->load();
+        now = r.clock.nsecsElapsed();
+        if(r.dropped) qWarning("Trace is missing its oldest %lld spans",r.dropped);
+    }
+
+    QSaveFile file(filepath);
+    if(!file.open(QIODevice::WriteOnly)){
+        if(error) *error = file.errorString();
+        return false;
+    }
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    QHash<Qt::HANDLE,int> threads; // small stable ids read better than handles
+    QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for(const Event& event : events){
+        if(!first) out += ",\n";
+        first = false;
+        if(!threads.contains(event.thread)) threads.insert(event.thread,threads.size() + 1);
+        out += "{\"ph\":\"X\",\"cat\":";
+        appendString(out,event.category);
+        out += ",\"name\":";
+        appendString(out,event.name);
+        out += ",\"ts\":" + QByteArray::number(event.start / 1000.0,'f',3);
+        out += ",\"dur\":" + QByteArray::number(event.duration / 1000.0,'f',3);
+        out += ",\"pid\":" + pid + ",\"tid\":" + QByteArray::number(threads.value(event.thread)) + "}";
+        if(out.size() >= (1 << 20)){
+            file.write(out);
+            out.clear();
+        }
+    }
+    for(auto it = counters.constBegin(); it != counters.constEnd(); ++it){
+        if(!first) out += ",\n";
+        first = false;
+        out += "{\"ph\":\"C\",\"name\":";
+        appendString(out,it.key().constData());
+        out += ",\"ts\":" + QByteArray::number(now / 1000.0,'f',3);
+        out += ",\"pid\":" + pid + ",\"args\":{\"value\":" + QByteArray::number(it.value()) + "}}";
+    }
+    out += "\n]}\n";
+    file.write(out);
+    if(!file.commit()){
+        if(error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+#else
+
+bool Tracing::compiledIn(){
+    return false;
+}
+
+qint64 Tracing::counterValue(const char*){
+    return 0;
+}
+
+Tracing::SpanStats Tracing::spanStats(const char*){
+    SpanStats stats = {0,0,0};
+    return stats;
+}
+
+qint64 Tracing::now(){
+    return -1;
+}
+
+void Tracing::reset(){}
+
+bool Tracing::writeChromeTrace(const QString&, QString *error){
+    if(error) *error = "Tracing is not compiled in, rebuild with CONFIG+=tracing";
+    return false;
+}
+
+#endif
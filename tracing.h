@@ -0,0 +1,116 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QString>
+
+/*
+ * Trace spans and counters for the hot paths.
+ *
+ * The macros only compile to something in builds configured with CONFIG+=tracing, which defines
+ * FLOORPLAN_TRACING; otherwise they expand to empty statements and their arguments are never
+ * evaluated. When compiled in, every category is off until it is enabled through the logging rules,
+ * e.g. QT_LOGGING_RULES="floorplan.paint.debug=true" or "floorplan.*.debug=true", so a disabled span
+ * costs one flag check.
+ *
+ *  TRACE_SPAN(traceLoad, "readJson");               times the rest of the enclosing scope
+ *  TRACE_MARK(_inputTime);                          stores the current trace time in a qint64
+ *  TRACE_SPAN_SINCE(tracePaint, "latency", _inputTime); times from a mark to the end of the scope
+ *  TRACE_COUNT(tracePaint, "features drawn", 1);    adds to a named counter
+ */
+
+#ifdef FLOORPLAN_TRACING
+#include <QLoggingCategory>
+#include <QAtomicInteger>
+
+Q_DECLARE_LOGGING_CATEGORY(traceLoad)    // floorplan.load: reading files, building floors, replaying journals
+Q_DECLARE_LOGGING_CATEGORY(traceSave)    // floorplan.save: encoding, writing, journal appends and autosaves
+Q_DECLARE_LOGGING_CATEGORY(tracePaint)   // floorplan.paint: paint events and the static layer
+Q_DECLARE_LOGGING_CATEGORY(traceHitTest) // floorplan.hittest: finding features under a point
+Q_DECLARE_LOGGING_CATEGORY(traceSnap)    // floorplan.snap: snapping edit points
+Q_DECLARE_LOGGING_CATEGORY(traceUndo)    // floorplan.undo: undo, redo and the edit history
+Q_DECLARE_LOGGING_CATEGORY(traceRoute)   // floorplan.route: the connection graph and route queries
+#endif
+
+namespace Tracing{
+    //! If the build has tracing compiled in
+    bool compiledIn();
+    /*!
+     * \brief writeChromeTrace write the spans recorded so far and the counter totals as a Chrome
+     * trace-event file, which chrome://tracing and Perfetto open
+     * \param filepath
+     * \param error set to the problem if the file can't be written
+     * \return false if the file couldn't be written, or tracing isn't compiled in
+     */
+    bool writeChromeTrace(const QString& filepath, QString* error = 0);
+    //! The total of the counter called \param name, 0 if it never counted or tracing isn't compiled in
+    qint64 counterValue(const char* name);
+    //! Durations of the recent spans with one name, in nanoseconds
+    typedef struct{
+        int samples;  // how many recent spans the figures cover, 0 if there were none
+        qint64 last;
+        qint64 p95;
+    }SpanStats;
+    //! Statistics over the last few hundred spans called \param name
+    SpanStats spanStats(const char* name);
+    //! Nanoseconds since tracing started, -1 if tracing isn't compiled in
+    qint64 now();
+    //! Zero every counter and drop the recorded spans
+    void reset();
+
+#ifdef FLOORPLAN_TRACING
+    /*!
+     * \brief The Counter class is a named total, one static instance per TRACE_COUNT site
+     * Sites with the same name share a total.
+     */
+    class Counter
+    {
+    public:
+        explicit Counter(const char* name);
+        void add(qint64 n){_value->fetchAndAddRelaxed(n);}
+    private:
+        QAtomicInteger<qint64>* _value; //! Owned by the registry, shared by every site with the name
+    };
+
+    /*!
+     * \brief The Span class records the time between its construction and destruction
+     * Nothing is recorded if the category was disabled when the span started.
+     */
+    class Span
+    {
+    public:
+        Span(const QLoggingCategory& category, const char* name);
+        //! Time from \param start, a value of now(), instead of from construction; negative starts aren't recorded
+        Span(const QLoggingCategory& category, const char* name, qint64 start);
+        ~Span();
+    private:
+        Q_DISABLE_COPY(Span)
+        const char* _category;
+        const char* _name;
+        qint64 _start; //! Nanoseconds since tracing started, -1 when the category is disabled
+    };
+
+    //! Turn the spans and counters of \param category on or off, on top of the logging rules
+    void setEnabled(const QLoggingCategory& category, bool enabled);
+#endif
+}
+
+#ifdef FLOORPLAN_TRACING
+#define TRACE_CONCAT_(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT_(a,b)
+#define TRACE_SPAN(category, name) Tracing::Span TRACE_CONCAT(_traceSpan,__LINE__)(category(),name)
+#define TRACE_SPAN_SINCE(category, name, start) Tracing::Span TRACE_CONCAT(_traceSpan,__LINE__)(category(),name,start)
+#define TRACE_MARK(var) ((var) = Tracing::now())
+#define TRACE_COUNT(category, name, n) do{ \
+        if(category().isDebugEnabled()){ \
+            static Tracing::Counter _traceCounter(name); \
+            _traceCounter.add(n); \
+        } \
+    }while(0)
+#else
+#define TRACE_SPAN(category, name) do{}while(0)
+#define TRACE_SPAN_SINCE(category, name, start) do{}while(0)
+#define TRACE_MARK(var) do{}while(0)
+#define TRACE_COUNT(category, name, n) do{}while(0)
+#endif
+
+#endif // TRACING_H